@@ -0,0 +1,53 @@
+/* contrib/fuzzystrmatch/fuzzystrmatch--1.1--1.2.sql */
+
+-- complain if script is sourced in psql, rather than via ALTER EXTENSION
+\echo Use "ALTER EXTENSION fuzzystrmatch UPDATE TO '1.2'" to load this file. \quit
+
+CREATE FUNCTION levenshtein_op(text, text) RETURNS bool
+AS 'MODULE_PATHNAME'
+LANGUAGE C STRICT STABLE PARALLEL SAFE;  -- stable because depends on fuzzystrmatch.levenshtein_threshold
+
+CREATE OPERATOR <~ (
+	LEFTARG = text,
+	RIGHTARG = text,
+	PROCEDURE = levenshtein_op,
+	COMMUTATOR = '<~',
+	RESTRICT = contsel,
+	JOIN = contjoinsel
+);
+
+-- SP-GiST BK-tree support
+CREATE FUNCTION spg_levenshtein_config(internal, internal)
+RETURNS void
+AS 'MODULE_PATHNAME'
+LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE FUNCTION spg_levenshtein_choose(internal, internal)
+RETURNS void
+AS 'MODULE_PATHNAME'
+LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE FUNCTION spg_levenshtein_picksplit(internal, internal)
+RETURNS void
+AS 'MODULE_PATHNAME'
+LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE FUNCTION spg_levenshtein_inner_consistent(internal, internal)
+RETURNS void
+AS 'MODULE_PATHNAME'
+LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE FUNCTION spg_levenshtein_leaf_consistent(internal, internal)
+RETURNS bool
+AS 'MODULE_PATHNAME'
+LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OPERATOR CLASS spgist_levenshtein_ops
+FOR TYPE text USING spgist
+AS
+	OPERATOR	1	<~ (text, text),
+	FUNCTION	1	spg_levenshtein_config(internal, internal),
+	FUNCTION	2	spg_levenshtein_choose(internal, internal),
+	FUNCTION	3	spg_levenshtein_picksplit(internal, internal),
+	FUNCTION	4	spg_levenshtein_inner_consistent(internal, internal),
+	FUNCTION	5	spg_levenshtein_leaf_consistent(internal, internal);
@@ -0,0 +1,9 @@
+/* contrib/fuzzystrmatch/fuzzystrmatch--1.2--1.3.sql */
+
+-- complain if script is sourced in psql, rather than via ALTER EXTENSION
+\echo Use "ALTER EXTENSION fuzzystrmatch UPDATE TO '1.3'" to load this file. \quit
+
+-- distance if it is at most the third argument, else NULL
+CREATE FUNCTION levenshtein_within(text, text, int) RETURNS int
+AS 'MODULE_PATHNAME'
+LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
@@ -40,12 +40,40 @@
 
 #include <ctype.h>
 
+#include "fuzzystrmatch.h"
 #include "mb/pg_wchar.h"
 #include "utils/builtins.h"
+#include "utils/guc.h"
 #include "utils/varlena.h"
 
 PG_MODULE_MAGIC;
 
+/* GUC variables */
+int			levenshtein_threshold = 1;
+
+void		_PG_init(void);
+
+/*
+ * Module load callback
+ */
+void
+_PG_init(void)
+{
+	/* Define custom GUC variables. */
+	DefineCustomIntVariable("fuzzystrmatch.levenshtein_threshold",
+							"Sets the edit distance accepted by the <~ operator.",
+							NULL,
+							&levenshtein_threshold,
+							1,
+							0,
+							MAX_LEVENSHTEIN_STRLEN,
+							PGC_USERSET,
+							0,
+							NULL,
+							NULL,
+							NULL);
+}
+
 /*
  * Soundex
  */
@@ -143,6 +171,165 @@ getcode(char c)
 /* These prevent GH from becoming F */
 #define NOGHTOF(c)	(getcode(c) & 16)	/* BDH */
 
+/*
+ * Levenshtein operand cache
+ *
+ * In a nested loop, one outer string is compared against every inner string,
+ * so successive calls very often share their first argument.  We keep the
+ * preprocessed form of the most recent one in fn_extra: its character
+ * lengths and the work rows for the distance matrix, plus, for single-byte
+ * strings of up to 64 characters, the match masks of Myers' bit-parallel
+ * algorithm, which then replaces the matrix for unit costs.
+ */
+#define MYERS_MAX_LEN	64
+
+typedef struct LevenshteinCache
+{
+	LevenshteinSource source;
+	bool		valid;			/* source holds a usable string */
+	bool		use_myers;		/* peq is set up */
+	uint64		peq[256];		/* positions of each byte value in source */
+
+	/* last result of levenshtein_within() for this source */
+	bool		memo_valid;
+	char	   *memo_target;
+	int			memo_bytes;
+	int			memo_alloc;		/* allocated size of memo_target */
+	int			memo_max_d;
+	int			memo_result;
+} LevenshteinCache;
+
+static LevenshteinCache *
+levenshtein_cache(FunctionCallInfo fcinfo, const char *s_data, int s_bytes)
+{
+	LevenshteinCache *cache = (LevenshteinCache *) fcinfo->flinfo->fn_extra;
+	MemoryContext oldcontext;
+	int			i;
+
+	if (cache == NULL)
+	{
+		cache = (LevenshteinCache *)
+			MemoryContextAllocZero(fcinfo->flinfo->fn_mcxt,
+								   sizeof(LevenshteinCache));
+		fcinfo->flinfo->fn_extra = (void *) cache;
+	}
+	else if (cache->valid && cache->source.slen == s_bytes &&
+			 memcmp(cache->source.str, s_data, s_bytes) == 0)
+		return cache;
+
+	cache->valid = false;
+	cache->memo_valid = false;
+	oldcontext = MemoryContextSwitchTo(fcinfo->flinfo->fn_mcxt);
+	varstr_levenshtein_prepare(&cache->source, s_data, s_bytes);
+	MemoryContextSwitchTo(oldcontext);
+
+	cache->use_myers = (s_bytes > 0 && s_bytes <= MYERS_MAX_LEN &&
+						cache->source.m == s_bytes);
+	if (cache->use_myers)
+	{
+		memset(cache->peq, 0, sizeof(cache->peq));
+		for (i = 0; i < s_bytes; i++)
+			cache->peq[(unsigned char) s_data[i]] |= UINT64CONST(1) << i;
+	}
+	cache->valid = true;
+
+	return cache;
+}
+
+/*
+ * Unit-cost Levenshtein distance from the cached source to a single-byte
+ * target, computed one target character at a time on bit vectors of vertical
+ * deltas (Hyyro's formulation of Myers' algorithm).  If max_d >= 0, gives up
+ * with max_d + 1 as soon as the distance is certain to exceed max_d.
+ */
+static int
+levenshtein_myers(const LevenshteinCache *cache, const char *target, int tlen,
+				  int max_d)
+{
+	uint64		last = UINT64CONST(1) << (cache->source.m - 1);
+	uint64		pv = ~UINT64CONST(0);
+	uint64		mv = 0;
+	int			score = cache->source.m;
+	int			j;
+
+	for (j = 0; j < tlen; j++)
+	{
+		uint64		eq = cache->peq[(unsigned char) target[j]];
+		uint64		xv = eq | mv;
+		uint64		xh = (((eq & pv) + pv) ^ pv) | eq;
+		uint64		ph = mv | ~(xh | pv);
+		uint64		mh = pv & xh;
+
+		if (ph & last)
+			score++;
+		else if (mh & last)
+			score--;
+
+		/* row 0 of the matrix grows by one per column */
+		ph = (ph << 1) | 1;
+		mh <<= 1;
+		pv = mh | ~(xv | ph);
+		mv = ph & xv;
+
+		/* each remaining target character lowers the score by one at most */
+		if (max_d >= 0 && score - (tlen - j - 1) > max_d)
+			return max_d + 1;
+	}
+
+	return score;
+}
+
+/*
+ * Common code of the levenshtein() variants.  max_d is only used if bounded.
+ * Unless trusted, strings longer than MAX_LEVENSHTEIN_STRLEN are rejected.
+ */
+static int
+levenshtein_common(FunctionCallInfo fcinfo, text *src, text *dst,
+				   int ins_c, int del_c, int sub_c,
+				   bool bounded, int max_d, bool trusted)
+{
+	LevenshteinCache *cache;
+	const char *t_data;
+	int			t_bytes;
+
+	t_data = VARDATA_ANY(dst);
+	t_bytes = VARSIZE_ANY_EXHDR(dst);
+
+	cache = levenshtein_cache(fcinfo, VARDATA_ANY(src), VARSIZE_ANY_EXHDR(src));
+
+	/*
+	 * Untrusted longer targets take the general path, which enforces the
+	 * length limit.
+	 */
+	if (cache->use_myers && ins_c == 1 && del_c == 1 && sub_c == 1 &&
+		(trusted || t_bytes <= MAX_LEVENSHTEIN_STRLEN))
+	{
+		int			i = 0;
+
+		/* in multibyte encodings, all bytes of non-ASCII characters are high */
+		if (pg_database_encoding_max_length() > 1)
+		{
+			while (i < t_bytes && !IS_HIGHBIT_SET(t_data[i]))
+				i++;
+		}
+		else
+			i = t_bytes;
+
+		if (i == t_bytes)
+			return levenshtein_myers(cache, t_data, t_bytes,
+									 bounded ? max_d : -1);
+	}
+
+	if (bounded)
+		return varstr_levenshtein_less_equal_prepared(&cache->source,
+													  t_data, t_bytes,
+													  ins_c, del_c, sub_c,
+													  max_d, trusted);
+	return varstr_levenshtein_prepared(&cache->source, t_data, t_bytes,
+									   ins_c, del_c, sub_c, trusted);
+}
+
+
 PG_FUNCTION_INFO_V1(levenshtein_with_costs);
 Datum
 levenshtein_with_costs(PG_FUNCTION_ARGS)
@@ -152,20 +339,9 @@ levenshtein_with_costs(PG_FUNCTION_ARGS)
 	int			ins_c = PG_GETARG_INT32(2);
 	int			del_c = PG_GETARG_INT32(3);
 	int			sub_c = PG_GETARG_INT32(4);
-	const char *s_data;
-	const char *t_data;
-	int			s_bytes,
-				t_bytes;
 
-	/* Extract a pointer to the actual character data */
-	s_data = VARDATA_ANY(src);
-	t_data = VARDATA_ANY(dst);
-	/* Determine length of each string in bytes */
-	s_bytes = VARSIZE_ANY_EXHDR(src);
-	t_bytes = VARSIZE_ANY_EXHDR(dst);
-
-	PG_RETURN_INT32(varstr_levenshtein(s_data, s_bytes, t_data, t_bytes,
-									   ins_c, del_c, sub_c, false));
+	PG_RETURN_INT32(levenshtein_common(fcinfo, src, dst,
+									   ins_c, del_c, sub_c, false, 0, false));
 }
 
 
@@ -175,20 +351,9 @@ levenshtein(PG_FUNCTION_ARGS)
 {
 	text	   *src = PG_GETARG_TEXT_PP(0);
 	text	   *dst = PG_GETARG_TEXT_PP(1);
-	const char *s_data;
-	const char *t_data;
-	int			s_bytes,
-				t_bytes;
-
-	/* Extract a pointer to the actual character data */
-	s_data = VARDATA_ANY(src);
-	t_data = VARDATA_ANY(dst);
-	/* Determine length of each string in bytes */
-	s_bytes = VARSIZE_ANY_EXHDR(src);
-	t_bytes = VARSIZE_ANY_EXHDR(dst);
 
-	PG_RETURN_INT32(varstr_levenshtein(s_data, s_bytes, t_data, t_bytes,
-									   1, 1, 1, false));
+	PG_RETURN_INT32(levenshtein_common(fcinfo, src, dst, 1, 1, 1, false, 0,
+									   false));
 }
 
 
@@ -202,22 +367,10 @@ levenshtein_less_equal_with_costs(PG_FUNCTION_ARGS)
 	int			del_c = PG_GETARG_INT32(3);
 	int			sub_c = PG_GETARG_INT32(4);
 	int			max_d = PG_GETARG_INT32(5);
-	const char *s_data;
-	const char *t_data;
-	int			s_bytes,
-				t_bytes;
-
-	/* Extract a pointer to the actual character data */
-	s_data = VARDATA_ANY(src);
-	t_data = VARDATA_ANY(dst);
-	/* Determine length of each string in bytes */
-	s_bytes = VARSIZE_ANY_EXHDR(src);
-	t_bytes = VARSIZE_ANY_EXHDR(dst);
 
-	PG_RETURN_INT32(varstr_levenshtein_less_equal(s_data, s_bytes,
-												  t_data, t_bytes,
-												  ins_c, del_c, sub_c,
-												  max_d, false));
+	PG_RETURN_INT32(levenshtein_common(fcinfo, src, dst,
+									   ins_c, del_c, sub_c, true, max_d,
+									   false));
 }
 
 
@@ -228,22 +381,88 @@ levenshtein_less_equal(PG_FUNCTION_ARGS)
 	text	   *src = PG_GETARG_TEXT_PP(0);
 	text	   *dst = PG_GETARG_TEXT_PP(1);
 	int			max_d = PG_GETARG_INT32(2);
-	const char *s_data;
-	const char *t_data;
-	int			s_bytes,
-				t_bytes;
 
-	/* Extract a pointer to the actual character data */
-	s_data = VARDATA_ANY(src);
-	t_data = VARDATA_ANY(dst);
-	/* Determine length of each string in bytes */
-	s_bytes = VARSIZE_ANY_EXHDR(src);
-	t_bytes = VARSIZE_ANY_EXHDR(dst);
+	PG_RETURN_INT32(levenshtein_common(fcinfo, src, dst, 1, 1, 1,
+									   true, max_d, false));
+}
+
+
+/*
+ * levenshtein_within(source, target, max_d) returns the distance between
+ * the strings if it is at most max_d, and NULL otherwise.
+ *
+ * "levenshtein_within(a, b, k) IS NOT NULL" is recognised as an edit-distance
+ * join clause, so a single similarity join at the largest threshold of
+ * interest yields every pair together with its exact distance; the smaller
+ * thresholds are then plain comparisons on that distance.  The join emits
+ * all row pairs of one key pair consecutively, so the last result is kept
+ * and reused when the same strings come in again.
+ */
+PG_FUNCTION_INFO_V1(levenshtein_within);
+Datum
+levenshtein_within(PG_FUNCTION_ARGS)
+{
+	text	   *src = PG_GETARG_TEXT_PP(0);
+	text	   *dst = PG_GETARG_TEXT_PP(1);
+	int			max_d = PG_GETARG_INT32(2);
+	const char *t_data = VARDATA_ANY(dst);
+	int			t_bytes = VARSIZE_ANY_EXHDR(dst);
+	LevenshteinCache *cache;
+	int			d;
+
+	if (max_d < 0)
+		PG_RETURN_NULL();
+
+	cache = levenshtein_cache(fcinfo, VARDATA_ANY(src), VARSIZE_ANY_EXHDR(src));
+	if (cache->memo_valid && cache->memo_max_d == max_d &&
+		cache->memo_bytes == t_bytes &&
+		memcmp(cache->memo_target, t_data, t_bytes) == 0)
+		d = cache->memo_result;
+	else
+	{
+		d = levenshtein_common(fcinfo, src, dst, 1, 1, 1, true, max_d,
+							   false);
+
+		if (t_bytes > cache->memo_alloc)
+		{
+			if (cache->memo_target)
+				pfree(cache->memo_target);
+			cache->memo_alloc = Max(t_bytes, 32);
+			cache->memo_target = MemoryContextAlloc(fcinfo->flinfo->fn_mcxt,
+													cache->memo_alloc);
+		}
+		memcpy(cache->memo_target, t_data, t_bytes);
+		cache->memo_bytes = t_bytes;
+		cache->memo_max_d = max_d;
+		cache->memo_result = d;
+		cache->memo_valid = true;
+	}
+
+	if (d > max_d)
+		PG_RETURN_NULL();
+	PG_RETURN_INT32(d);
+}
+
+
+/*
+ * text <~ text: are the strings within fuzzystrmatch.levenshtein_threshold
+ * edits of each other?
+ *
+ * The SP-GiST operator class must index strings of any length, so its
+ * support functions compute distances as trusted callers.  The operator
+ * does the same, so that it gives the same answers with and without the
+ * index; the threshold bounds the work either way.
+ */
+PG_FUNCTION_INFO_V1(levenshtein_op);
+Datum
+levenshtein_op(PG_FUNCTION_ARGS)
+{
+	text	   *src = PG_GETARG_TEXT_PP(0);
+	text	   *dst = PG_GETARG_TEXT_PP(1);
+	int			max_d = levenshtein_threshold;
 
-	PG_RETURN_INT32(varstr_levenshtein_less_equal(s_data, s_bytes,
-												  t_data, t_bytes,
-												  1, 1, 1,
-												  max_d, false));
+	PG_RETURN_BOOL(levenshtein_common(fcinfo, src, dst, 1, 1, 1,
+									  true, max_d, true) <= max_d);
 }
 
 
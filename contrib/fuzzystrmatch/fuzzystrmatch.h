@@ -0,0 +1,13 @@
+/*
+ * contrib/fuzzystrmatch/fuzzystrmatch.h
+ */
+#ifndef FUZZYSTRMATCH_H
+#define FUZZYSTRMATCH_H
+
+/* operator strategy numbers */
+#define LevenshteinStrategyNumber	1
+
+/* GUC variable: the edit distance accepted by the <~ operator */
+extern int	levenshtein_threshold;
+
+#endif							/* FUZZYSTRMATCH_H */
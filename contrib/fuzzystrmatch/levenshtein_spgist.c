@@ -0,0 +1,307 @@
+/*
+ * contrib/fuzzystrmatch/levenshtein_spgist.c
+ *
+ * SP-GiST operator class implementing a BK-tree (Burkhard-Keller tree)
+ * over text, for "col <~ query" searches.
+ *
+ * Each inner tuple has one of the indexed strings as its prefix, the pivot,
+ * and one node per distinct edit distance from the pivot; every string in
+ * the subtree below the node labelled d is exactly d edits away from the
+ * pivot.  By the triangle inequality, a string within k edits of the query
+ * can only be found under the nodes whose label is within k of the query's
+ * own distance to the pivot, so a search computes one distance per inner
+ * tuple it visits and skips all other subtrees.
+ *
+ * Leaf tuples hold the complete strings, so the index can return them and
+ * never needs a recheck.
+ *
+ * Inner tuples without a prefix only occur when an allTheSame tuple has
+ * been split (see spg_levenshtein_choose); they do not constrain their
+ * children.
+ *
+ * Distances are computed without the length limit of levenshtein(), so
+ * that any text column can be indexed.
+ */
+#include "postgres.h"
+
+#include "access/spgist.h"
+#include "catalog/pg_type.h"
+#include "fuzzystrmatch.h"
+#include "utils/builtins.h"
+#include "utils/varlena.h"
+
+
+PG_FUNCTION_INFO_V1(spg_levenshtein_config);
+PG_FUNCTION_INFO_V1(spg_levenshtein_choose);
+PG_FUNCTION_INFO_V1(spg_levenshtein_picksplit);
+PG_FUNCTION_INFO_V1(spg_levenshtein_inner_consistent);
+PG_FUNCTION_INFO_V1(spg_levenshtein_leaf_consistent);
+
+/* Exact distance between two text datums */
+static int
+text_distance(Datum a, Datum b)
+{
+	text	   *ta = DatumGetTextPP(a);
+	text	   *tb = DatumGetTextPP(b);
+
+	return varstr_levenshtein(VARDATA_ANY(ta), VARSIZE_ANY_EXHDR(ta),
+							  VARDATA_ANY(tb), VARSIZE_ANY_EXHDR(tb),
+							  1, 1, 1, true);
+}
+
+/*
+ * Find the node labelled with the given distance.  Labels are kept in
+ * ascending order.
+ */
+static bool
+searchLabel(Datum *nodeLabels, int nNodes, int32 distance, int *i)
+{
+	int			StopLow = 0,
+				StopHigh = nNodes;
+
+	while (StopLow < StopHigh)
+	{
+		int			StopMiddle = (StopLow + StopHigh) >> 1;
+		int32		middle = DatumGetInt32(nodeLabels[StopMiddle]);
+
+		if (distance < middle)
+			StopHigh = StopMiddle;
+		else if (distance > middle)
+			StopLow = StopMiddle + 1;
+		else
+		{
+			*i = StopMiddle;
+			return true;
+		}
+	}
+
+	*i = StopHigh;
+	return false;
+}
+
+Datum
+spg_levenshtein_config(PG_FUNCTION_ARGS)
+{
+	/* spgConfigIn *cfgin = (spgConfigIn *) PG_GETARG_POINTER(0); */
+	spgConfigOut *cfg = (spgConfigOut *) PG_GETARG_POINTER(1);
+
+	cfg->prefixType = TEXTOID;
+	cfg->labelType = INT4OID;
+	cfg->canReturnData = true;
+	cfg->longValuesOK = false;
+	PG_RETURN_VOID();
+}
+
+Datum
+spg_levenshtein_choose(PG_FUNCTION_ARGS)
+{
+	spgChooseIn *in = (spgChooseIn *) PG_GETARG_POINTER(0);
+	spgChooseOut *out = (spgChooseOut *) PG_GETARG_POINTER(1);
+	int32		distance;
+	int			i;
+
+	if (!in->hasPrefix)
+	{
+		/* any child will do; the core picks one if allTheSame */
+		out->resultType = spgMatchNode;
+		out->result.matchNode.nodeN = 0;
+		out->result.matchNode.levelAdd = 0;
+		out->result.matchNode.restDatum = in->datum;
+		PG_RETURN_VOID();
+	}
+
+	distance = text_distance(in->datum, in->prefixDatum);
+
+	if (searchLabel(in->nodeLabels, in->nNodes, distance, &i))
+	{
+		out->resultType = spgMatchNode;
+		out->result.matchNode.nodeN = i;
+		out->result.matchNode.levelAdd = 0;
+		out->result.matchNode.restDatum = in->datum;
+	}
+	else if (in->allTheSame)
+	{
+		/*
+		 * Can't use AddNode action, so split the tuple.  The upper tuple
+		 * keeps the pivot and gets a single node for the distance all the
+		 * old children share; the lower tuple keeps the old nodes but no
+		 * pivot.  The next choose call then adds our distance to the upper
+		 * tuple.
+		 */
+		out->resultType = spgSplitTuple;
+		out->result.splitTuple.prefixHasPrefix = true;
+		out->result.splitTuple.prefixPrefixDatum = in->prefixDatum;
+		out->result.splitTuple.prefixNNodes = 1;
+		out->result.splitTuple.prefixNodeLabels = (Datum *) palloc(sizeof(Datum));
+		out->result.splitTuple.prefixNodeLabels[0] = in->nodeLabels[0];
+		out->result.splitTuple.childNodeN = 0;
+		out->result.splitTuple.postfixHasPrefix = false;
+	}
+	else
+	{
+		/* Add a node for the not-previously-seen distance */
+		out->resultType = spgAddNode;
+		out->result.addNode.nodeLabel = Int32GetDatum(distance);
+		out->result.addNode.nodeN = i;
+	}
+
+	PG_RETURN_VOID();
+}
+
+typedef struct spgNodeDistance
+{
+	int32		distance;
+	int			i;
+} spgNodeDistance;
+
+static int
+cmpNodeDistance(const void *a, const void *b)
+{
+	const spgNodeDistance *aa = (const spgNodeDistance *) a;
+	const spgNodeDistance *bb = (const spgNodeDistance *) b;
+
+	if (aa->distance != bb->distance)
+		return (aa->distance < bb->distance) ? -1 : 1;
+	return (aa->i < bb->i) ? -1 : (aa->i > bb->i);
+}
+
+Datum
+spg_levenshtein_picksplit(PG_FUNCTION_ARGS)
+{
+	spgPickSplitIn *in = (spgPickSplitIn *) PG_GETARG_POINTER(0);
+	spgPickSplitOut *out = (spgPickSplitOut *) PG_GETARG_POINTER(1);
+	text	   *pivot = DatumGetTextPP(in->datums[0]);
+	spgNodeDistance *nodes;
+	int			i;
+
+	/* the first string is as good a pivot as any */
+	out->hasPrefix = true;
+	out->prefixDatum = PointerGetDatum(cstring_to_text_with_len(VARDATA_ANY(pivot),
+																VARSIZE_ANY_EXHDR(pivot)));
+
+	nodes = (spgNodeDistance *) palloc(sizeof(spgNodeDistance) * in->nTuples);
+	for (i = 0; i < in->nTuples; i++)
+	{
+		nodes[i].distance = text_distance(in->datums[i], out->prefixDatum);
+		nodes[i].i = i;
+	}
+	qsort(nodes, in->nTuples, sizeof(*nodes), cmpNodeDistance);
+
+	/* And emit results */
+	out->nNodes = 0;
+	out->nodeLabels = (Datum *) palloc(sizeof(Datum) * in->nTuples);
+	out->mapTuplesToNodes = (int *) palloc(sizeof(int) * in->nTuples);
+	out->leafTupleDatums = (Datum *) palloc(sizeof(Datum) * in->nTuples);
+
+	for (i = 0; i < in->nTuples; i++)
+	{
+		if (i == 0 || nodes[i].distance != nodes[i - 1].distance)
+		{
+			out->nodeLabels[out->nNodes] = Int32GetDatum(nodes[i].distance);
+			out->nNodes++;
+		}
+		out->mapTuplesToNodes[nodes[i].i] = out->nNodes - 1;
+		out->leafTupleDatums[nodes[i].i] = in->datums[nodes[i].i];
+	}
+
+	PG_RETURN_VOID();
+}
+
+Datum
+spg_levenshtein_inner_consistent(PG_FUNCTION_ARGS)
+{
+	spgInnerConsistentIn *in = (spgInnerConsistentIn *) PG_GETARG_POINTER(0);
+	spgInnerConsistentOut *out = (spgInnerConsistentOut *) PG_GETARG_POINTER(1);
+	int			k = levenshtein_threshold;
+	int32		minLabel = PG_INT32_MAX;
+	int32		maxLabel = PG_INT32_MIN;
+	int32	   *distances;
+	int			i,
+				j;
+
+	out->nNodes = 0;
+	out->nodeNumbers = (int *) palloc(sizeof(int) * in->nNodes);
+
+	if (!in->hasPrefix)
+	{
+		for (i = 0; i < in->nNodes; i++)
+			out->nodeNumbers[out->nNodes++] = i;
+		PG_RETURN_VOID();
+	}
+
+	for (i = 0; i < in->nNodes; i++)
+	{
+		minLabel = Min(minLabel, DatumGetInt32(in->nodeLabels[i]));
+		maxLabel = Max(maxLabel, DatumGetInt32(in->nodeLabels[i]));
+	}
+
+	/*
+	 * The query's distance to the pivot only matters up to maxLabel + k;
+	 * beyond that, no node can qualify and the bounded computation can stop
+	 * early.
+	 */
+	distances = (int32 *) palloc(sizeof(int32) * in->nkeys);
+	for (j = 0; j < in->nkeys; j++)
+	{
+		StrategyNumber strategy = in->scankeys[j].sk_strategy;
+		text	   *query = DatumGetTextPP(in->scankeys[j].sk_argument);
+		text	   *pivot = DatumGetTextPP(in->prefixDatum);
+
+		if (strategy != LevenshteinStrategyNumber)
+			elog(ERROR, "unrecognized strategy number: %d", strategy);
+
+		distances[j] = varstr_levenshtein_less_equal(VARDATA_ANY(query),
+													 VARSIZE_ANY_EXHDR(query),
+													 VARDATA_ANY(pivot),
+													 VARSIZE_ANY_EXHDR(pivot),
+													 1, 1, 1,
+													 maxLabel + k, true);
+		if (distances[j] + k < minLabel || distances[j] - k > maxLabel)
+			PG_RETURN_VOID();
+	}
+
+	for (i = 0; i < in->nNodes; i++)
+	{
+		int32		label = DatumGetInt32(in->nodeLabels[i]);
+		bool		res = true;
+
+		for (j = 0; j < in->nkeys && res; j++)
+			res = (Abs(label - distances[j]) <= k);
+
+		if (res)
+			out->nodeNumbers[out->nNodes++] = i;
+	}
+
+	PG_RETURN_VOID();
+}
+
+Datum
+spg_levenshtein_leaf_consistent(PG_FUNCTION_ARGS)
+{
+	spgLeafConsistentIn *in = (spgLeafConsistentIn *) PG_GETARG_POINTER(0);
+	spgLeafConsistentOut *out = (spgLeafConsistentOut *) PG_GETARG_POINTER(1);
+	text	   *leaf = DatumGetTextPP(in->leafDatum);
+	int			k = levenshtein_threshold;
+	bool		res = true;
+	int			j;
+
+	out->recheck = false;
+	out->leafValue = in->leafDatum;
+
+	for (j = 0; j < in->nkeys && res; j++)
+	{
+		StrategyNumber strategy = in->scankeys[j].sk_strategy;
+		text	   *query = DatumGetTextPP(in->scankeys[j].sk_argument);
+
+		if (strategy != LevenshteinStrategyNumber)
+			elog(ERROR, "unrecognized strategy number: %d", strategy);
+
+		res = (varstr_levenshtein_less_equal(VARDATA_ANY(query),
+											 VARSIZE_ANY_EXHDR(query),
+											 VARDATA_ANY(leaf),
+											 VARSIZE_ANY_EXHDR(leaf),
+											 1, 1, 1, k, true) <= k);
+	}
+
+	PG_RETURN_BOOL(res);
+}
@@ -13,6 +13,282 @@ SELECT levenshtein('GUMBO', 'GAMBOL', 2, 1, 1);
 SELECT levenshtein_less_equal('extensive', 'exhaustive', 2);
 SELECT levenshtein_less_equal('extensive', 'exhaustive', 4);
 
+-- threshold predicates over columns are evaluated by a fused bounded step
+CREATE TEMP TABLE lev_pairs (a text, b text);
+INSERT INTO lev_pairs VALUES ('  GUMBO', 'GAMBOL  '), ('kitten', 'sitting'),
+  ('abc', NULL), ('Toyota ', 'TOYOTA'), ('', '   ');
+SELECT a, b,
+       levenshtein(trim(a::varchar(6)), trim(b::varchar(6))) <= 2 AS le2,
+       levenshtein(a, b) < 4 AS lt4,
+       1 >= levenshtein(lower(a), lower(b)) AS ge1
+FROM lev_pairs ORDER BY a;
+SET enable_fusedlevenshtein = off;
+SELECT a, b,
+       levenshtein(trim(a::varchar(6)), trim(b::varchar(6))) <= 2 AS le2,
+       levenshtein(a, b) < 4 AS lt4,
+       1 >= levenshtein(lower(a), lower(b)) AS ge1
+FROM lev_pairs ORDER BY a;
+RESET enable_fusedlevenshtein;
+-- negative bounds reject every pair, without overflow at INT_MIN
+SELECT a, b,
+       levenshtein(a, b) < (-2147483648)::int AS ltmin,
+       (-2147483648)::int > levenshtein(a, b) AS gtmin,
+       levenshtein(a, b) <= -1 AS lem1
+FROM lev_pairs ORDER BY a;
+
+-- successive calls with the same source reuse its preprocessed form
+SELECT length(a) AS alen, b, levenshtein(a, b) AS d,
+       levenshtein(a, b, 2, 1, 3) AS dc,
+       levenshtein_less_equal(a, b, 3) AS le3
+FROM (VALUES ('kitten', 'sitting'), ('kitten', 'kitten'), ('kitten', ''),
+             ('kitten', 'kitchen'), (repeat('ab', 40), 'ab'),
+             (repeat('ab', 40), repeat('ba', 40)),
+             (repeat('ab', 40), repeat('ab', 39) || 'b')) v(a, b);
+
+-- similarity join comparing each pair of distinct keys once
+CREATE TEMP TABLE lev_makes (id int, make text);
+INSERT INTO lev_makes VALUES (1, 'TOYOTA'), (2, 'HONDA'), (3, 'TOYOTA'),
+  (4, NULL), (5, 'HODNA'), (6, 'FORD'), (7, 'TOYOT'), (8, 'HONDA');
+SET enable_dedupjoin = on;
+SET enable_passjoin = off;
+SELECT a.id, b.id, a.make, b.make
+FROM lev_makes a JOIN lev_makes b
+  ON levenshtein(a.make, b.make) <= 1 AND a.id < b.id
+ORDER BY 1, 2;
+RESET enable_dedupjoin;
+SET enable_passjoin = on;
+-- ... with PassJoin candidate generation
+SELECT a.id, b.id, a.make, b.make
+FROM lev_makes a JOIN lev_makes b
+  ON levenshtein(a.make, b.make) < 3 AND a.id < b.id
+ORDER BY 1, 2;
+-- ... with approximate (LSH) candidate generation
+SET enable_lshjoin = on;
+SELECT a.id, b.id, a.make, b.make
+FROM lev_makes a JOIN lev_makes b
+  ON levenshtein(a.make, b.make) <= 1 AND a.id < b.id
+ORDER BY 1, 2;
+RESET enable_lshjoin;
+-- ... with blocking on phonetic codes, which misses HONDA/HODNA
+SET similarity_join_blocking_keys = soundex;
+SELECT a.id, b.id, a.make, b.make
+FROM lev_makes a JOIN lev_makes b
+  ON levenshtein(a.make, b.make) <= 2 AND a.id < b.id
+ORDER BY 1, 2;
+EXPLAIN (ANALYZE, COSTS OFF, TIMING OFF, SUMMARY OFF)
+SELECT * FROM lev_makes a JOIN lev_makes b
+  ON levenshtein(a.make, b.make) <= 2 AND a.id < b.id;
+-- a cached plan keeps the strategy it was made with
+PREPARE lev_soundex AS SELECT * FROM lev_makes a JOIN lev_makes b
+  ON levenshtein(a.make, b.make) <= 2 AND a.id < b.id;
+EXECUTE lev_soundex;
+SET similarity_join_blocking_keys = dmetaphone, dmetaphone_alt;
+SET enable_lshjoin = on;
+EXPLAIN (ANALYZE, COSTS OFF, TIMING OFF, SUMMARY OFF) EXECUTE lev_soundex;
+RESET enable_lshjoin;
+DEALLOCATE lev_soundex;
+SELECT a.id, b.id, a.make, b.make
+FROM lev_makes a JOIN lev_makes b
+  ON levenshtein(a.make, b.make) <= 2 AND a.id < b.id
+ORDER BY 1, 2;
+SET similarity_join_blocking_keys = length;
+SELECT count(*) FROM lev_makes a JOIN lev_makes b
+  ON levenshtein(a.make, b.make) <= 1;
+-- blocking keys are computed in the collation of the join clause
+CREATE FUNCTION lev_block_by_collation(text) RETURNS text LANGUAGE sql
+  AS $$ SELECT CASE WHEN pg_collation_for($1) = '"C"' THEN $1 ELSE '' END $$;
+SET similarity_join_blocking_keys = lev_block_by_collation;
+SELECT a.id, b.id FROM lev_makes a JOIN lev_makes b
+  ON levenshtein(a.make, b.make) <= 1 AND a.id < b.id
+ORDER BY 1, 2;
+SELECT a.id, b.id FROM lev_makes a JOIN lev_makes b
+  ON levenshtein(a.make COLLATE "C", b.make) <= 1 AND a.id < b.id
+ORDER BY 1, 2;
+DROP FUNCTION lev_block_by_collation(text);
+RESET similarity_join_blocking_keys;
+-- ... and in the block nested loop, over a length-bucketed inner side
+CREATE TEMP TABLE lev_lengths AS
+  SELECT i AS id, repeat('x', i % 32 + 1) AS w FROM generate_series(1, 64) i;
+SET enable_passjoin = off;
+SET enable_block = on;
+SET enable_material = off;
+EXPLAIN (ANALYZE, COSTS OFF, TIMING OFF, SUMMARY OFF)
+SELECT * FROM (VALUES ('x'), ('xx')) o(w) JOIN lev_lengths l
+  ON levenshtein(o.w, l.w) <= 1;
+SELECT o.w, count(*)
+FROM (VALUES ('x'), ('xx')) o(w) JOIN lev_lengths l
+  ON levenshtein(o.w, l.w) <= 1
+GROUP BY o.w ORDER BY o.w;
+-- ... unless the inner side does not fit in work_mem
+CREATE TEMP TABLE lev_lengths_big AS
+  SELECT i AS id, repeat('x', i % 32 + 1) AS w FROM generate_series(1, 3000) i;
+SET work_mem = 64;
+EXPLAIN (ANALYZE, COSTS OFF, TIMING OFF, SUMMARY OFF)
+SELECT * FROM (VALUES ('x'), ('xx')) o(w) JOIN lev_lengths_big l
+  ON levenshtein(o.w, l.w) <= 1;
+SELECT o.w, count(*)
+FROM (VALUES ('x'), ('xx')) o(w) JOIN lev_lengths_big l
+  ON levenshtein(o.w, l.w) <= 1
+GROUP BY o.w ORDER BY o.w;
+RESET work_mem;
+SELECT o.w, count(*)
+FROM (VALUES ('x'), ('xx')) o(w) JOIN lev_lengths_big l
+  ON levenshtein(o.w, l.w) <= 1
+GROUP BY o.w ORDER BY o.w;
+SET enable_passjoin = on;
+-- a similarity join whose inputs do not fit in work_mem runs in the block
+-- nested loop instead
+SET work_mem = 64;
+EXPLAIN (ANALYZE, COSTS OFF, TIMING OFF, SUMMARY OFF)
+SELECT * FROM lev_lengths_big b JOIN lev_lengths l
+  ON levenshtein(b.w, l.w) <= 1;
+SELECT count(*), sum(b.id * l.id) FROM lev_lengths_big b JOIN lev_lengths l
+  ON levenshtein(b.w, l.w) <= 1;
+RESET work_mem;
+SELECT count(*), sum(b.id * l.id) FROM lev_lengths_big b JOIN lev_lengths l
+  ON levenshtein(b.w, l.w) <= 1;
+RESET enable_block;
+RESET enable_material;
+-- the bandit join visits the bucketed inner pages in order of their yield,
+-- or in their own order, and returns the rows of the plain nested loop
+CREATE TEMP TABLE lev_arms (id int PRIMARY KEY, w text);
+INSERT INTO lev_arms
+  SELECT i, repeat('x', (i - 1) / 32 * 4 + 1 + i % 3)
+  FROM generate_series(1, 160) i;
+CREATE TEMP TABLE lev_pages (id int PRIMARY KEY, w text);
+INSERT INTO lev_pages
+  SELECT i, repeat('y', i % 7) || repeat('x', i % 19)
+  FROM generate_series(1, 200) i;
+ANALYZE lev_arms;
+ANALYZE lev_pages;
+SET enable_passjoin = off;
+SET enable_block = off;
+SET enable_hashjoin = off;
+SET enable_mergejoin = off;
+SET enable_material = off;
+SET enable_seqscan = off;
+SET enable_bitmapscan = off;
+SELECT count(*), sum(a.id * p.id) FROM lev_arms a JOIN lev_pages p
+  ON levenshtein(a.w, p.w) <= 2 WHERE a.id > 0 AND p.id > 0;
+SET enable_fastjoin = on;
+EXPLAIN (ANALYZE, COSTS OFF, TIMING OFF, SUMMARY OFF)
+SELECT * FROM lev_arms a JOIN lev_pages p
+  ON levenshtein(a.w, p.w) <= 2 WHERE a.id > 0 AND p.id > 0;
+SELECT count(*), sum(a.id * p.id) FROM lev_arms a JOIN lev_pages p
+  ON levenshtein(a.w, p.w) <= 2 WHERE a.id > 0 AND p.id > 0;
+SET enable_innerpageorder = off;
+EXPLAIN (ANALYZE, COSTS OFF, TIMING OFF, SUMMARY OFF)
+SELECT * FROM lev_arms a JOIN lev_pages p
+  ON levenshtein(a.w, p.w) <= 2 WHERE a.id > 0 AND p.id > 0;
+SELECT count(*), sum(a.id * p.id) FROM lev_arms a JOIN lev_pages p
+  ON levenshtein(a.w, p.w) <= 2 WHERE a.id > 0 AND p.id > 0;
+RESET enable_innerpageorder;
+RESET enable_fastjoin;
+RESET enable_block;
+RESET enable_hashjoin;
+RESET enable_mergejoin;
+RESET enable_material;
+RESET enable_seqscan;
+RESET enable_bitmapscan;
+SET enable_passjoin = on;
+-- ... and at several thresholds at once, through levenshtein_within()
+SELECT levenshtein_within('GUMBO', 'GAMBOL', 2),
+       levenshtein_within('GUMBO', 'GAMBOL', 1),
+       levenshtein_within('GUMBO', 'GUMBO', -1);
+EXPLAIN (ANALYZE, COSTS OFF, TIMING OFF, SUMMARY OFF)
+SELECT a.id, b.id FROM lev_makes a JOIN lev_makes b
+  ON levenshtein_within(a.make, b.make, 2) IS NOT NULL;
+SELECT aid, bid, d, d <= 0 AS same, d <= 1 AS close
+FROM (SELECT a.id, b.id, levenshtein_within(a.make, b.make, 2)
+      FROM lev_makes a JOIN lev_makes b
+        ON levenshtein_within(a.make, b.make, 2) IS NOT NULL AND a.id < b.id
+      OFFSET 0) x(aid, bid, d)
+ORDER BY 1, 2;
+-- ... returning the closest pairs first, without a sort
+EXPLAIN (ANALYZE, COSTS OFF, TIMING OFF, SUMMARY OFF)
+SELECT a.id, b.id FROM lev_makes a JOIN lev_makes b
+  ON levenshtein(a.make, b.make) <= 2 AND a.id < b.id
+ORDER BY levenshtein(a.make, b.make) LIMIT 2;
+SELECT levenshtein(a.make, b.make) AS d FROM lev_makes a JOIN lev_makes b
+  ON levenshtein(a.make, b.make) <= 2 AND a.id < b.id
+ORDER BY levenshtein(a.make, b.make);
+RESET enable_passjoin;
+-- row estimates of edit-distance clauses come from the column statistics
+CREATE FUNCTION lev_estimate(query text) RETURNS int LANGUAGE plpgsql AS $$
+DECLARE
+  plan json;
+BEGIN
+  EXECUTE 'EXPLAIN (FORMAT JSON) ' || query INTO plan;
+  RETURN (plan->0->'Plan'->>'Plan Rows')::int;
+END $$;
+ANALYZE lev_makes;
+SELECT lev_estimate('SELECT * FROM lev_makes a JOIN lev_makes b ON levenshtein(a.make, b.make) <= 1') AS est,
+       (SELECT count(*) FROM lev_makes a JOIN lev_makes b ON levenshtein(a.make, b.make) <= 1) AS actual;
+SELECT lev_estimate('SELECT * FROM lev_makes WHERE levenshtein(make, ''HONDAS'') < 3') AS est,
+       (SELECT count(*) FROM lev_makes WHERE levenshtein(make, 'HONDAS') < 3) AS actual;
+-- ... comparing only the most common values beyond a high statistics target
+CREATE TEMP TABLE lev_common AS
+  SELECT 'w' || (i % 500) AS w FROM generate_series(1, 1000) i;
+ALTER TABLE lev_common ALTER COLUMN w SET STATISTICS 1000;
+ANALYZE lev_common;
+SELECT lev_estimate('SELECT * FROM lev_common a JOIN lev_common b ON levenshtein(a.w, b.w) <= 0') AS est,
+       (SELECT count(*) FROM lev_common a JOIN lev_common b ON levenshtein(a.w, b.w) <= 0) AS actual;
+DROP FUNCTION lev_estimate(text);
+
+-- BK-tree index for the <~ operator
+CREATE INDEX lev_makes_idx ON lev_makes USING spgist (make spgist_levenshtein_ops);
+CREATE TEMP TABLE lev_words AS
+  SELECT i AS id,
+         substr(translate(md5(i::text), '0123456789abcdef', 'abcdabcdabcdabcd'),
+                1, i % 9) AS w
+  FROM generate_series(1, 3000) i;
+INSERT INTO lev_words SELECT 3000 + i, 'abcd' FROM generate_series(1, 500) i;
+CREATE INDEX lev_words_idx ON lev_words USING spgist (w spgist_levenshtein_ops);
+SET enable_seqscan = off;
+SET enable_bitmapscan = off;
+SET fuzzystrmatch.levenshtein_threshold = 1;
+EXPLAIN (COSTS OFF)
+SELECT id, make FROM lev_makes WHERE make <~ 'TOYOTA';
+SELECT id, make FROM lev_makes WHERE make <~ 'TOYOTA' ORDER BY id;
+SET fuzzystrmatch.levenshtein_threshold = 2;
+SELECT id, make FROM lev_makes WHERE make <~ 'HONDA' ORDER BY id;
+CREATE TEMP TABLE lev_index_result AS
+  SELECT '' AS q, id FROM lev_words WHERE w <~ ''
+  UNION ALL SELECT 'a', id FROM lev_words WHERE w <~ 'a'
+  UNION ALL SELECT 'abcd', id FROM lev_words WHERE w <~ 'abcd'
+  UNION ALL SELECT 'dcba', id FROM lev_words WHERE w <~ 'dcba'
+  UNION ALL SELECT 'abcabca', id FROM lev_words WHERE w <~ 'abcabca';
+EXPLAIN (COSTS OFF)
+SELECT id FROM lev_words WHERE w <~ 'abcd';
+RESET enable_seqscan;
+RESET enable_bitmapscan;
+SET enable_indexscan = off;
+SELECT q, count(*),
+       count(*) = (SELECT count(*) FROM lev_index_result r WHERE r.q = v.q) AS same_count
+FROM (VALUES (''), ('a'), ('abcd'), ('dcba'), ('abcabca')) v(q), lev_words
+WHERE levenshtein(w, q) <= 2
+GROUP BY q ORDER BY q;
+SELECT count(*) FROM (
+  SELECT q, id FROM lev_index_result
+  EXCEPT
+  SELECT q, id FROM (VALUES (''), ('a'), ('abcd'), ('dcba'), ('abcabca')) v(q), lev_words
+  WHERE levenshtein(w, q) <= 2) x;
+RESET enable_indexscan;
+-- strings over 255 characters are compared alike with and without the index
+CREATE TEMP TABLE lev_long (id int, w text);
+INSERT INTO lev_long VALUES (1, repeat('TOYOTA', 50)), (2, repeat('TOYOTA', 50) || 'S'),
+  (3, repeat('HONDA', 60)), (4, 'TOYOTA');
+CREATE INDEX lev_long_idx ON lev_long USING spgist (w spgist_levenshtein_ops);
+SELECT id, length(w) FROM lev_long WHERE w <~ repeat('TOYOTA', 50) ORDER BY id;
+SET enable_seqscan = off;
+SET enable_bitmapscan = off;
+EXPLAIN (COSTS OFF)
+SELECT id FROM lev_long WHERE w <~ 'TOYOTA';
+SELECT id, length(w) FROM lev_long WHERE w <~ repeat('TOYOTA', 50) ORDER BY id;
+RESET enable_seqscan;
+RESET enable_bitmapscan;
+RESET fuzzystrmatch.levenshtein_threshold;
+
 
 SELECT metaphone('GUMBO', 4);
 
@@ -0,0 +1,28 @@
+/* contrib/pg_trgm/pg_trgm--1.4--1.5.sql */
+
+-- complain if script is sourced in psql, rather than via ALTER EXTENSION
+\echo Use "ALTER EXTENSION pg_trgm UPDATE TO '1.5'" to load this file. \quit
+
+CREATE TYPE levenshtein_bound AS (
+        target text,
+        max_distance int4
+);
+
+CREATE FUNCTION levenshtein_bound_op(text,levenshtein_bound)
+RETURNS bool
+AS 'MODULE_PATHNAME'
+LANGUAGE C STRICT IMMUTABLE PARALLEL SAFE;
+
+CREATE OPERATOR <~ (
+        LEFTARG = text,
+        RIGHTARG = levenshtein_bound,
+        PROCEDURE = levenshtein_bound_op,
+        RESTRICT = contsel,
+        JOIN = contjoinsel
+);
+
+ALTER OPERATOR FAMILY gist_trgm_ops USING gist ADD
+        OPERATOR        11       <~ (text, levenshtein_bound);
+
+ALTER OPERATOR FAMILY gin_trgm_ops USING gin ADD
+        OPERATOR        11       <~ (text, levenshtein_bound);
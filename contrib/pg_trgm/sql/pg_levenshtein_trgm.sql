@@ -0,0 +1,48 @@
+CREATE EXTENSION fuzzystrmatch;
+
+CREATE TABLE test_trgm3(t text COLLATE "C");
+
+\copy test_trgm3 from 'data/trgm2.data'
+
+-- the operator the planner derives from levenshtein() thresholds
+select 'Baikal' <~ row('Baykal', 1)::levenshtein_bound;
+select 'Baikal' <~ row('Baykal', 0)::levenshtein_bound;
+select 'Baikal' <~ row('Baykal', -1)::levenshtein_bound;
+select 'Baikal' <~ row('Baykal', NULL)::levenshtein_bound;
+
+-- reference results
+select t from test_trgm3 where levenshtein(t, 'Baykal') <= 2 order by t;
+select t from test_trgm3 where levenshtein('Kabankala', t) < 3 order by t;
+create temp table lev_ref as
+  select t from test_trgm3 where levenshtein(t, 'Lake Baykal') <= 4;
+
+create index trgm_idx3 on test_trgm3 using gin (t gin_trgm_ops);
+set enable_seqscan=off;
+
+explain (costs off)
+select t from test_trgm3 where levenshtein(t, 'Baykal') <= 2 order by t;
+select t from test_trgm3 where levenshtein(t, 'Baykal') <= 2 order by t;
+explain (costs off)
+select t from test_trgm3 where levenshtein('Kabankala', t) < 3 order by t;
+select t from test_trgm3 where levenshtein('Kabankala', t) < 3 order by t;
+-- a bound too loose for trigrams to help still gives the right answer
+select count(*) from test_trgm3 where levenshtein(t, 'Bay') <= 3;
+select count(*) from test_trgm3 where levenshtein(t, 'Baykal') <= -1;
+select count(*) from lev_ref;
+select count(*) from
+  (select t from test_trgm3 where levenshtein(t, 'Lake Baykal') <= 4
+   except all select t from lev_ref) x;
+
+drop index trgm_idx3;
+create index trgm_idx3 on test_trgm3 using gist (t gist_trgm_ops);
+
+explain (costs off)
+select t from test_trgm3 where levenshtein(t, 'Baykal') <= 2 order by t;
+select t from test_trgm3 where levenshtein(t, 'Baykal') <= 2 order by t;
+select t from test_trgm3 where levenshtein('Kabankala', t) < 3 order by t;
+select count(*) from test_trgm3 where levenshtein(t, 'Bay') <= 3;
+select count(*) from
+  (select t from test_trgm3 where levenshtein(t, 'Lake Baykal') <= 4
+   except all select t from lev_ref) x;
+
+reset enable_seqscan;
@@ -5,6 +5,7 @@
 #define __TRGM_H__
 
 #include "access/gist.h"
+#include "access/htup.h"
 #include "access/itup.h"
 #include "access/stratnum.h"
 #include "storage/bufpage.h"
@@ -37,6 +38,7 @@
 #define WordDistanceStrategyNumber			8
 #define StrictWordSimilarityStrategyNumber	9
 #define StrictWordDistanceStrategyNumber	10
+#define EditDistanceStrategyNumber			11
 
 typedef char trgm[3];
 
@@ -131,10 +133,14 @@ extern void compact_trigram(trgm *tptr, char *str, int bytelen);
 extern TRGM *generate_trgm(char *str, int slen);
 extern TRGM *generate_wildcard_trgm(const char *str, int slen);
 extern float4 cnt_sml(TRGM *trg1, TRGM *trg2, bool inexact);
+extern int32 cnt_common(TRGM *trg1, TRGM *trg2);
 extern bool trgm_contained_by(TRGM *trg1, TRGM *trg2);
 extern bool *trgm_presence_map(TRGM *query, TRGM *key);
 extern TRGM *createTrgmNFA(text *text_re, Oid collation,
 			  TrgmPackedGraph **graph, MemoryContext rcontext);
 extern bool trigramsMatchGraph(TrgmPackedGraph *graph, bool *check);
+extern bool get_levenshtein_bound(HeapTupleHeader bound, text **target,
+					  int32 *maxDistance);
+extern int32 levenshtein_bound_min_common(int32 ntrigrams, int32 maxDistance);
 
 #endif							/* __TRGM_H__ */
@@ -84,6 +84,9 @@ gin_extract_query_trgm(PG_FUNCTION_ARGS)
 	int32		trglen;
 	trgm	   *ptr;
 	TrgmPackedGraph *graph;
+	text	   *target;
+	int32		maxDistance;
+	int32	   *minCommon;
 	int32		i;
 
 	switch (strategy)
@@ -93,6 +96,36 @@ gin_extract_query_trgm(PG_FUNCTION_ARGS)
 		case StrictWordSimilarityStrategyNumber:
 			trg = generate_trgm(VARDATA_ANY(val), VARSIZE_ANY_EXHDR(val));
 			break;
+		case EditDistanceStrategyNumber:
+			if (!get_levenshtein_bound(PG_GETARG_HEAPTUPLEHEADER(0),
+									   &target, &maxDistance) ||
+				maxDistance < 0)
+			{
+				/* Nothing can match */
+				*nentries = 0;
+				PG_RETURN_POINTER(entries);
+			}
+			trg = generate_trgm(VARDATA_ANY(target),
+								VARSIZE_ANY_EXHDR(target));
+			trglen = ARRNELEM(trg);
+
+			/*
+			 * Store the number of trigrams a match must have as extra_data,
+			 * again the same value in each element.  If the bound is too
+			 * loose to require any, every item has to be rechecked.
+			 */
+			minCommon = (int32 *) palloc(sizeof(int32));
+			*minCommon = levenshtein_bound_min_common(trglen, maxDistance);
+			if (*minCommon <= 0)
+			{
+				*nentries = 0;
+				*searchMode = GIN_SEARCH_MODE_ALL;
+				PG_RETURN_POINTER(entries);
+			}
+			*extra_data = (Pointer *) palloc(sizeof(Pointer) * trglen);
+			for (i = 0; i < trglen; i++)
+				(*extra_data)[i] = (Pointer) minCommon;
+			break;
 		case ILikeStrategyNumber:
 #ifndef IGNORECASE
 			elog(ERROR, "cannot handle ~~* with case-sensitive trigrams");
@@ -217,6 +250,22 @@ gin_trgm_consistent(PG_FUNCTION_ARGS)
 			res = (nkeys == 0) ? false :
 				(((((float4) ntrue) / ((float4) nkeys))) >= nlimit);
 			break;
+		case EditDistanceStrategyNumber:
+			if (nkeys < 1)
+			{
+				/* Bound requires no common trigrams: do full index scan */
+				res = true;
+				break;
+			}
+
+			ntrue = 0;
+			for (i = 0; i < nkeys; i++)
+			{
+				if (check[i])
+					ntrue++;
+			}
+			res = (ntrue >= *((int32 *) extra_data[0]));
+			break;
 		case ILikeStrategyNumber:
 #ifndef IGNORECASE
 			elog(ERROR, "cannot handle ~~* with case-sensitive trigrams");
@@ -302,6 +351,22 @@ gin_trgm_triconsistent(PG_FUNCTION_ARGS)
 				? GIN_FALSE : (((((float4) ntrue) / ((float4) nkeys)) >= nlimit)
 							   ? GIN_MAYBE : GIN_FALSE);
 			break;
+		case EditDistanceStrategyNumber:
+			if (nkeys < 1)
+			{
+				/* Bound requires no common trigrams: do full index scan */
+				res = GIN_MAYBE;
+				break;
+			}
+
+			ntrue = 0;
+			for (i = 0; i < nkeys; i++)
+			{
+				if (check[i] != GIN_FALSE)
+					ntrue++;
+			}
+			res = (ntrue >= *((int32 *) extra_data[0])) ? GIN_MAYBE : GIN_FALSE;
+			break;
 		case ILikeStrategyNumber:
 #ifndef IGNORECASE
 			elog(ERROR, "cannot handle ~~* with case-sensitive trigrams");
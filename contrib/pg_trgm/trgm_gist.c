@@ -18,6 +18,8 @@ typedef struct
 	TRGM	   *trigrams;
 	/* if a regex operator, the extracted graph */
 	TrgmPackedGraph *graph;
+	/* if an edit-distance bound, the distance (-1 if nothing can match) */
+	int32		maxDistance;
 
 	/*
 	 * The "query" and "trigrams" are stored in the same palloc block as this
@@ -215,6 +217,8 @@ gtrgm_consistent(PG_FUNCTION_ARGS)
 	{
 		gtrgm_consistent_cache *newcache;
 		TrgmPackedGraph *graph = NULL;
+		int32		maxDistance = -1;
+		text	   *target;
 		Size		qtrgsize;
 
 		switch (strategy)
@@ -225,6 +229,19 @@ gtrgm_consistent(PG_FUNCTION_ARGS)
 				qtrg = generate_trgm(VARDATA(query),
 									 querysize - VARHDRSZ);
 				break;
+			case EditDistanceStrategyNumber:
+				/* the query is a levenshtein_bound, not a text */
+				if (get_levenshtein_bound((HeapTupleHeader) query,
+										  &target, &maxDistance) &&
+					maxDistance >= 0)
+					qtrg = generate_trgm(VARDATA_ANY(target),
+										 VARSIZE_ANY_EXHDR(target));
+				else
+				{
+					maxDistance = -1;
+					qtrg = NULL;
+				}
+				break;
 			case ILikeStrategyNumber:
 #ifndef IGNORECASE
 				elog(ERROR, "cannot handle ~~* with case-sensitive trigrams");
@@ -278,6 +295,7 @@ gtrgm_consistent(PG_FUNCTION_ARGS)
 		else
 			newcache->trigrams = NULL;
 		newcache->graph = graph;
+		newcache->maxDistance = maxDistance;
 
 		if (cache)
 			pfree(cache);
@@ -322,6 +340,34 @@ gtrgm_consistent(PG_FUNCTION_ARGS)
 					res = (((((float8) count) / ((float8) len))) >= nlimit);
 			}
 			break;
+		case EditDistanceStrategyNumber:
+			/* Trigrams only narrow down the candidates */
+			*recheck = true;
+
+			if (cache->maxDistance < 0)
+				res = false;
+			else if (GIST_LEAF(entry))
+			{					/* all leafs contains orig trgm */
+				/*
+				 * The bound holds in both directions, so the larger of the
+				 * two trigram sets gives the stricter test.
+				 */
+				int32		len = Max(ARRNELEM(qtrg), ARRNELEM(key));
+
+				res = (cnt_common(qtrg, key) >=
+					   levenshtein_bound_min_common(len, cache->maxDistance));
+			}
+			else if (ISALLTRUE(key))
+			{					/* non-leaf contains signature */
+				res = true;
+			}
+			else
+			{					/* non-leaf contains signature */
+				res = (cnt_sml_sign_common(qtrg, GETSIGN(key)) >=
+					   levenshtein_bound_min_common(ARRNELEM(qtrg),
+													cache->maxDistance));
+			}
+			break;
 		case ILikeStrategyNumber:
 #ifndef IGNORECASE
 			elog(ERROR, "cannot handle ~~* with case-sensitive trigrams");
@@ -8,10 +8,12 @@
 #include "trgm.h"
 
 #include "catalog/pg_type.h"
+#include "executor/executor.h"
 #include "tsearch/ts_locale.h"
 #include "utils/lsyscache.h"
 #include "utils/memutils.h"
 #include "utils/pg_crc.h"
+#include "utils/varlena.h"
 
 PG_MODULE_MAGIC;
 
@@ -38,6 +40,7 @@ PG_FUNCTION_INFO_V1(strict_word_similarity_op);
 PG_FUNCTION_INFO_V1(strict_word_similarity_commutator_op);
 PG_FUNCTION_INFO_V1(strict_word_similarity_dist_op);
 PG_FUNCTION_INFO_V1(strict_word_similarity_dist_commutator_op);
+PG_FUNCTION_INFO_V1(levenshtein_bound_op);
 
 /* Trigram with position */
 typedef struct
@@ -875,6 +878,7 @@ get_wildcard_part(const char *str, int lenstr,
 	return endword;
 }
 
+
 /*
  * Generates trigrams for wildcard search string.
  *
@@ -1014,12 +1018,16 @@ show_trgm(PG_FUNCTION_ARGS)
 	PG_RETURN_POINTER(a);
 }
 
-float4
-cnt_sml(TRGM *trg1, TRGM *trg2, bool inexact)
+/*
+ * Returns the number of trigrams trg1 and trg2 have in common.
+ * This relies on the trigram arrays being sorted.
+ */
+int32
+cnt_common(TRGM *trg1, TRGM *trg2)
 {
 	trgm	   *ptr1,
 			   *ptr2;
-	int			count = 0;
+	int32		count = 0;
 	int			len1,
 				len2;
 
@@ -1029,10 +1037,6 @@ cnt_sml(TRGM *trg1, TRGM *trg2, bool inexact)
 	len1 = ARRNELEM(trg1);
 	len2 = ARRNELEM(trg2);
 
-	/* explicit test is needed to avoid 0/0 division when both lengths are 0 */
-	if (len1 <= 0 || len2 <= 0)
-		return (float4) 0.0;
-
 	while (ptr1 - GETARR(trg1) < len1 && ptr2 - GETARR(trg2) < len2)
 	{
 		int			res = CMPTRGM(ptr1, ptr2);
@@ -1049,6 +1053,25 @@ cnt_sml(TRGM *trg1, TRGM *trg2, bool inexact)
 		}
 	}
 
+	return count;
+}
+
+float4
+cnt_sml(TRGM *trg1, TRGM *trg2, bool inexact)
+{
+	int			count;
+	int			len1,
+				len2;
+
+	len1 = ARRNELEM(trg1);
+	len2 = ARRNELEM(trg2);
+
+	/* explicit test is needed to avoid 0/0 division when both lengths are 0 */
+	if (len1 <= 0 || len2 <= 0)
+		return (float4) 0.0;
+
+	count = cnt_common(trg1, trg2);
+
 	/*
 	 * If inexact then len2 is equal to count, because we don't know actual
 	 * length of second string in inexact search and we can assume that count
@@ -1341,3 +1364,73 @@ strict_word_similarity_dist_commutator_op(PG_FUNCTION_ARGS)
 	PG_FREE_IF_COPY(in2, 1);
 	PG_RETURN_FLOAT4(1.0 - res);
 }
+
+/*
+ * Extract the fields of a levenshtein_bound value.  Returns false if either
+ * of them is null.
+ */
+bool
+get_levenshtein_bound(HeapTupleHeader bound, text **target, int32 *maxDistance)
+{
+	Datum		value;
+	bool		isnull;
+
+	value = GetAttributeByNum(bound, 1, &isnull);
+	if (isnull)
+		return false;
+	*target = DatumGetTextPP(value);
+
+	value = GetAttributeByNum(bound, 2, &isnull);
+	if (isnull)
+		return false;
+	*maxDistance = DatumGetInt32(value);
+
+	return true;
+}
+
+/*
+ * Minimum number of the query's trigrams that a string within maxDistance
+ * edits of it must share with it.
+ *
+ * A single insertion, deletion or substitution touches at most three
+ * consecutive trigrams of the padded words (it can also split or join words,
+ * which changes no more than that), so at most 3 * maxDistance of the
+ * query's trigrams can disappear.  The result may be zero or negative, in
+ * which case trigrams can't narrow the search.
+ */
+int32
+levenshtein_bound_min_common(int32 ntrigrams, int32 maxDistance)
+{
+	return ntrigrams - 3 * Min(maxDistance, ntrigrams);
+}
+
+/*
+ * levenshtein_bound_op: text <~ levenshtein_bound
+ *
+ * True if the text is within max_distance edits of target.  This is the
+ * operator the planner derives from "levenshtein(col, expr) <= k" clauses so
+ * that trigram indexes can be used to find the candidates.
+ */
+Datum
+levenshtein_bound_op(PG_FUNCTION_ARGS)
+{
+	text	   *in = PG_GETARG_TEXT_PP(0);
+	text	   *target;
+	int32		maxDistance;
+	int			distance;
+
+	if (!get_levenshtein_bound(PG_GETARG_HEAPTUPLEHEADER(1),
+							   &target, &maxDistance))
+		PG_RETURN_NULL();
+
+	if (maxDistance < 0)
+		PG_RETURN_BOOL(false);
+
+	distance = varstr_levenshtein_less_equal(VARDATA_ANY(in),
+											 VARSIZE_ANY_EXHDR(in),
+											 VARDATA_ANY(target),
+											 VARSIZE_ANY_EXHDR(target),
+											 1, 1, 1, maxDistance, false);
+
+	PG_RETURN_BOOL(distance <= maxDistance);
+}
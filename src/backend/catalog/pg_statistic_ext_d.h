@@ -28,12 +28,14 @@
 #define Anum_pg_statistic_ext_stxkind 6
 #define Anum_pg_statistic_ext_stxndistinct 7
 #define Anum_pg_statistic_ext_stxdependencies 8
+#define Anum_pg_statistic_ext_stxblocksketch 9
 
-#define Natts_pg_statistic_ext 8
+#define Natts_pg_statistic_ext 9
 
 
 #define STATS_EXT_NDISTINCT			'd'
 #define STATS_EXT_DEPENDENCIES		'f'
+#define STATS_EXT_BLOCKSKETCH		'b'
 
 
 #endif							/* PG_STATISTIC_EXT_D_H */
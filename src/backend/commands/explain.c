@@ -20,6 +20,7 @@
 #include "commands/defrem.h"
 #include "commands/prepare.h"
 #include "executor/nodeHash.h"
+#include "executor/simjoin.h"
 #include "foreign/fdwapi.h"
 #include "jit/jit.h"
 #include "nodes/extensible.h"
@@ -28,6 +29,7 @@
 #include "optimizer/planmain.h"
 #include "parser/parsetree.h"
 #include "rewrite/rewriteHandler.h"
+#include "statistics/statistics.h"
 #include "storage/bufmgr.h"
 #include "tcop/tcopprot.h"
 #include "utils/builtins.h"
@@ -103,6 +105,7 @@ static void show_tablesample(TableSampleClause *tsc, PlanState *planstate,
 				 List *ancestors, ExplainState *es);
 static void show_sort_info(SortState *sortstate, ExplainState *es);
 static void show_hash_info(HashState *hashstate, ExplainState *es);
+static void show_nestloop_info(NestLoopState *nlstate, ExplainState *es);
 static void show_tidbitmap_info(BitmapHeapScanState *planstate,
 					ExplainState *es);
 static void show_instrumentation_count(const char *qlabel, int which,
@@ -1721,6 +1724,8 @@ ExplainNode(PlanState *planstate, List *ancestors,
 			if (plan->qual)
 				show_instrumentation_count("Rows Removed by Filter", 2,
 										   planstate, es);
+			if (es->analyze)
+				show_nestloop_info(castNode(NestLoopState, planstate), es);
 			break;
 		case T_MergeJoin:
 			show_upper_qual(((MergeJoin *) plan)->mergeclauses,
@@ -2638,6 +2643,363 @@ show_hash_info(HashState *hashstate, ExplainState *es)
 	}
 }
 
+/*
+ * Show runtime statistics of the paged nested loop kernels.
+ */
+static void
+show_nestloop_info(NestLoopState *nlstate, ExplainState *es)
+{
+	EditDistanceFilter *filter = nlstate->edFilter;
+	SimilarityJoinState *sjstate = nlstate->simJoin;
+	LengthBucketedInner *buckets = nlstate->lengthBuckets;
+
+	if (sjstate != NULL)
+	{
+		if (es->format != EXPLAIN_FORMAT_TEXT)
+		{
+			ExplainPropertyText("Candidate Generation",
+								sjstate->useLSH ? "LSH" :
+								sjstate->useBlocking ? "Blocking" :
+								sjstate->usePassJoin ? "PassJoin" : "Length",
+								es);
+			ExplainPropertyInteger("Indexed Segments", NULL,
+								   sjstate->nsegments, es);
+			if (sjstate->useLSH)
+			{
+				double		recall = ExecSimilarityJoinRecall(sjstate);
+
+				ExplainPropertyInteger("LSH Bands", NULL,
+									   SIMJOIN_LSH_BANDS, es);
+				ExplainPropertyInteger("LSH Rows per Band", NULL,
+									   SIMJOIN_LSH_ROWS, es);
+				if (recall >= 0)
+					ExplainPropertyFloat("Estimated Recall", NULL,
+										 recall, 3, es);
+			}
+			if (sjstate->useBlocking)
+			{
+				double		recall = ExecSimilarityJoinRecall(sjstate);
+
+				ExplainPropertyText("Blocking Keys",
+									sjstate->blockingKeys, es);
+				ExplainPropertyInteger("Blocks", NULL,
+									   sjstate->nblocks, es);
+				if (recall >= 0)
+					ExplainPropertyFloat("Sampled Recall", NULL,
+										 recall, 3, es);
+			}
+			ExplainPropertyInteger("Outer Rows", NULL,
+								   sjstate->outer.nrows, es);
+			ExplainPropertyInteger("Outer Distinct Keys", NULL,
+								   sjstate->outer.nvalues, es);
+			ExplainPropertyInteger("Inner Rows", NULL,
+								   sjstate->inner.nrows, es);
+			ExplainPropertyInteger("Inner Distinct Keys", NULL,
+								   sjstate->inner.nvalues, es);
+			ExplainPropertyInteger("Candidate Key Pairs", NULL,
+								   sjstate->candidatePairs, es);
+			ExplainPropertyInteger("Prefiltered Key Pairs", NULL,
+								   sjstate->prefilterRejects, es);
+			ExplainPropertyInteger("Distance Evaluations", NULL,
+								   sjstate->distanceCalls, es);
+			ExplainPropertyInteger("Matching Key Pairs", NULL,
+								   sjstate->matchedPairs, es);
+			ExplainPropertyBool("Distance Ordered",
+								sjstate->distanceOrdered, es);
+			if (sjstate->distanceOrdered)
+				ExplainPropertyInteger("Exact Key Pairs", NULL,
+									   sjstate->exactPairs, es);
+		}
+		else if (sjstate->built)
+		{
+			appendStringInfoSpaces(es->str, es->indent * 2);
+			appendStringInfo(es->str,
+							 "Distinct Keys: outer=%d (of %d rows)  inner=%d (of %d rows)\n",
+							 sjstate->outer.nvalues, sjstate->outer.nrows,
+							 sjstate->inner.nvalues, sjstate->inner.nrows);
+			appendStringInfoSpaces(es->str, es->indent * 2);
+			if (sjstate->useLSH)
+			{
+				double		recall = ExecSimilarityJoinRecall(sjstate);
+
+				appendStringInfo(es->str,
+								 "Candidate Generation: LSH  Bands: %dx%d",
+								 SIMJOIN_LSH_BANDS, SIMJOIN_LSH_ROWS);
+				if (recall >= 0)
+					appendStringInfo(es->str, "  Estimated Recall: %.3f",
+									 recall);
+				appendStringInfoChar(es->str, '\n');
+			}
+			else if (sjstate->useBlocking)
+			{
+				double		recall = ExecSimilarityJoinRecall(sjstate);
+
+				appendStringInfo(es->str,
+								 "Candidate Generation: Blocking on %s  Blocks: %d",
+								 sjstate->blockingKeys, sjstate->nblocks);
+				if (recall >= 0)
+					appendStringInfo(es->str, "  Sampled Recall: %.3f",
+									 recall);
+				appendStringInfoChar(es->str, '\n');
+			}
+			else if (sjstate->usePassJoin)
+				appendStringInfo(es->str,
+								 "Candidate Generation: PassJoin  Segments: %d\n",
+								 sjstate->nsegments);
+			else
+				appendStringInfoString(es->str,
+									   "Candidate Generation: Length\n");
+			appendStringInfoSpaces(es->str, es->indent * 2);
+			appendStringInfo(es->str,
+							 "Key Pairs: candidates=%ld  prefiltered=%ld  compared=%ld  matched=%ld\n",
+							 sjstate->candidatePairs,
+							 sjstate->prefilterRejects,
+							 sjstate->distanceCalls,
+							 sjstate->matchedPairs);
+			if (sjstate->distanceOrdered)
+			{
+				int			d;
+
+				/* key pairs returned per distance, in the tiers reached */
+				appendStringInfoSpaces(es->str, es->indent * 2);
+				appendStringInfo(es->str, "Distance Tiers: 0=%ld",
+								 sjstate->exactPairs);
+				for (d = 1; d <= Min(sjstate->tier, sjstate->maxTier); d++)
+				{
+					if (sjstate->tierPairs[d] > 0)
+						appendStringInfo(es->str, "  %d=%ld", d,
+										 sjstate->tierPairs[d]);
+				}
+				appendStringInfoChar(es->str, '\n');
+			}
+		}
+	}
+
+	if (filter != NULL && sjstate == NULL)
+	{
+		long		passed = filter->checkedPairs - filter->lengthRejects -
+		filter->bagRejects - filter->qgramRejects;
+
+		if (es->format != EXPLAIN_FORMAT_TEXT)
+		{
+			ExplainPropertyInteger("Prefilter Pairs", NULL,
+								   filter->checkedPairs, es);
+			ExplainPropertyInteger("Prefilter Length Rejects", NULL,
+								   filter->lengthRejects, es);
+			ExplainPropertyInteger("Prefilter Bag Rejects", NULL,
+								   filter->bagRejects, es);
+			ExplainPropertyInteger("Prefilter Q-gram Rejects", NULL,
+								   filter->qgramRejects, es);
+		}
+		else if (filter->checkedPairs > 0)
+		{
+			double		total = (double) filter->checkedPairs;
+
+			appendStringInfoSpaces(es->str, es->indent * 2);
+			appendStringInfo(es->str,
+							 "Edit Distance Prefilter: pairs=%ld  length=%.1f%%  bag=%.1f%%  q-gram=%.1f%%  passed=%.1f%%\n",
+							 filter->checkedPairs,
+							 100.0 * filter->lengthRejects / total,
+							 100.0 * filter->bagRejects / total,
+							 100.0 * filter->qgramRejects / total,
+							 100.0 * passed / total);
+		}
+	}
+
+	if (buckets != NULL)
+	{
+		if (es->format != EXPLAIN_FORMAT_TEXT)
+		{
+			ExplainPropertyInteger("Length Bucketed Inner Pages", NULL,
+								   buckets->npages, es);
+			ExplainPropertyInteger("Skipped Inner Pages", NULL,
+								   buckets->skippedPages, es);
+			ExplainPropertyInteger("Inner Passes by Yield", NULL,
+								   buckets->orderedPasses, es);
+		}
+		else if (buckets->built)
+		{
+			appendStringInfoSpaces(es->str, es->indent * 2);
+			appendStringInfo(es->str,
+							 "Length Buckets: inner pages=%d  skipped=%ld",
+							 buckets->npages, buckets->skippedPages);
+			if (buckets->orderedPasses > 0)
+				appendStringInfo(es->str, "  passes by yield=%ld",
+								 buckets->orderedPasses);
+			appendStringInfoChar(es->str, '\n');
+		}
+	}
+
+	if (nlstate->exploredPages > 0)
+	{
+		double		exploreYield = nlstate->exploreTime > 0 ?
+		nlstate->exploreRows / nlstate->exploreTime : 0;
+		double		exploitYield = nlstate->exploitTime > 0 ?
+		nlstate->exploitRows / nlstate->exploitTime : 0;
+		int			extentsEntered = 0;
+		int			i;
+
+		/* extents explored past their probe page */
+		for (i = 0; i < nlstate->nextents; i++)
+		{
+			if (nlstate->extentNext[i] > 1)
+				extentsEntered++;
+		}
+
+		if (es->format != EXPLAIN_FORMAT_TEXT)
+		{
+			ExplainPropertyText("Bandit Reward",
+								nlstate->costAwareRewards ? "Rows per ms" : "Rows",
+								es);
+			ExplainPropertyInteger("Explored Pages", NULL,
+								   nlstate->exploredPages, es);
+			ExplainPropertyInteger("Exploited Pages", NULL,
+								   nlstate->exploitedPages, es);
+			ExplainPropertyInteger("Evaluated Pairs", NULL,
+								   nlstate->evaluatedPairs, es);
+			ExplainPropertyInteger("Base Active Set", NULL,
+								   nlstate->sqrtOfInnerPages, es);
+			ExplainPropertyInteger("Final Active Set", NULL,
+								   nlstate->activeSetLimit, es);
+			ExplainPropertyInteger("Peak Active Set", NULL,
+								   nlstate->peakActiveSetLimit, es);
+			if (nlstate->tupleBound >= 0)
+				ExplainPropertyInteger("Tuple Bound", NULL,
+									   nlstate->tupleBound, es);
+			ExplainPropertyText("Bandit Arms",
+								nlstate->flipped ? "Inner" : "Outer", es);
+			ExplainPropertyBool("Flipped at Runtime",
+								nlstate->flippedAtRuntime, es);
+			ExplainPropertyText("Bandit Strategy",
+								nlstate->blockMode ? "Block" : "Bandit", es);
+			if (nlstate->nextents > 0)
+			{
+				ExplainPropertyInteger("Extents", NULL,
+									   nlstate->nextents, es);
+				ExplainPropertyInteger("Pages per Extent", NULL,
+									   nlstate->extentPages, es);
+				ExplainPropertyInteger("Extents Entered", NULL,
+									   extentsEntered, es);
+			}
+			if (nlstate->sketchPrior != NULL && nlstate->sketchPrior->built)
+			{
+				ExplainPropertyInteger("Sketched Blocks", NULL,
+									   nlstate->sketchPrior->sketch->nblocks, es);
+				ExplainPropertyInteger("Sketched Blocks Used", NULL,
+									   nlstate->sketchPrior->usedBlocks, es);
+				ExplainPropertyInteger("Sketch Pages Ranked", NULL,
+									   nlstate->sketchPrior->npages, es);
+				ExplainPropertyInteger("Sketch Pages Explored", NULL,
+									   nlstate->sketchPrior->nextPage, es);
+			}
+			if (nlstate->sample != NULL)
+			{
+				ExplainPropertyInteger("Sample Tuples", NULL,
+									   nlstate->sampleTuples, es);
+				ExplainPropertyInteger("Sampled Pages", NULL,
+									   nlstate->sampledPages, es);
+			}
+			if (nlstate->blockMode)
+			{
+				ExplainPropertyInteger("Block Switch After Pages", NULL,
+									   nlstate->blockModeAfter, es);
+				ExplainPropertyFloat("Block Switch Score CV", NULL,
+									 nlstate->blockModeScoreCV, 3, es);
+				ExplainPropertyInteger("Block Pages", NULL,
+									   nlstate->blockModePages, es);
+			}
+			if (nlstate->warmupBlocks > 0)
+			{
+				ExplainPropertyInteger("Warm-up Blocks", NULL,
+									   nlstate->warmupBlocks, es);
+				ExplainPropertyFloat("Outer Page Skew", NULL,
+									 nlstate->inputSkew[0], 3, es);
+				ExplainPropertyFloat("Inner Page Skew", NULL,
+									 nlstate->inputSkew[1], 3, es);
+			}
+			if (es->timing)
+			{
+				ExplainPropertyFloat("Explore Yield", "rows/ms",
+									 exploreYield, 3, es);
+				ExplainPropertyFloat("Exploit Yield", "rows/ms",
+									 exploitYield, 3, es);
+			}
+		}
+		else
+		{
+			appendStringInfoSpaces(es->str, es->indent * 2);
+			appendStringInfo(es->str,
+							 "Bandit: reward=%s  explored pages=%ld  exploited=%ld  pairs=%ld\n",
+							 nlstate->costAwareRewards ? "rows/ms" : "rows",
+							 nlstate->exploredPages, nlstate->exploitedPages,
+							 nlstate->evaluatedPairs);
+			appendStringInfoSpaces(es->str, es->indent * 2);
+			appendStringInfo(es->str,
+							 "Bandit Active Set: base=%d  final=%d  peak=%d",
+							 nlstate->sqrtOfInnerPages,
+							 nlstate->activeSetLimit,
+							 nlstate->peakActiveSetLimit);
+			if (nlstate->tupleBound >= 0)
+				appendStringInfo(es->str, "  tuple bound=" INT64_FORMAT,
+								 nlstate->tupleBound);
+			appendStringInfoChar(es->str, '\n');
+			appendStringInfoSpaces(es->str, es->indent * 2);
+			appendStringInfo(es->str, "Bandit Arms: %s input pages",
+							 nlstate->flipped ? "inner" : "outer");
+			if (nlstate->warmupBlocks > 0)
+				appendStringInfo(es->str,
+								 "  %s after %ld warm-up blocks (page yield skew: outer=%.2f  inner=%.2f)",
+								 nlstate->flippedAtRuntime ? "flipped" : "kept",
+								 nlstate->warmupBlocks,
+								 nlstate->inputSkew[0], nlstate->inputSkew[1]);
+			appendStringInfoChar(es->str, '\n');
+			if (nlstate->nextents > 0)
+			{
+				appendStringInfoSpaces(es->str, es->indent * 2);
+				appendStringInfo(es->str,
+								 "Bandit Extents: %d of %d pages  entered=%d\n",
+								 nlstate->nextents, nlstate->extentPages,
+								 extentsEntered);
+			}
+			if (nlstate->sketchPrior != NULL && nlstate->sketchPrior->built)
+			{
+				appendStringInfoSpaces(es->str, es->indent * 2);
+				appendStringInfo(es->str,
+								 "Bandit Sketches: %d of %u blocks used  pages ranked=%d  explored first=%d\n",
+								 nlstate->sketchPrior->usedBlocks,
+								 nlstate->sketchPrior->sketch->nblocks,
+								 nlstate->sketchPrior->npages,
+								 nlstate->sketchPrior->nextPage);
+			}
+			if (nlstate->sample != NULL)
+			{
+				appendStringInfoSpaces(es->str, es->indent * 2);
+				appendStringInfo(es->str,
+								 "Bandit Sample: %d of %ld tuples  pages explored with it=%ld\n",
+								 nlstate->sampleTuples,
+								 nlstate->sampleInputTuples,
+								 nlstate->sampledPages);
+			}
+			if (nlstate->blockMode)
+			{
+				appendStringInfoSpaces(es->str, es->indent * 2);
+				appendStringInfo(es->str,
+								 "Bandit Strategy: block after %ld explored pages (score cv=%.2f)  pages joined in full=%ld\n",
+								 nlstate->blockModeAfter,
+								 nlstate->blockModeScoreCV,
+								 nlstate->blockModePages);
+			}
+			if (es->timing)
+			{
+				appendStringInfoSpaces(es->str, es->indent * 2);
+				appendStringInfo(es->str,
+								 "Bandit Yield: explore=%.3f rows/ms  exploit=%.3f rows/ms\n",
+								 exploreYield, exploitYield);
+			}
+		}
+	}
+}
+
 /*
  * If it's EXPLAIN ANALYZE, show exact/lossy pages for a BitmapHeapScan node
  */
@@ -14,6 +14,7 @@
  */
 #include "postgres.h"
 
+#include "access/htup_details.h"
 #include "access/relscan.h"
 #include "catalog/dependency.h"
 #include "catalog/indexing.h"
@@ -70,11 +71,12 @@ CreateStatistics(CreateStatsStmt *stmt)
 	Oid			relid;
 	ObjectAddress parentobject,
 				myself;
-	Datum		types[2];		/* one for each possible type of statistic */
+	Datum		types[3];		/* one for each possible type of statistic */
 	int			ntypes;
 	ArrayType  *stxkind;
 	bool		build_ndistinct;
 	bool		build_dependencies;
+	bool		build_blocksketch;
 	bool		requested_type = false;
 	int			i;
 	ListCell   *cell;
@@ -233,15 +235,6 @@ CreateStatistics(CreateStatsStmt *stmt)
 		ReleaseSysCache(atttuple);
 	}
 
-	/*
-	 * Check that at least two columns were specified in the statement. The
-	 * upper bound was already checked in the loop above.
-	 */
-	if (numcols < 2)
-		ereport(ERROR,
-				(errcode(ERRCODE_INVALID_OBJECT_DEFINITION),
-				 errmsg("extended statistics require at least 2 columns")));
-
 	/*
 	 * Sort the attnums, which makes detecting duplicates somewhat easier, and
 	 * it does not hurt (it does not affect the efficiency, unlike for
@@ -269,6 +262,7 @@ CreateStatistics(CreateStatsStmt *stmt)
 	 */
 	build_ndistinct = false;
 	build_dependencies = false;
+	build_blocksketch = false;
 	foreach(cell, stmt->stat_types)
 	{
 		char	   *type = strVal((Value *) lfirst(cell));
@@ -283,25 +277,46 @@ CreateStatistics(CreateStatsStmt *stmt)
 			build_dependencies = true;
 			requested_type = true;
 		}
+		else if (strcmp(type, "blocksketch") == 0)
+		{
+			build_blocksketch = true;
+			requested_type = true;
+		}
 		else
 			ereport(ERROR,
 					(errcode(ERRCODE_SYNTAX_ERROR),
 					 errmsg("unrecognized statistics kind \"%s\"",
 							type)));
 	}
-	/* If no statistic type was specified, build them all. */
+	/*
+	 * If no statistic type was specified, build all the multi-column ones.
+	 * Block sketches are built only on request: they take a second look at
+	 * the sampled blocks and are used by no plan estimate.
+	 */
 	if (!requested_type)
 	{
 		build_ndistinct = true;
 		build_dependencies = true;
 	}
 
+	/*
+	 * Check that at least two columns were specified in the statement, or
+	 * one for a block sketch alone. The upper bound was already checked in
+	 * the loop above.
+	 */
+	if (numcols < 2 && (build_ndistinct || build_dependencies))
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_OBJECT_DEFINITION),
+				 errmsg("extended statistics require at least 2 columns")));
+
 	/* construct the char array of enabled statistic types */
 	ntypes = 0;
 	if (build_ndistinct)
 		types[ntypes++] = CharGetDatum(STATS_EXT_NDISTINCT);
 	if (build_dependencies)
 		types[ntypes++] = CharGetDatum(STATS_EXT_DEPENDENCIES);
+	if (build_blocksketch)
+		types[ntypes++] = CharGetDatum(STATS_EXT_BLOCKSKETCH);
 	Assert(ntypes > 0 && ntypes <= lengthof(types));
 	stxkind = construct_array(types, ntypes, CHAROID, 1, true, 'c');
 
@@ -320,6 +335,7 @@ CreateStatistics(CreateStatsStmt *stmt)
 	/* no statistics built yet */
 	nulls[Anum_pg_statistic_ext_stxndistinct - 1] = true;
 	nulls[Anum_pg_statistic_ext_stxdependencies - 1] = true;
+	nulls[Anum_pg_statistic_ext_stxblocksketch - 1] = true;
 
 	/* insert it into pg_statistic_ext */
 	statrel = heap_open(StatisticExtRelationId, RowExclusiveLock);
@@ -430,8 +446,39 @@ UpdateStatisticsForTypeChange(Oid statsOid, Oid relationOid, int attnum,
 	 * values, this assumption could fail.  But that seems like a corner case
 	 * that doesn't justify zapping the stats in common cases.)
 	 *
-	 * Future types of extended stats will likely require us to work harder.
+	 * Block sketches are different: their ranges and hash signatures are of
+	 * values of the old type, so they are reset until the next ANALYZE.
 	 */
+	Relation	rel;
+	HeapTuple	oldtup;
+	HeapTuple	newtup;
+	Datum		values[Natts_pg_statistic_ext];
+	bool		nulls[Natts_pg_statistic_ext];
+	bool		replaces[Natts_pg_statistic_ext];
+
+	oldtup = SearchSysCache1(STATEXTOID, ObjectIdGetDatum(statsOid));
+	if (!HeapTupleIsValid(oldtup))
+		elog(ERROR, "cache lookup failed for statistics object %u", statsOid);
+
+	if (heap_attisnull(oldtup, Anum_pg_statistic_ext_stxblocksketch, NULL))
+	{
+		ReleaseSysCache(oldtup);
+		return;
+	}
+
+	memset(values, 0, sizeof(values));
+	memset(nulls, false, sizeof(nulls));
+	memset(replaces, false, sizeof(replaces));
+	nulls[Anum_pg_statistic_ext_stxblocksketch - 1] = true;
+	replaces[Anum_pg_statistic_ext_stxblocksketch - 1] = true;
+
+	rel = heap_open(StatisticExtRelationId, RowExclusiveLock);
+	newtup = heap_modify_tuple(oldtup, RelationGetDescr(rel),
+							   values, nulls, replaces);
+	CatalogTupleUpdate(rel, &newtup->t_self, newtup);
+	heap_freetuple(newtup);
+	ReleaseSysCache(oldtup);
+	heap_close(rel, RowExclusiveLock);
 }
 
 /*
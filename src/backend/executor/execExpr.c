@@ -41,6 +41,8 @@
 #include "nodes/makefuncs.h"
 #include "nodes/nodeFuncs.h"
 #include "optimizer/clauses.h"
+#include "optimizer/cost.h"
+#include "optimizer/editdist.h"
 #include "optimizer/planner.h"
 #include "pgstat.h"
 #include "utils/builtins.h"
@@ -62,6 +64,8 @@ static void ExecInitExprRec(Expr *node, ExprState *state,
 static void ExecInitFunc(ExprEvalStep *scratch, Expr *node, List *args,
 			 Oid funcid, Oid inputcollid,
 			 ExprState *state);
+static void ExecInitEditDistance(ExprEvalStep *scratch,
+					 EditDistanceClause *edc, ExprState *state);
 static void ExecInitExprSlots(ExprState *state, Node *node);
 static void ExecPushExprSlots(ExprState *state, LastAttnumInfo *info);
 static bool get_last_attnums_walker(Node *node, LastAttnumInfo *info);
@@ -889,6 +893,19 @@ ExecInitExprRec(Expr *node, ExprState *state,
 		case T_OpExpr:
 			{
 				OpExpr	   *op = (OpExpr *) node;
+				EditDistanceClause edc;
+
+				/*
+				 * levenshtein(a, b) <= k gets a fused step that computes a
+				 * bounded distance directly on the normalised operands.
+				 */
+				if (enable_fusedlevenshtein &&
+					match_edit_distance_clause((Node *) node, &edc))
+				{
+					ExecInitEditDistance(&scratch, &edc, state);
+					ExprEvalPushStep(state, &scratch);
+					break;
+				}
 
 				ExecInitFunc(&scratch, node,
 							 op->args, op->opfuncid, op->inputcollid,
@@ -2253,6 +2270,32 @@ ExecInitFunc(ExprEvalStep *scratch, Expr *node, List *args, Oid funcid,
 	}
 }
 
+/*
+ * Prepare evaluation of a recognised edit-distance predicate.
+ *
+ * Only the raw string operands are evaluated as separate steps; the
+ * truncation, trimming and the distance itself happen inside the single
+ * EEOP_EDIT_DISTANCE step, without going through fmgr.
+ */
+static void
+ExecInitEditDistance(ExprEvalStep *scratch, EditDistanceClause *edc,
+					 ExprState *state)
+{
+	int			i;
+
+	scratch->opcode = EEOP_EDIT_DISTANCE;
+	scratch->d.editdistance.values = (Datum *) palloc(sizeof(Datum) * 2);
+	scratch->d.editdistance.nulls = (bool *) palloc(sizeof(bool) * 2);
+	scratch->d.editdistance.clause = (EditDistanceClause *)
+		palloc(sizeof(EditDistanceClause));
+	memcpy(scratch->d.editdistance.clause, edc, sizeof(EditDistanceClause));
+
+	for (i = 0; i < 2; i++)
+		ExecInitExprRec(edc->args[i].expr, state,
+						&scratch->d.editdistance.values[i],
+						&scratch->d.editdistance.nulls[i]);
+}
+
 /*
  * Add expression steps deforming the ExprState's inner/outer/scan slots
  * as much as required by the expression.
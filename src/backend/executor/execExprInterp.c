@@ -65,6 +65,7 @@
 #include "utils/memutils.h"
 #include "miscadmin.h"
 #include "nodes/nodeFuncs.h"
+#include "optimizer/editdist.h"
 #include "parser/parsetree.h"
 #include "pgstat.h"
 #include "utils/builtins.h"
@@ -74,6 +75,7 @@
 #include "utils/lsyscache.h"
 #include "utils/timestamp.h"
 #include "utils/typcache.h"
+#include "utils/varlena.h"
 #include "utils/xml.h"
 
 
@@ -366,6 +368,7 @@ ExecInterpExpr(ExprState *state, ExprContext *econtext, bool *isnull)
 		&&CASE_EEOP_ROWCOMPARE_STEP,
 		&&CASE_EEOP_ROWCOMPARE_FINAL,
 		&&CASE_EEOP_MINMAX,
+		&&CASE_EEOP_EDIT_DISTANCE,
 		&&CASE_EEOP_FIELDSELECT,
 		&&CASE_EEOP_FIELDSTORE_DEFORM,
 		&&CASE_EEOP_FIELDSTORE_FORM,
@@ -1352,6 +1355,14 @@ ExecInterpExpr(ExprState *state, ExprContext *econtext, bool *isnull)
 			EEO_NEXT();
 		}
 
+		EEO_CASE(EEOP_EDIT_DISTANCE)
+		{
+			/* too complex for an inline implementation */
+			ExecEvalEditDistance(state, op);
+
+			EEO_NEXT();
+		}
+
 		EEO_CASE(EEOP_FIELDSELECT)
 		{
 			/* too complex for an inline implementation */
@@ -2824,6 +2835,46 @@ ExecEvalMinMax(ExprState *state, ExprEvalStep *op)
 	}
 }
 
+/*
+ * Evaluate a fused "levenshtein(a, b) <= k" predicate.
+ *
+ * Both raw operands have already been evaluated into
+ * op->d.editdistance.values[]/nulls[].  Any trim()/varchar(n) wrappers that
+ * were peeled off at compile time are applied in place, and the distance is
+ * computed with the bounded algorithm so it can give up as soon as k is
+ * exceeded.  Like levenshtein() itself, strings longer than
+ * MAX_LEVENSHTEIN_STRLEN raise an error.
+ */
+void
+ExecEvalEditDistance(ExprState *state, ExprEvalStep *op)
+{
+	EditDistanceClause *edc = op->d.editdistance.clause;
+	Datum	   *values = op->d.editdistance.values;
+	bool	   *nulls = op->d.editdistance.nulls;
+	const char *s;
+	const char *t;
+	int			slen;
+	int			tlen;
+	int			dist;
+
+	/* levenshtein() and the comparison are both strict */
+	if (nulls[0] || nulls[1])
+	{
+		*op->resvalue = (Datum) 0;
+		*op->resnull = true;
+		return;
+	}
+
+	s = edit_distance_normalize(&edc->args[0], values[0], &slen);
+	t = edit_distance_normalize(&edc->args[1], values[1], &tlen);
+
+	dist = varstr_levenshtein_less_equal(s, slen, t, tlen, 1, 1, 1,
+										 Max(edc->maxDistance, 0), false);
+
+	*op->resvalue = BoolGetDatum(dist <= edc->maxDistance);
+	*op->resnull = false;
+}
+
 /*
  * Evaluate a FieldSelect node.
  *
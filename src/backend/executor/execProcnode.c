@@ -904,6 +904,17 @@ ExecSetTupleBound(int64 tuples_needed, PlanState *child_node)
 
 		ExecSetTupleBound(tuples_needed, outerPlanState(child_node));
 	}
+	else if (IsA(child_node, NestLoopState))
+	{
+		/*
+		 * A bandit nested loop uses the bound to decide when to stop
+		 * exploring outer pages.  It cannot be passed further down: the join
+		 * may read any number of input rows to produce this many.
+		 */
+		NestLoopState *nlstate = (NestLoopState *) child_node;
+
+		nlstate->tupleBound = tuples_needed;
+	}
 
 	/*
 	 * In principle we could descend through any plan node type that is
@@ -0,0 +1,1491 @@
+/*-------------------------------------------------------------------------
+ *
+ * execSimjoin.c
+ *	  Similarity join over distinct join keys.
+ *
+ * A nested loop whose join quals contain an edit-distance threshold such
+ * as levenshtein(o.a, i.b) <= k can be run here instead of by the nested
+ * loop kernels.  Join keys in similarity workloads are highly repetitive
+ * (makes, brands, titles), so we first read both inputs into dictionaries
+ * that map each distinct normalised key to the rows carrying it.  The
+ * clause is then evaluated once per pair of distinct keys, and each
+ * matching key pair is expanded into its row pairs.
+ *
+ * Only key pairs whose lengths differ by at most k are compared.  With
+ * enable_passjoin, candidates are narrowed further by the segment scheme of
+ * PassJoin (Li et al., "Pass-Join: A Partition-based Method for Similarity
+ * Joins", VLDB 2011): each inner key of length l >= k + 1 is cut into k + 1
+ * segments, and by pigeonhole any outer key within distance k contains one
+ * of them unchanged.  The segments are indexed by hash, and each outer key
+ * probes the index with its substrings at the few positions where a
+ * segment of a key of each admissible length could have moved to.
+ *
+ * enable_lshjoin trades completeness for speed instead: each key gets a
+ * MinHash signature of its set of character bigrams, the signatures are cut
+ * into bands, and only keys sharing a whole band with the outer key are
+ * compared (locality-sensitive hashing).  A pair whose bigram sets have
+ * Jaccard similarity J becomes a candidate with probability
+ * 1 - (1 - J^r)^b for b bands of r hashes, so matches may be missed; each
+ * match found is weighted by the inverse of that probability to estimate
+ * how many were missed (see ExecSimilarityJoinRecall).
+ *
+ * similarity_join_blocking_keys names functions such as soundex() or
+ * dmetaphone() that map a key to a blocking key, typically a phonetic code.
+ * Only keys sharing a blocking key are compared, which is what hand-written
+ * blocking queries do; naming several functions, e.g. dmetaphone and
+ * dmetaphone_alt, lets a pair be found through any of them.  Outer keys are
+ * visited block by block.  Blocking may miss matches as well, so a sample of
+ * SIMJOIN_BLOCKING_SAMPLES outer keys is also compared with all inner keys
+ * of admissible length, to measure the fraction of matches it finds.
+ *
+ * Results are streamed: key pairs are visited with the most frequent outer
+ * keys first, and a matching pair is expanded as soon as it is found, so
+ * the first rows are returned after the inputs are read rather than after
+ * all distances are known.
+ *
+ * If the plan needs the rows ordered by edit distance (NestLoop's
+ * distanceOrdered, for ORDER BY levenshtein(...)), pairs of identical keys
+ * are found by looking the outer keys up in the inner dictionary and are
+ * returned first.  The candidate pairs are then compared once per tier
+ * d = 1, 2, ..., k, with bound d and a length window of d, and the pairs at
+ * exactly distance d are returned before tier d + 1 is started.  Nothing is
+ * kept between tiers but a count for EXPLAIN, and a LIMIT satisfied by the
+ * low tiers never compares a pair at the higher bounds.
+ *
+ * Both dictionaries must fit in work_mem.  If they do not, the join is
+ * flagged as overflowed and the nested loop falls back on its own kernels,
+ * which evaluate the clause row pair by row pair.
+ *
+ * Only inner joins without nest-loop parameters are handled.
+ *
+ * Portions Copyright (c) 1996-2018, PostgreSQL Global Development Group
+ * Portions Copyright (c) 1994, Regents of the University of California
+ *
+ *
+ * IDENTIFICATION
+ *	  src/backend/executor/execSimjoin.c
+ *
+ *-------------------------------------------------------------------------
+ */
+#include "postgres.h"
+
+#include <math.h>
+
+#include "access/hash.h"
+#include "catalog/pg_type.h"
+#include "executor/executor.h"
+#include "executor/simjoin.h"
+#include "mb/pg_wchar.h"
+#include "miscadmin.h"
+#include "optimizer/cost.h"
+#include "parser/parse_func.h"
+#include "utils/acl.h"
+#include "utils/builtins.h"
+#include "utils/hashutils.h"
+#include "utils/lsyscache.h"
+#include "utils/memutils.h"
+#include "utils/regproc.h"
+#include "utils/varlena.h"
+
+
+/* One row's key while a dictionary is being built */
+typedef struct SimilarityEntry
+{
+	char	   *value;
+	int			bytes;
+	int			chars;
+	int			row;
+} SimilarityEntry;
+
+static bool build_dictionary(NestLoopState *nlstate, bool outerSide,
+				 SimilarityDictionary *dict);
+static int	compare_entries(const void *a, const void *b);
+static bool same_key(const SimilarityEntry *a, const SimilarityEntry *b);
+static int	compare_frequency(const void *a, const void *b, void *arg);
+static int	first_key_of_length(const SimilarityDictionary *dict, int chars);
+static void build_passjoin_index(SimilarityJoinState *sjstate);
+static void passjoin_segment(int len, int k, int segno, int *start, int *seglen);
+static uint32 passjoin_hash(int len, int segno, const char *str, int bytes);
+static int	compare_segments(const void *a, const void *b);
+static void passjoin_probe(SimilarityJoinState *sjstate, const int *offsets,
+			   int chars, int len);
+static void add_candidates(SimilarityJoinState *sjstate, uint32 hash,
+			   int minchars, int maxchars);
+static void build_lsh_index(SimilarityJoinState *sjstate);
+static int	lsh_grams(const char *str, int bytes, uint32 *grams);
+static int	compare_grams(const void *a, const void *b);
+static void lsh_signature(const uint32 *grams, int ngrams, uint32 *minhashes);
+static uint32 lsh_band_hash(const uint32 *minhashes, int band);
+static double lsh_candidate_probability(const uint32 *a, int na,
+						  const uint32 *b, int nb);
+static void init_blocking_functions(SimilarityJoinState *sjstate,
+						const char *keys);
+static void build_blocking_index(SimilarityJoinState *sjstate);
+static uint32 blocking_key_hash(FmgrInfo *flinfo, Oid collation,
+				  const char *str, int bytes);
+static int	compare_block(const void *a, const void *b, void *arg);
+static void sample_blocking_recall(SimilarityJoinState *sjstate,
+					   int outerValue, int first, int last);
+static void start_outer_key(SimilarityJoinState *sjstate, int bound);
+static int key_pair_distance(SimilarityJoinState *sjstate, int outerValue,
+				  int innerValue, int bound);
+static void start_key_pair(SimilarityJoinState *sjstate, int outerValue,
+			   int innerValue);
+static bool next_ordered_key_pair(SimilarityJoinState *sjstate);
+static void start_tier(SimilarityJoinState *sjstate);
+static int	find_key(const SimilarityDictionary *dict, const char *value,
+		 int bytes, int chars);
+
+
+/* ----------------------------------------------------------------
+ *		ExecInitSimilarityJoin
+ *
+ *		Set up a similarity join for nlstate, driven by the join qual
+ *		"clause", which has been decomposed into edc.  outerArgno tells
+ *		which argument of the clause reads the outer input.
+ * ----------------------------------------------------------------
+ */
+SimilarityJoinState *
+ExecInitSimilarityJoin(NestLoopState *nlstate, Node *clause,
+					   EditDistanceClause *edc, int outerArgno)
+{
+	NestLoop   *node = (NestLoop *) nlstate->js.ps.plan;
+	EState	   *estate = nlstate->js.ps.state;
+	SimilarityJoinState *sjstate;
+	List	   *restQuals;
+
+	Assert(node->join.jointype == JOIN_INNER && node->nestParams == NIL);
+
+	sjstate = (SimilarityJoinState *) palloc0(sizeof(SimilarityJoinState));
+	sjstate->clause = *edc;
+	sjstate->outerArgno = outerArgno;
+	sjstate->outerKey = ExecInitExpr(edc->args[outerArgno].expr,
+									 (PlanState *) nlstate);
+	sjstate->innerKey = ExecInitExpr(edc->args[1 - outerArgno].expr,
+									 (PlanState *) nlstate);
+
+	/* the clause itself is checked per key pair, not per row pair */
+	restQuals = list_delete_ptr(list_copy(node->join.joinqual), clause);
+	sjstate->restQual = ExecInitQual(restQuals, (PlanState *) nlstate);
+
+	sjstate->cxt = AllocSetContextCreate(CurrentMemoryContext,
+										 "SimilarityJoin",
+										 ALLOCSET_DEFAULT_SIZES);
+	sjstate->distanceOrdered = node->distanceOrdered;
+	sjstate->useLSH = node->simJoinStrategy == SIMJOIN_LSH;
+	sjstate->useBlocking = node->simJoinStrategy == SIMJOIN_BLOCKING;
+	sjstate->usePassJoin = node->simJoinStrategy == SIMJOIN_PASSJOIN;
+	if (sjstate->useBlocking)
+		init_blocking_functions(sjstate, node->simJoinBlockingKeys);
+	sjstate->outerSlot =
+		ExecInitExtraTupleSlot(estate,
+							   ExecGetResultType(outerPlanState(nlstate)));
+	sjstate->innerSlot =
+		ExecInitExtraTupleSlot(estate,
+							   ExecGetResultType(innerPlanState(nlstate)));
+
+	return sjstate;
+}
+
+/* ----------------------------------------------------------------
+ *		ExecSimilarityJoin
+ *
+ *		Return the next joined tuple, or NULL when done.
+ * ----------------------------------------------------------------
+ */
+TupleTableSlot *
+ExecSimilarityJoin(NestLoopState *nlstate)
+{
+	SimilarityJoinState *sjstate = nlstate->simJoin;
+	ExprContext *econtext = nlstate->js.ps.ps_ExprContext;
+	ExprState  *otherqual = nlstate->js.ps.qual;
+
+	CHECK_FOR_INTERRUPTS();
+
+	ResetExprContext(econtext);
+
+	if (!sjstate->built)
+	{
+		sjstate->spaceUsed = 0;
+		if (!build_dictionary(nlstate, true, &sjstate->outer) ||
+			!build_dictionary(nlstate, false, &sjstate->inner))
+		{
+			/* the caller rejoins the rescanned inputs by its own kernels */
+			MemoryContextReset(sjstate->cxt);
+			memset(&sjstate->outer, 0, sizeof(SimilarityDictionary));
+			memset(&sjstate->inner, 0, sizeof(SimilarityDictionary));
+			sjstate->outerOrder = NULL;
+			sjstate->candidates = NULL;
+			sjstate->overflowed = true;
+			ExecReScan(outerPlanState(nlstate));
+			ExecReScan(innerPlanState(nlstate));
+			return NULL;
+		}
+		sjstate->outerPos = -1;
+		sjstate->ncandidates = sjstate->nextCandidate = 0;
+		sjstate->expanding = false;
+		sjstate->tier = 0;
+		sjstate->tierPairs = NULL;
+		sjstate->built = true;
+
+		/* a negative bound can never be met */
+		if (sjstate->clause.maxDistance < 0)
+			sjstate->outer.nvalues = 0;
+		else if (sjstate->useLSH)
+			build_lsh_index(sjstate);
+		else if (sjstate->useBlocking)
+			build_blocking_index(sjstate);
+		else if (sjstate->usePassJoin)
+			build_passjoin_index(sjstate);
+	}
+
+	for (;;)
+	{
+		if (sjstate->expanding)
+		{
+			SimilarityDictionary *outer = &sjstate->outer;
+			SimilarityDictionary *inner = &sjstate->inner;
+			int			outerValue = sjstate->outerValue;
+			int			innerValue = sjstate->innerValue;
+			int			outerRow = outer->postings[sjstate->outerPosting];
+			int			innerRow = inner->postings[sjstate->innerPosting];
+
+			/* advance to the next row pair of this key pair */
+			if (++sjstate->innerPosting == inner->firstPosting[innerValue + 1])
+			{
+				sjstate->innerPosting = inner->firstPosting[innerValue];
+				if (++sjstate->outerPosting ==
+					outer->firstPosting[outerValue + 1])
+					sjstate->expanding = false;
+			}
+
+			ExecStoreMinimalTuple(outer->rows[outerRow],
+								  sjstate->outerSlot, false);
+			ExecStoreMinimalTuple(inner->rows[innerRow],
+								  sjstate->innerSlot, false);
+			econtext->ecxt_outertuple = sjstate->outerSlot;
+			econtext->ecxt_innertuple = sjstate->innerSlot;
+
+			if (ExecQual(sjstate->restQual, econtext))
+			{
+				if (otherqual == NULL || ExecQual(otherqual, econtext))
+					return ExecProject(nlstate->js.ps.ps_ProjInfo);
+				else
+					InstrCountFiltered2(nlstate, 1);
+			}
+			else
+				InstrCountFiltered1(nlstate, 1);
+
+			ResetExprContext(econtext);
+			continue;
+		}
+
+		if (sjstate->distanceOrdered)
+		{
+			if (!next_ordered_key_pair(sjstate))
+				return NULL;
+			continue;
+		}
+
+		if (sjstate->nextCandidate < sjstate->ncandidates)
+		{
+			int			outerValue = sjstate->outerOrder[sjstate->outerPos];
+			int			innerValue =
+			sjstate->candidates[sjstate->nextCandidate++];
+
+			if (key_pair_distance(sjstate, outerValue, innerValue,
+								  sjstate->clause.maxDistance) <=
+				sjstate->clause.maxDistance)
+				start_key_pair(sjstate, outerValue, innerValue);
+			continue;
+		}
+
+		if (sjstate->outerPos + 1 >= sjstate->outer.nvalues)
+			return NULL;
+		sjstate->outerPos++;
+		start_outer_key(sjstate, sjstate->clause.maxDistance);
+	}
+}
+
+/* ----------------------------------------------------------------
+ *		ExecReScanSimilarityJoin
+ *
+ *		Forget the dictionaries; they are rebuilt from the rescanned
+ *		inputs on the next call.  The caller takes care of the outer plan.
+ * ----------------------------------------------------------------
+ */
+void
+ExecReScanSimilarityJoin(NestLoopState *nlstate)
+{
+	SimilarityJoinState *sjstate = nlstate->simJoin;
+	PlanState  *innerPlan = innerPlanState(nlstate);
+
+	if (sjstate->built)
+	{
+		MemoryContextReset(sjstate->cxt);
+		memset(&sjstate->outer, 0, sizeof(SimilarityDictionary));
+		memset(&sjstate->inner, 0, sizeof(SimilarityDictionary));
+		memset(&sjstate->source, 0, sizeof(LevenshteinSource));
+		sjstate->outerOrder = NULL;
+		sjstate->segments = NULL;
+		sjstate->nsegments = 0;
+		sjstate->probeStamp = NULL;
+		sjstate->innerGramStart = NULL;
+		sjstate->innerGrams = NULL;
+		sjstate->outerGrams = NULL;
+		sjstate->outerBlocks = NULL;
+		sjstate->candidates = NULL;
+		sjstate->tierPairs = NULL;
+		sjstate->built = false;
+	}
+
+	if (innerPlan->chgParam == NULL)
+		ExecReScan(innerPlan);
+}
+
+/* ----------------------------------------------------------------
+ *		ExecSimilarityJoinRecall
+ *
+ *		Estimated fraction of the matching row pairs that an LSH or a
+ *		blocking join has returned so far, or -1 if there is no basis for
+ *		an estimate yet.
+ *
+ *		For LSH, every match found is counted 1/p times, p being the
+ *		probability that LSH proposes a pair with its bigram sets; that sum
+ *		estimates all the matches, including the missed ones.  For blocking,
+ *		it is the fraction found among the matches of the sampled outer
+ *		keys.
+ * ----------------------------------------------------------------
+ */
+double
+ExecSimilarityJoinRecall(SimilarityJoinState *sjstate)
+{
+	if (sjstate->useLSH && sjstate->lshFoundRows > 0)
+		return sjstate->lshFoundRows / sjstate->lshEstimatedRows;
+	if (sjstate->useBlocking && sjstate->sampleRows > 0)
+		return sjstate->sampleFoundRows / sjstate->sampleRows;
+	return -1;
+}
+
+/* ----------------------------------------------------------------
+ *		ExecEndSimilarityJoin
+ * ----------------------------------------------------------------
+ */
+void
+ExecEndSimilarityJoin(SimilarityJoinState *sjstate)
+{
+	ExecClearTuple(sjstate->outerSlot);
+	ExecClearTuple(sjstate->innerSlot);
+	MemoryContextDelete(sjstate->cxt);
+}
+
+/*
+ * build_dictionary
+ *		Read one input to the end and group its rows by join key.
+ *
+ * Returns false, leaving the input partly read, as soon as the space taken
+ * by both dictionaries exceeds work_mem.
+ */
+static bool
+build_dictionary(NestLoopState *nlstate, bool outerSide,
+				 SimilarityDictionary *dict)
+{
+	SimilarityJoinState *sjstate = nlstate->simJoin;
+	PlanState  *plan;
+	ExprContext *econtext = nlstate->js.ps.ps_ExprContext;
+	ExprState  *keyState;
+	EditDistanceOperand *operand;
+	SimilarityEntry *entries;
+	int			maxrows = 1024;
+	long		allowedSpace = work_mem * 1024L;
+	int			nvalues;
+	int			i;
+	MemoryContext oldcontext;
+
+	if (outerSide)
+	{
+		plan = outerPlanState(nlstate);
+		keyState = sjstate->outerKey;
+		operand = &sjstate->clause.args[sjstate->outerArgno];
+	}
+	else
+	{
+		plan = innerPlanState(nlstate);
+		keyState = sjstate->innerKey;
+		operand = &sjstate->clause.args[1 - sjstate->outerArgno];
+	}
+
+	entries = MemoryContextAllocHuge(sjstate->cxt,
+									 maxrows * sizeof(SimilarityEntry));
+	dict->rows = MemoryContextAllocHuge(sjstate->cxt,
+										maxrows * sizeof(MinimalTuple));
+	dict->nrows = 0;
+	sjstate->spaceUsed += maxrows * (sizeof(SimilarityEntry) +
+									 sizeof(MinimalTuple));
+
+	for (;;)
+	{
+		TupleTableSlot *slot = ExecProcNode(plan);
+		Datum		value;
+		bool		isnull;
+
+		if (TupIsNull(slot))
+			break;
+
+		if (outerSide)
+			econtext->ecxt_outertuple = slot;
+		else
+			econtext->ecxt_innertuple = slot;
+
+		oldcontext = MemoryContextSwitchTo(econtext->ecxt_per_tuple_memory);
+		value = ExecEvalExpr(keyState, econtext, &isnull);
+		if (!isnull)
+		{
+			SimilarityEntry *entry;
+			const char *str;
+			int			len;
+
+			str = edit_distance_normalize(operand, value, &len);
+
+			MemoryContextSwitchTo(sjstate->cxt);
+			if (dict->nrows >= maxrows)
+			{
+				sjstate->spaceUsed += maxrows * (sizeof(SimilarityEntry) +
+												 sizeof(MinimalTuple));
+				maxrows *= 2;
+				entries = repalloc_huge(entries,
+										maxrows * sizeof(SimilarityEntry));
+				dict->rows = repalloc_huge(dict->rows,
+										   maxrows * sizeof(MinimalTuple));
+			}
+			entry = &entries[dict->nrows];
+			entry->value = palloc(len);
+			memcpy(entry->value, str, len);
+			entry->bytes = len;
+			entry->chars = pg_mbstrlen_with_len(str, len);
+			entry->row = dict->nrows;
+			dict->rows[dict->nrows] = ExecCopySlotMinimalTuple(slot);
+			sjstate->spaceUsed += GetMemoryChunkSpace(entry->value) +
+				GetMemoryChunkSpace(dict->rows[dict->nrows]) + sizeof(int);
+			dict->nrows++;
+		}
+		MemoryContextSwitchTo(oldcontext);
+		ResetExprContext(econtext);
+
+		if (sjstate->spaceUsed > allowedSpace)
+			return false;
+
+		CHECK_FOR_INTERRUPTS();
+	}
+
+	qsort(entries, dict->nrows, sizeof(SimilarityEntry), compare_entries);
+
+	/* count distinct keys, then lay out the dictionary */
+	nvalues = 0;
+	for (i = 0; i < dict->nrows; i++)
+	{
+		if (i == 0 || !same_key(&entries[i - 1], &entries[i]))
+			nvalues++;
+	}
+
+	oldcontext = MemoryContextSwitchTo(sjstate->cxt);
+	dict->nvalues = nvalues;
+	dict->values = palloc(nvalues * sizeof(char *));
+	dict->bytes = palloc(nvalues * sizeof(int));
+	dict->chars = palloc(nvalues * sizeof(int));
+	dict->sigs = palloc(nvalues * sizeof(EditDistanceSignature));
+	dict->firstPosting = palloc((nvalues + 1) * sizeof(int));
+	dict->postings = MemoryContextAllocHuge(sjstate->cxt,
+											Max(dict->nrows, 1) * sizeof(int));
+
+	nvalues = 0;
+	for (i = 0; i < dict->nrows; i++)
+	{
+		SimilarityEntry *entry = &entries[i];
+
+		/* compare with the first entry of the group, whose key is kept */
+		if (i == 0 ||
+			!same_key(&entries[dict->firstPosting[nvalues - 1]], entry))
+		{
+			dict->values[nvalues] = entry->value;
+			dict->bytes[nvalues] = entry->bytes;
+			dict->chars[nvalues] = entry->chars;
+			edit_distance_signature(entry->value, entry->bytes,
+									&dict->sigs[nvalues]);
+			dict->firstPosting[nvalues] = i;
+			nvalues++;
+		}
+		else
+			pfree(entry->value);
+		dict->postings[i] = entry->row;
+	}
+	dict->firstPosting[nvalues] = dict->nrows;
+	pfree(entries);
+
+	if (outerSide)
+	{
+		sjstate->outerOrder = palloc(Max(nvalues, 1) * sizeof(int));
+		for (i = 0; i < nvalues; i++)
+			sjstate->outerOrder[i] = i;
+		qsort_arg(sjstate->outerOrder, nvalues, sizeof(int),
+				  compare_frequency, dict);
+	}
+	else
+		sjstate->candidates = palloc(Max(nvalues, 1) * sizeof(int));
+	MemoryContextSwitchTo(oldcontext);
+	return true;
+}
+
+/*
+ * Order keys by character length, then bytewise; equal keys by input order.
+ */
+static int
+compare_entries(const void *a, const void *b)
+{
+	const SimilarityEntry *ea = (const SimilarityEntry *) a;
+	const SimilarityEntry *eb = (const SimilarityEntry *) b;
+	int			cmp;
+
+	if (ea->chars != eb->chars)
+		return ea->chars < eb->chars ? -1 : 1;
+	if (ea->bytes != eb->bytes)
+		return ea->bytes < eb->bytes ? -1 : 1;
+	cmp = memcmp(ea->value, eb->value, ea->bytes);
+	if (cmp != 0)
+		return cmp;
+	return ea->row < eb->row ? -1 : (ea->row > eb->row ? 1 : 0);
+}
+
+static bool
+same_key(const SimilarityEntry *a, const SimilarityEntry *b)
+{
+	return a->bytes == b->bytes && memcmp(a->value, b->value, a->bytes) == 0;
+}
+
+/*
+ * Order key numbers by descending number of rows, then by key number.
+ */
+static int
+compare_frequency(const void *a, const void *b, void *arg)
+{
+	const SimilarityDictionary *dict = (const SimilarityDictionary *) arg;
+	int			va = *(const int *) a;
+	int			vb = *(const int *) b;
+	int			na = dict->firstPosting[va + 1] - dict->firstPosting[va];
+	int			nb = dict->firstPosting[vb + 1] - dict->firstPosting[vb];
+
+	if (na != nb)
+		return na > nb ? -1 : 1;
+	return va < vb ? -1 : (va > vb ? 1 : 0);
+}
+
+/*
+ * Lowest key number whose length is at least chars, or nvalues if none.
+ */
+static int
+first_key_of_length(const SimilarityDictionary *dict, int chars)
+{
+	int			lo = 0;
+	int			hi = dict->nvalues;
+
+	while (lo < hi)
+	{
+		int			mid = lo + (hi - lo) / 2;
+
+		if (dict->chars[mid] < chars)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+/*
+ * build_passjoin_index
+ *		Index the segments of all inner keys that have at least k + 1
+ *		characters.
+ */
+static void
+build_passjoin_index(SimilarityJoinState *sjstate)
+{
+	SimilarityDictionary *inner = &sjstate->inner;
+	int			k = sjstate->clause.maxDistance;
+	int		   *offsets;
+	int			maxchars = 0;
+	int			v;
+	MemoryContext oldcontext;
+
+	oldcontext = MemoryContextSwitchTo(sjstate->cxt);
+
+	sjstate->nsegments = 0;
+	for (v = 0; v < inner->nvalues; v++)
+	{
+		if (inner->chars[v] > k)
+			sjstate->nsegments += k + 1;
+		maxchars = Max(maxchars, inner->chars[v]);
+	}
+	sjstate->segments = palloc(Max(sjstate->nsegments, 1) *
+							   sizeof(PassJoinSegment));
+	sjstate->probeStamp = palloc(Max(inner->nvalues, 1) * sizeof(int));
+	offsets = palloc((maxchars + 1) * sizeof(int));
+
+	sjstate->nsegments = 0;
+	for (v = 0; v < inner->nvalues; v++)
+	{
+		const char *str = inner->values[v];
+		int			chars = inner->chars[v];
+		int			c;
+		int			segno;
+
+		sjstate->probeStamp[v] = -1;
+		if (chars <= k)
+			continue;
+
+		/* byte offset of each character */
+		offsets[0] = 0;
+		for (c = 0; c < chars; c++)
+			offsets[c + 1] = offsets[c] + pg_mblen(str + offsets[c]);
+
+		for (segno = 0; segno <= k; segno++)
+		{
+			PassJoinSegment *seg = &sjstate->segments[sjstate->nsegments++];
+			int			start;
+			int			seglen;
+
+			passjoin_segment(chars, k, segno, &start, &seglen);
+			seg->hash = passjoin_hash(chars, segno, str + offsets[start],
+									  offsets[start + seglen] - offsets[start]);
+			seg->value = v;
+		}
+	}
+	pfree(offsets);
+
+	qsort(sjstate->segments, sjstate->nsegments, sizeof(PassJoinSegment),
+		  compare_segments);
+
+	MemoryContextSwitchTo(oldcontext);
+}
+
+/*
+ * The even partition of a key of len characters into k + 1 segments: the
+ * last len % (k + 1) segments are one character longer than the others.
+ */
+static void
+passjoin_segment(int len, int k, int segno, int *start, int *seglen)
+{
+	int			base = len / (k + 1);
+	int			nshort = k + 1 - len % (k + 1);
+
+	*start = segno * base + Max(0, segno - nshort);
+	*seglen = (segno < nshort) ? base : base + 1;
+}
+
+static uint32
+passjoin_hash(int len, int segno, const char *str, int bytes)
+{
+	uint32		h = DatumGetUInt32(hash_any((const unsigned char *) str,
+											bytes));
+
+	return hash_combine(h, hash_uint32((uint32) len * 1024 + (uint32) segno));
+}
+
+/* floor(n / 2), also for negative n */
+static inline int
+floor_half(int n)
+{
+	return (n >= 0) ? n / 2 : -((1 - n) / 2);
+}
+
+static int
+compare_segments(const void *a, const void *b)
+{
+	const PassJoinSegment *sa = (const PassJoinSegment *) a;
+	const PassJoinSegment *sb = (const PassJoinSegment *) b;
+
+	if (sa->hash != sb->hash)
+		return sa->hash < sb->hash ? -1 : 1;
+	return sa->value < sb->value ? -1 : (sa->value > sb->value ? 1 : 0);
+}
+
+/*
+ * passjoin_probe
+ *		Add to the candidates every inner key that has a segment occurring in
+ *		the current outer key (len characters, at the given byte offsets) at
+ *		a position compatible with distance k.
+ *
+ * If segment i of an inner key of length l starts at p, and the outer key
+ * matches it shifted by d, then the prefixes before it cost at least |d|
+ * edits and the suffixes after it at least |len - l - d|, which bounds d.
+ * When the outer key is not shorter, we may also assume that segment i is
+ * the first unchanged one, so the i segments before it hold an edit each
+ * (the multi-match-aware window of PassJoin).
+ */
+static void
+passjoin_probe(SimilarityJoinState *sjstate, const int *offsets, int chars,
+			   int len)
+{
+	const char *str = sjstate->source.str;
+	int			k = sjstate->clause.maxDistance;
+	int			l;
+
+	for (l = Max(len - k, k + 1); l <= len + k; l++)
+	{
+		int			delta = len - l;
+		int			segno;
+
+		for (segno = 0; segno <= k; segno++)
+		{
+			int			start;
+			int			seglen;
+			int			lo;
+			int			hi;
+			int			pos;
+
+			passjoin_segment(l, k, segno, &start, &seglen);
+
+			/* |d| + |delta - d| <= k, i.e. ceil((delta - k) / 2) <= d */
+			lo = start - floor_half(k - delta);
+			hi = start + floor_half(delta + k);
+			if (delta >= 0)
+			{
+				lo = Max(lo, Max(start - segno, start + delta - (k - segno)));
+				hi = Min(hi, Min(start + segno, start + delta + (k - segno)));
+			}
+			lo = Max(lo, 0);
+			hi = Min(hi, chars - seglen);
+
+			for (pos = lo; pos <= hi; pos++)
+			{
+				uint32		hash;
+
+				hash = passjoin_hash(l, segno, str + offsets[pos],
+									 offsets[pos + seglen] - offsets[pos]);
+				add_candidates(sjstate, hash, l, l);
+			}
+		}
+	}
+}
+
+/*
+ * add_candidates
+ *		Add to the candidates every inner key of minchars .. maxchars
+ *		characters that has an index entry with the given hash, unless it
+ *		is a candidate for the current outer key already.
+ */
+static void
+add_candidates(SimilarityJoinState *sjstate, uint32 hash, int minchars,
+			   int maxchars)
+{
+	SimilarityDictionary *inner = &sjstate->inner;
+	int			a = 0;
+	int			b = sjstate->nsegments;
+
+	/* find the first index entry with this hash */
+	while (a < b)
+	{
+		int			mid = a + (b - a) / 2;
+
+		if (sjstate->segments[mid].hash < hash)
+			a = mid + 1;
+		else
+			b = mid;
+	}
+	for (; a < sjstate->nsegments && sjstate->segments[a].hash == hash; a++)
+	{
+		int			v = sjstate->segments[a].value;
+
+		if (inner->chars[v] >= minchars && inner->chars[v] <= maxchars &&
+			sjstate->probeStamp[v] != sjstate->outerPos)
+		{
+			sjstate->probeStamp[v] = sjstate->outerPos;
+			sjstate->candidates[sjstate->ncandidates++] = v;
+		}
+	}
+}
+
+/*
+ * build_lsh_index
+ *		Compute the bigram sets and MinHash signatures of all inner keys and
+ *		index every band of each signature.
+ */
+static void
+build_lsh_index(SimilarityJoinState *sjstate)
+{
+	SimilarityDictionary *inner = &sjstate->inner;
+	SimilarityDictionary *outer = &sjstate->outer;
+	uint32		minhashes[SIMJOIN_LSH_HASHES];
+	int			ngrams = 0;
+	int			maxchars = 0;
+	int			v;
+	int			band;
+	MemoryContext oldcontext;
+
+	oldcontext = MemoryContextSwitchTo(sjstate->cxt);
+
+	/* a key has at most as many distinct bigrams as characters */
+	for (v = 0; v < inner->nvalues; v++)
+		ngrams += inner->chars[v];
+	for (v = 0; v < outer->nvalues; v++)
+		maxchars = Max(maxchars, outer->chars[v]);
+
+	sjstate->innerGramStart = palloc((inner->nvalues + 1) * sizeof(int));
+	sjstate->innerGrams = palloc(Max(ngrams, 1) * sizeof(uint32));
+	sjstate->outerGrams = palloc(Max(maxchars, 1) * sizeof(uint32));
+	sjstate->probeStamp = palloc(Max(inner->nvalues, 1) * sizeof(int));
+	sjstate->nsegments = inner->nvalues * SIMJOIN_LSH_BANDS;
+	sjstate->segments = palloc(Max(sjstate->nsegments, 1) *
+							   sizeof(PassJoinSegment));
+
+	ngrams = 0;
+	for (v = 0; v < inner->nvalues; v++)
+	{
+		int			n;
+
+		sjstate->probeStamp[v] = -1;
+		sjstate->innerGramStart[v] = ngrams;
+		n = lsh_grams(inner->values[v], inner->bytes[v],
+					  sjstate->innerGrams + ngrams);
+		lsh_signature(sjstate->innerGrams + ngrams, n, minhashes);
+		ngrams += n;
+
+		for (band = 0; band < SIMJOIN_LSH_BANDS; band++)
+		{
+			PassJoinSegment *entry =
+			&sjstate->segments[v * SIMJOIN_LSH_BANDS + band];
+
+			entry->hash = lsh_band_hash(minhashes, band);
+			entry->value = v;
+		}
+	}
+	sjstate->innerGramStart[inner->nvalues] = ngrams;
+
+	qsort(sjstate->segments, sjstate->nsegments, sizeof(PassJoinSegment),
+		  compare_segments);
+
+	MemoryContextSwitchTo(oldcontext);
+}
+
+/*
+ * lsh_grams
+ *		Store the hashes of the distinct character bigrams of a key in
+ *		grams, in ascending order, and return their number.  A key of a
+ *		single character is its own gram.
+ */
+static int
+lsh_grams(const char *str, int bytes, uint32 *grams)
+{
+	int			ngrams = 0;
+	int			prev = 0;
+	int			pos = 0;
+	int			i;
+	int			n;
+
+	if (bytes == 0)
+		return 0;
+
+	pos = pg_mblen(str);
+	if (pos >= bytes)
+		grams[ngrams++] = DatumGetUInt32(hash_any((const unsigned char *) str,
+												  bytes));
+	while (pos < bytes)
+	{
+		int			next = pos + pg_mblen(str + pos);
+
+		grams[ngrams++] =
+			DatumGetUInt32(hash_any((const unsigned char *) str + prev,
+									next - prev));
+		prev = pos;
+		pos = next;
+	}
+
+	qsort(grams, ngrams, sizeof(uint32), compare_grams);
+	for (i = n = 0; i < ngrams; i++)
+	{
+		if (n == 0 || grams[n - 1] != grams[i])
+			grams[n++] = grams[i];
+	}
+	return n;
+}
+
+static int
+compare_grams(const void *a, const void *b)
+{
+	uint32		ga = *(const uint32 *) a;
+	uint32		gb = *(const uint32 *) b;
+
+	return ga < gb ? -1 : (ga > gb ? 1 : 0);
+}
+
+/*
+ * lsh_signature
+ *		The MinHash signature of a gram set: for each of the hash functions,
+ *		the least hash value over the grams.  The functions are the gram
+ *		hash mixed with a different seed each.
+ */
+static void
+lsh_signature(const uint32 *grams, int ngrams, uint32 *minhashes)
+{
+	int			h;
+	int			i;
+
+	for (h = 0; h < SIMJOIN_LSH_HASHES; h++)
+	{
+		uint32		seed = (uint32) (h + 1) * 0x9e3779b9;
+		uint32		min = PG_UINT32_MAX;
+
+		for (i = 0; i < ngrams; i++)
+		{
+			uint32		value = DatumGetUInt32(hash_uint32(grams[i] ^ seed));
+
+			min = Min(min, value);
+		}
+		minhashes[h] = min;
+	}
+}
+
+static uint32
+lsh_band_hash(const uint32 *minhashes, int band)
+{
+	uint32		h;
+
+	h = DatumGetUInt32(hash_any((const unsigned char *)
+								(minhashes + band * SIMJOIN_LSH_ROWS),
+								SIMJOIN_LSH_ROWS * sizeof(uint32)));
+	return hash_combine(h, hash_uint32((uint32) band));
+}
+
+/*
+ * lsh_candidate_probability
+ *		The probability that LSH proposes a pair with the given gram sets,
+ *		1 - (1 - J^r)^b with J their Jaccard similarity.
+ */
+static double
+lsh_candidate_probability(const uint32 *a, int na, const uint32 *b, int nb)
+{
+	int			common = 0;
+	int			i = 0;
+	int			j = 0;
+	double		jaccard;
+
+	while (i < na && j < nb)
+	{
+		if (a[i] < b[j])
+			i++;
+		else if (a[i] > b[j])
+			j++;
+		else
+		{
+			common++;
+			i++;
+			j++;
+		}
+	}
+
+	/* two empty keys have identical signatures */
+	jaccard = (na + nb > 0) ? (double) common / (na + nb - common) : 1.0;
+
+	return 1.0 - pow(1.0 - pow(jaccard, SIMJOIN_LSH_ROWS), SIMJOIN_LSH_BANDS);
+}
+
+/*
+ * init_blocking_functions
+ *		Look up the functions named by keys, the value that
+ *		similarity_join_blocking_keys had when the plan was made.
+ */
+static void
+init_blocking_functions(SimilarityJoinState *sjstate, const char *keys)
+{
+	char	   *rawnames = pstrdup(keys);
+	List	   *names;
+	ListCell   *lc;
+	int			f = 0;
+
+	if (!SplitIdentifierString(rawnames, ',', &names))
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("invalid list syntax in parameter \"%s\"",
+						"similarity_join_blocking_keys")));
+
+	sjstate->blockingKeys = pstrdup(keys);
+	sjstate->nblockingFuncs = list_length(names);
+	sjstate->blockingFuncs = palloc(sjstate->nblockingFuncs * sizeof(FmgrInfo));
+	foreach(lc, names)
+	{
+		List	   *funcname = stringToQualifiedNameList((char *) lfirst(lc));
+		Oid			argtype = TEXTOID;
+		Oid			funcid;
+		AclResult	aclresult;
+
+		funcid = LookupFuncName(funcname, 1, &argtype, false);
+		if (get_func_rettype(funcid) != TEXTOID)
+			ereport(ERROR,
+					(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+					 errmsg("blocking key function %s must return type %s",
+							NameListToString(funcname), "text")));
+		aclresult = pg_proc_aclcheck(funcid, GetUserId(), ACL_EXECUTE);
+		if (aclresult != ACLCHECK_OK)
+			aclcheck_error(aclresult, OBJECT_FUNCTION, get_func_name(funcid));
+		fmgr_info(funcid, &sjstate->blockingFuncs[f++]);
+	}
+}
+
+/*
+ * build_blocking_index
+ *		Index all inner keys by their blocking keys, compute the blocking
+ *		keys of the outer keys, and order the outer keys by block.
+ */
+static void
+build_blocking_index(SimilarityJoinState *sjstate)
+{
+	SimilarityDictionary *inner = &sjstate->inner;
+	SimilarityDictionary *outer = &sjstate->outer;
+	int			nfuncs = sjstate->nblockingFuncs;
+	MemoryContext keycxt;
+	MemoryContext oldcontext;
+	int			v;
+	int			f;
+	int			i;
+
+	keycxt = AllocSetContextCreate(CurrentMemoryContext,
+								   "SimilarityJoin blocking keys",
+								   ALLOCSET_DEFAULT_SIZES);
+	oldcontext = MemoryContextSwitchTo(sjstate->cxt);
+
+	sjstate->probeStamp = palloc(Max(inner->nvalues, 1) * sizeof(int));
+	sjstate->nsegments = inner->nvalues * nfuncs;
+	sjstate->segments = palloc(Max(sjstate->nsegments, 1) *
+							   sizeof(PassJoinSegment));
+	sjstate->outerBlocks = palloc(Max(outer->nvalues * nfuncs, 1) *
+								  sizeof(uint32));
+
+	MemoryContextSwitchTo(keycxt);
+	for (v = 0; v < inner->nvalues; v++)
+	{
+		sjstate->probeStamp[v] = -1;
+		for (f = 0; f < nfuncs; f++)
+		{
+			PassJoinSegment *entry = &sjstate->segments[v * nfuncs + f];
+
+			entry->hash = blocking_key_hash(&sjstate->blockingFuncs[f],
+											sjstate->clause.collation,
+											inner->values[v],
+											inner->bytes[v]);
+			entry->value = v;
+			MemoryContextReset(keycxt);
+		}
+		CHECK_FOR_INTERRUPTS();
+	}
+	for (v = 0; v < outer->nvalues; v++)
+	{
+		for (f = 0; f < nfuncs; f++)
+		{
+			sjstate->outerBlocks[v * nfuncs + f] =
+				blocking_key_hash(&sjstate->blockingFuncs[f],
+								  sjstate->clause.collation,
+								  outer->values[v], outer->bytes[v]);
+			MemoryContextReset(keycxt);
+		}
+		CHECK_FOR_INTERRUPTS();
+	}
+	MemoryContextSwitchTo(sjstate->cxt);
+	MemoryContextDelete(keycxt);
+
+	qsort(sjstate->segments, sjstate->nsegments, sizeof(PassJoinSegment),
+		  compare_segments);
+	sjstate->nblocks = 0;
+	for (i = 0; i < sjstate->nsegments; i++)
+	{
+		if (i == 0 || sjstate->segments[i].hash != sjstate->segments[i - 1].hash)
+			sjstate->nblocks++;
+	}
+
+	sjstate->sampleInterval = Max(1, outer->nvalues / SIMJOIN_BLOCKING_SAMPLES);
+
+	/* stream the results block by block */
+	qsort_arg(sjstate->outerOrder, outer->nvalues, sizeof(int),
+			  compare_block, sjstate);
+
+	MemoryContextSwitchTo(oldcontext);
+}
+
+/*
+ * The hash of a key's blocking key.  Keys of different functions are not
+ * told apart, so that, say, a primary and an alternate code can match.  A
+ * null blocking key is treated as an empty one.  The function is called with
+ * the collation that the join clause compares the keys in.
+ */
+static uint32
+blocking_key_hash(FmgrInfo *flinfo, Oid collation, const char *str, int bytes)
+{
+	FunctionCallInfoData fcinfo;
+	Datum		result;
+	text	   *code;
+
+	InitFunctionCallInfoData(fcinfo, flinfo, 1, collation, NULL, NULL);
+	fcinfo.arg[0] = PointerGetDatum(cstring_to_text_with_len(str, bytes));
+	fcinfo.argnull[0] = false;
+	result = FunctionCallInvoke(&fcinfo);
+	if (fcinfo.isnull)
+		return DatumGetUInt32(hash_any((const unsigned char *) "", 0));
+
+	code = DatumGetTextPP(result);
+	return DatumGetUInt32(hash_any((const unsigned char *) VARDATA_ANY(code),
+								   VARSIZE_ANY_EXHDR(code)));
+}
+
+/*
+ * Order outer key numbers by their first blocking key, then by descending
+ * number of rows.
+ */
+static int
+compare_block(const void *a, const void *b, void *arg)
+{
+	SimilarityJoinState *sjstate = (SimilarityJoinState *) arg;
+	uint32		ba = sjstate->outerBlocks[*(const int *) a *
+										  sjstate->nblockingFuncs];
+	uint32		bb = sjstate->outerBlocks[*(const int *) b *
+										  sjstate->nblockingFuncs];
+
+	if (ba != bb)
+		return ba < bb ? -1 : 1;
+	return compare_frequency(a, b, &sjstate->outer);
+}
+
+/*
+ * sample_blocking_recall
+ *		Compare the current outer key with all inner keys first .. last - 1,
+ *		and count how many of the row pairs of its matches are found by
+ *		blocking, i.e. are candidates already.
+ */
+static void
+sample_blocking_recall(SimilarityJoinState *sjstate, int outerValue,
+					   int first, int last)
+{
+	SimilarityDictionary *outer = &sjstate->outer;
+	SimilarityDictionary *inner = &sjstate->inner;
+	int			k = sjstate->clause.maxDistance;
+	int			outerRows = outer->firstPosting[outerValue + 1] -
+	outer->firstPosting[outerValue];
+	int			v;
+
+	for (v = first; v < last; v++)
+	{
+		double		rows;
+
+		CHECK_FOR_INTERRUPTS();
+
+		if (edit_distance_prefilter(&outer->sigs[outerValue],
+									&inner->sigs[v], k) != EDFILTER_PASS ||
+			varstr_levenshtein_less_equal_prepared(&sjstate->source,
+												   inner->values[v],
+												   inner->bytes[v],
+												   1, 1, 1, k, false) > k)
+			continue;
+
+		rows = (double) outerRows *
+			(inner->firstPosting[v + 1] - inner->firstPosting[v]);
+		sjstate->sampleRows += rows;
+		if (sjstate->probeStamp[v] == sjstate->outerPos)
+			sjstate->sampleFoundRows += rows;
+	}
+}
+
+/*
+ * Make the outer key at outerPos current: preprocess it for the distance
+ * computation and collect the inner keys it has to be compared with at
+ * distance bound, which is the clause's bound except in the tiers of a
+ * distance-ordered join.
+ */
+static void
+start_outer_key(SimilarityJoinState *sjstate, int bound)
+{
+	int			outerValue = sjstate->outerOrder[sjstate->outerPos];
+	int			chars = sjstate->outer.chars[outerValue];
+	int			k = sjstate->clause.maxDistance;
+	int			first;
+	int			last;
+	int			v;
+	MemoryContext oldcontext;
+
+	oldcontext = MemoryContextSwitchTo(sjstate->cxt);
+	varstr_levenshtein_prepare(&sjstate->source,
+							   sjstate->outer.values[outerValue],
+							   sjstate->outer.bytes[outerValue]);
+	MemoryContextSwitchTo(oldcontext);
+
+	sjstate->ncandidates = sjstate->nextCandidate = 0;
+	first = first_key_of_length(&sjstate->inner, chars - bound);
+
+	if (sjstate->useLSH)
+	{
+		uint32		minhashes[SIMJOIN_LSH_HASHES];
+		int			band;
+
+		sjstate->nouterGrams = lsh_grams(sjstate->outer.values[outerValue],
+										 sjstate->outer.bytes[outerValue],
+										 sjstate->outerGrams);
+		lsh_signature(sjstate->outerGrams, sjstate->nouterGrams, minhashes);
+		for (band = 0; band < SIMJOIN_LSH_BANDS; band++)
+			add_candidates(sjstate, lsh_band_hash(minhashes, band),
+						   chars - bound, chars + bound);
+	}
+	else if (sjstate->useBlocking)
+	{
+		int			f;
+
+		for (f = 0; f < sjstate->nblockingFuncs; f++)
+			add_candidates(sjstate,
+						   sjstate->outerBlocks[outerValue *
+												sjstate->nblockingFuncs + f],
+						   chars - bound, chars + bound);
+		/*
+		 * A distance-ordered join samples in its last tier only, whose
+		 * length window is as wide as the clause's.
+		 */
+		if ((sjstate->tier == 0 || sjstate->tier == sjstate->maxTier) &&
+			sjstate->outerPos % sjstate->sampleInterval == 0)
+			sample_blocking_recall(sjstate, outerValue,
+								   first_key_of_length(&sjstate->inner,
+													   chars - k),
+								   first_key_of_length(&sjstate->inner,
+													   chars + k + 1));
+	}
+	else if (!sjstate->usePassJoin)
+	{
+		last = first_key_of_length(&sjstate->inner, chars + bound + 1);
+		for (v = first; v < last; v++)
+			sjstate->candidates[sjstate->ncandidates++] = v;
+	}
+	else
+	{
+		int		   *offsets = sjstate->source.rows;
+		int			c;
+
+		/*
+		 * Keys too short to be partitioned are always candidates.  The
+		 * segments are cut for the clause's bound, which finds the pairs
+		 * within any smaller bound as well.
+		 */
+		last = first_key_of_length(&sjstate->inner,
+								   Min(k + 1, chars + bound + 1));
+		for (v = first; v < last; v++)
+			sjstate->candidates[sjstate->ncandidates++] = v;
+
+		/*
+		 * Character offsets of the outer key; the distance computation's
+		 * work rows are free at this point and large enough.
+		 */
+		offsets[0] = 0;
+		for (c = 0; c < chars; c++)
+			offsets[c + 1] = offsets[c] + sjstate->source.char_len[c];
+		passjoin_probe(sjstate, offsets, chars, chars);
+	}
+}
+
+/*
+ * Distance between the current outer key and inner key innerValue, or some
+ * value above bound if it is farther.  Matches are counted once, in the
+ * tier of their distance.
+ */
+static int
+key_pair_distance(SimilarityJoinState *sjstate, int outerValue, int innerValue,
+				  int bound)
+{
+	SimilarityDictionary *inner = &sjstate->inner;
+	int			distance;
+
+	CHECK_FOR_INTERRUPTS();
+
+	sjstate->candidatePairs++;
+	if (enable_levenshteinfilter &&
+		edit_distance_prefilter(&sjstate->outer.sigs[outerValue],
+								&inner->sigs[innerValue], bound) != EDFILTER_PASS)
+	{
+		sjstate->prefilterRejects++;
+		return bound + 1;
+	}
+
+	sjstate->distanceCalls++;
+	distance = varstr_levenshtein_less_equal_prepared(&sjstate->source,
+													  inner->values[innerValue],
+													  inner->bytes[innerValue],
+													  1, 1, 1, bound, false);
+	if (distance > bound || distance < sjstate->tier)
+		return distance;
+
+	sjstate->matchedPairs++;
+
+	if (sjstate->useLSH)
+	{
+		SimilarityDictionary *outer = &sjstate->outer;
+		double		rows;
+		double		p;
+
+		rows = (double) (outer->firstPosting[outerValue + 1] -
+						 outer->firstPosting[outerValue]) *
+			(inner->firstPosting[innerValue + 1] -
+			 inner->firstPosting[innerValue]);
+		p = lsh_candidate_probability(sjstate->outerGrams,
+									  sjstate->nouterGrams,
+									  sjstate->innerGrams +
+									  sjstate->innerGramStart[innerValue],
+									  sjstate->innerGramStart[innerValue + 1] -
+									  sjstate->innerGramStart[innerValue]);
+		sjstate->lshFoundRows += rows;
+		sjstate->lshEstimatedRows += rows / Max(p, 1e-6);
+	}
+	return distance;
+}
+
+/*
+ * Start returning the row pairs of a matching key pair.
+ */
+static void
+start_key_pair(SimilarityJoinState *sjstate, int outerValue, int innerValue)
+{
+	sjstate->outerValue = outerValue;
+	sjstate->innerValue = innerValue;
+	sjstate->outerPosting = sjstate->outer.firstPosting[outerValue];
+	sjstate->innerPosting = sjstate->inner.firstPosting[innerValue];
+	sjstate->expanding = true;
+}
+
+/*
+ * Start the next matching key pair of a distance-ordered join, or return
+ * false if there is none left.
+ *
+ * Identical keys are found by looking each outer key up among the inner
+ * keys, so the pairs at distance 0 come out right after the inputs are
+ * read.  Only then are the other candidate pairs compared, one tier at a
+ * time: tier d compares them with bound d and returns the pairs at exactly
+ * distance d, before any pair is compared for tier d + 1.
+ */
+static bool
+next_ordered_key_pair(SimilarityJoinState *sjstate)
+{
+	SimilarityDictionary *outer = &sjstate->outer;
+
+	while (sjstate->tier == 0)
+	{
+		int			outerValue;
+		int			innerValue;
+
+		CHECK_FOR_INTERRUPTS();
+
+		if (sjstate->outerPos + 1 >= outer->nvalues)
+		{
+			start_tier(sjstate);
+			break;
+		}
+
+		outerValue = sjstate->outerOrder[++sjstate->outerPos];
+		innerValue = find_key(&sjstate->inner, outer->values[outerValue],
+							  outer->bytes[outerValue],
+							  outer->chars[outerValue]);
+		if (innerValue >= 0)
+		{
+			sjstate->exactPairs++;
+			start_key_pair(sjstate, outerValue, innerValue);
+			return true;
+		}
+	}
+
+	while (sjstate->tier <= sjstate->maxTier)
+	{
+		if (sjstate->nextCandidate < sjstate->ncandidates)
+		{
+			int			outerValue = sjstate->outerOrder[sjstate->outerPos];
+			int			innerValue =
+			sjstate->candidates[sjstate->nextCandidate++];
+
+			if (key_pair_distance(sjstate, outerValue, innerValue,
+								  sjstate->tier) == sjstate->tier)
+			{
+				sjstate->tierPairs[sjstate->tier]++;
+				start_key_pair(sjstate, outerValue, innerValue);
+				return true;
+			}
+			continue;
+		}
+
+		if (sjstate->outerPos + 1 < outer->nvalues)
+		{
+			sjstate->outerPos++;
+			start_outer_key(sjstate, sjstate->tier);
+		}
+		else
+			start_tier(sjstate);
+	}
+	return false;
+}
+
+/*
+ * Move a distance-ordered join on to its next tier, restarting the scan over
+ * the outer keys.  The first call, at the end of the exact lookups, also
+ * works out the last tier worth scanning: no two keys are farther apart than
+ * the longer of them.
+ */
+static void
+start_tier(SimilarityJoinState *sjstate)
+{
+	SimilarityDictionary *outer = &sjstate->outer;
+	SimilarityDictionary *inner = &sjstate->inner;
+	int			v;
+
+	if (sjstate->tier == 0)
+	{
+		int			longest = 0;
+
+		if (outer->nvalues > 0)
+			longest = outer->chars[outer->nvalues - 1];
+		if (inner->nvalues > 0)
+			longest = Max(longest, inner->chars[inner->nvalues - 1]);
+		sjstate->maxTier = Min(sjstate->clause.maxDistance, longest);
+		sjstate->tierPairs =
+			MemoryContextAllocZero(sjstate->cxt,
+								   (Max(sjstate->maxTier, 0) + 1) *
+								   sizeof(long));
+	}
+
+	sjstate->tier++;
+	sjstate->outerPos = -1;
+	sjstate->ncandidates = sjstate->nextCandidate = 0;
+
+	/* candidates are deduplicated by outerPos, which starts over */
+	if (sjstate->probeStamp != NULL)
+	{
+		for (v = 0; v < inner->nvalues; v++)
+			sjstate->probeStamp[v] = -1;
+	}
+}
+
+/*
+ * Key number of value in dict, or -1 if it is not there.
+ */
+static int
+find_key(const SimilarityDictionary *dict, const char *value, int bytes,
+		 int chars)
+{
+	int			lo = first_key_of_length(dict, chars);
+	int			hi = first_key_of_length(dict, chars + 1);
+
+	/* keys of one length are ordered by byte length, then bytewise */
+	while (lo < hi)
+	{
+		int			mid = lo + (hi - lo) / 2;
+		int			cmp;
+
+		if (dict->bytes[mid] != bytes)
+			cmp = dict->bytes[mid] < bytes ? -1 : 1;
+		else
+			cmp = memcmp(dict->values[mid], value, bytes);
+
+		if (cmp == 0)
+			return mid;
+		if (cmp < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return -1;
+}
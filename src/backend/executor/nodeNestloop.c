@@ -21,13 +21,29 @@
 
 #include "postgres.h"
 
+#include <float.h>
 #include <math.h>
 
+#include "access/hash.h"
+#include "catalog/pg_statistic_ext.h"
 #include "executor/execdebug.h"
 #include "executor/nodeNestloop.h"
+#include "executor/simjoin.h"
+#include "mb/pg_wchar.h"
 #include "miscadmin.h"
+#include "nodes/nodeFuncs.h"
+#include "optimizer/cost.h"
+#include "optimizer/editdist.h"
+#include "optimizer/plancat.h"
+#include "parser/parsetree.h"
+#include "statistics/statistics.h"
+#include "utils/lsyscache.h"
 #include "utils/memutils.h"
 #include "utils/guc.h"
+#include "utils/rel.h"
+#include "utils/relcache.h"
+#include "utils/syscache.h"
+#include "utils/typcache.h"
 
 
 /* ----------------------------------------------------------------
@@ -61,12 +77,41 @@
  */
 
 #define MAX(a,b) ((a) > (b) ? (a) : (b))
+/* initial length of joinedBlocks; it grows on demand */
+#define MAX_INITIAL_OUTER_PAGES 1024
+/* explored pages scored before the active set limit adapts to them */
+#define ACTIVE_SET_MIN_SCORES 4
+/* ... and how far it may grow past sqrt(inner pages) */
+#define ACTIVE_SET_MAX_GROWTH 4.0
+/* blocks, and pages of each input, sampled before a bandit join's arms are chosen */
+#define BANDIT_WARMUP_MIN_BLOCKS 64
+#define BANDIT_WARMUP_MIN_PAGES 4
+/* ... and how much more skewed the other input must be to flip to it */
+#define BANDIT_FLIP_MARGIN 1.25
+/* scored pages, and their scores' largest coefficient of variation, for a
+ * bandit join to hand over to a block nested loop */
+#define BANDIT_BLOCK_MIN_SCORES 16
+#define BANDIT_BLOCK_MAX_CV 0.25
+/* seed of the exploration sample when bandit_explore_seed is 0 */
+#define BANDIT_SAMPLE_SEED 0x9e3779b9
+/* arm pages a sketched block may span and still inform the sketch prior */
+#define BANDIT_SKETCH_MAX_SPAN 8
+
+/* An arm page's share of the rows of a sketched block, and their yield */
+typedef struct SketchPageShare {
+	int page;
+	double rows;
+	double yield; /* predicted rows per arm row */
+} SketchPageShare;
+
+static TupleTableSlot* ExecBanditJoin(PlanState *pstate);
 
 static RelationPage* CreateRelationPage() {
 	int i;
 	RelationPage* relationPage = palloc(sizeof(RelationPage));
 	relationPage->index = 0;
 	relationPage->tupleCount = 0;
+	relationPage->signatures = NULL;
 	for (i = 0; i < PAGE_SIZE; i++){
 		relationPage->tuples[i] = NULL;
 	}
@@ -86,116 +131,1868 @@ static void RemoveRelationPage(RelationPage** relationPageAdr) {
 			relationPage->tuples[i] = NULL;
 		}
 	}
+	if (relationPage->signatures != NULL) {
+		pfree(relationPage->signatures);
+	}
 	pfree(relationPage);
 	(*relationPageAdr) = NULL;
 }
 
+/*
+ * Find which input an operand of the edit-distance clause reads: *side ends
+ * up as OUTER_VAR or INNER_VAR, 0 if no Vars at all, or -1 if mixed.
+ */
+static bool operand_side_walker(Node *node, int *side) {
+	if (node == NULL) {
+		return false;
+	}
+	if (IsA(node, Var)) {
+		int varno = ((Var *) node)->varno;
+		if ((varno != OUTER_VAR && varno != INNER_VAR) ||
+				(*side != 0 && *side != varno)) {
+			*side = -1;
+			return true;
+		}
+		*side = varno;
+		return false;
+	}
+	return expression_tree_walker(node, operand_side_walker, (void *) side);
+}
+
+/*
+ * Find a join qual that is a levenshtein() threshold whose operands come
+ * from different sides of the join.  Returns the qual, or NULL if there is
+ * none; *edc and *outerArgno describe it.
+ */
+static Node* FindEditDistanceJoinClause(NestLoop *node, EditDistanceClause *edc, int *outerArgno) {
+	ListCell *lc;
+
+	foreach(lc, node->join.joinqual) {
+		int side0 = 0;
+		int side1 = 0;
+
+		if (!match_edit_distance_clause((Node *) lfirst(lc), edc)) {
+			continue;
+		}
+		operand_side_walker((Node *) edc->args[0].expr, &side0);
+		operand_side_walker((Node *) edc->args[1].expr, &side1);
+		if (side0 == OUTER_VAR && side1 == INNER_VAR) {
+			*outerArgno = 0;
+			return (Node *) lfirst(lc);
+		} else if (side0 == INNER_VAR && side1 == OUTER_VAR) {
+			*outerArgno = 1;
+			return (Node *) lfirst(lc);
+		}
+	}
+	return NULL;
+}
+
+/*
+ * Set up prefiltering if the join quals contain an edit-distance join
+ * clause.  The filter only tests necessary conditions of that conjunct, so
+ * a rejected pair is simply a pair that fails the join quals.
+ */
+static EditDistanceFilter* InitEditDistanceFilter(NestLoopState *nlstate, NestLoop *node) {
+	EditDistanceClause edc;
+	EditDistanceFilter *filter;
+	int outerArgno;
+
+	if (!enable_levenshteinfilter ||
+			FindEditDistanceJoinClause(node, &edc, &outerArgno) == NULL) {
+		return NULL;
+	}
+	filter = palloc0(sizeof(EditDistanceFilter));
+	filter->clause = palloc(sizeof(EditDistanceClause));
+	memcpy(filter->clause, &edc, sizeof(EditDistanceClause));
+	filter->outerArgno = outerArgno;
+	filter->outerOperand = ExecInitExpr(edc.args[outerArgno].expr, (PlanState *) nlstate);
+	filter->innerOperand = ExecInitExpr(edc.args[1 - outerArgno].expr, (PlanState *) nlstate);
+	return filter;
+}
+
+/*
+ * Use the distinct-key similarity join (execSimjoin.c) if the planner chose
+ * it for this node (simJoinStrategy) and it is applicable: an inner join,
+ * with an edit-distance join clause, whose inner side does not depend on
+ * the outer tuple.  The planner picks the strategy from enable_dedupjoin,
+ * enable_passjoin, enable_lshjoin and similarity_join_blocking_keys and
+ * costs the join accordingly (see final_cost_nestloop), so changing those
+ * settings does not affect a plan that has already been made.
+ */
+static SimilarityJoinState* InitSimilarityJoin(NestLoopState *nlstate, NestLoop *node) {
+	EditDistanceClause edc;
+	Node *clause;
+	int outerArgno;
+
+	if (node->simJoinStrategy == SIMJOIN_NONE ||
+			node->join.jointype != JOIN_INNER ||
+			node->nestParams != NIL) {
+		return NULL;
+	}
+	clause = FindEditDistanceJoinClause(node, &edc, &outerArgno);
+	if (clause == NULL) {
+		return NULL;
+	}
+	return ExecInitSimilarityJoin(nlstate, clause, &edc, outerArgno);
+}
+
+/*
+ * Bucket the inner side by join key length if the kernels page through an
+ * inner side that does not depend on the outer tuple.  With the inputs
+ * flipped the kernels page the outer plan as their inner side, so bucketing
+ * is not used then.
+ */
+static LengthBucketedInner* InitLengthBuckets(NestLoopState *nlstate, NestLoop *node) {
+	EditDistanceClause edc;
+	LengthBucketedInner *buckets;
+	const char *fliporder;
+	int outerArgno;
+
+	fliporder = GetConfigOption("enable_fliporder", false, false);
+	if (!enable_lengthbuckets || strcmp(fliporder, "on") == 0 ||
+			node->join.jointype != JOIN_INNER ||
+			node->nestParams != NIL ||
+			FindEditDistanceJoinClause(node, &edc, &outerArgno) == NULL) {
+		return NULL;
+	}
+	buckets = palloc0(sizeof(LengthBucketedInner));
+	buckets->clause = palloc(sizeof(EditDistanceClause));
+	memcpy(buckets->clause, &edc, sizeof(EditDistanceClause));
+	buckets->outerArgno = outerArgno;
+	buckets->outerOperand = ExecInitExpr(edc.args[outerArgno].expr, (PlanState *) nlstate);
+	buckets->innerOperand = ExecInitExpr(edc.args[1 - outerArgno].expr, (PlanState *) nlstate);
+	buckets->cxt = AllocSetContextCreate(CurrentMemoryContext,
+			"NestLoop length buckets",
+			ALLOCSET_DEFAULT_SIZES);
+	buckets->orderByYield = enable_innerpageorder;
+	return buckets;
+}
+
+/*
+ * Character length of the normalised join key of a tuple, or -1 if the key
+ * is null.
+ */
+static int JoinKeyLength(NestLoopState *node, TupleTableSlot *slot, bool outerSide) {
+	LengthBucketedInner *buckets = node->lengthBuckets;
+	ExprContext *econtext = node->js.ps.ps_ExprContext;
+	MemoryContext oldContext;
+	EditDistanceOperand *operand;
+	ExprState *operandState;
+	Datum value;
+	bool isnull;
+	int length = -1;
+
+	if (outerSide) {
+		econtext->ecxt_outertuple = slot;
+		operandState = buckets->outerOperand;
+		operand = &buckets->clause->args[buckets->outerArgno];
+	} else {
+		econtext->ecxt_innertuple = slot;
+		operandState = buckets->innerOperand;
+		operand = &buckets->clause->args[1 - buckets->outerArgno];
+	}
+	oldContext = MemoryContextSwitchTo(econtext->ecxt_per_tuple_memory);
+	value = ExecEvalExpr(operandState, econtext, &isnull);
+	if (!isnull) {
+		const char *str;
+		int len;
+
+		str = edit_distance_normalize(operand, value, &len);
+		length = pg_mbstrlen_with_len(str, len);
+	}
+	MemoryContextSwitchTo(oldContext);
+	ResetExprContext(econtext);
+	return length;
+}
+
+typedef struct BucketedTuple {
+	int length;
+	int seq; /* input position, to keep the sort stable */
+	MinimalTuple tuple;
+} BucketedTuple;
+
+static int CompareBucketedTuples(const void *a, const void *b) {
+	const BucketedTuple *ta = (const BucketedTuple *) a;
+	const BucketedTuple *tb = (const BucketedTuple *) b;
+
+	if (ta->length != tb->length) {
+		return (ta->length < tb->length) ? -1 : 1;
+	}
+	return (ta->seq < tb->seq) ? -1 : (ta->seq > tb->seq);
+}
+
+/*
+ * Read the whole inner side, sort it by key length and record the range of
+ * lengths on each page.  If the inner side does not fit in work_mem, the
+ * buckets are dropped and the inner plan is rescanned, so that the kernels
+ * page through it unbucketed; returns false then.
+ */
+static bool BuildLengthBuckets(NestLoopState *node) {
+	LengthBucketedInner *buckets = node->lengthBuckets;
+	PlanState *innerPlan = innerPlanState(node);
+	BucketedTuple *entries;
+	int allocated = 1024;
+	long allowedSpace = work_mem * 1024L;
+	long usedSpace;
+	int n = 0;
+	int i;
+
+	/* the inner plan must not allocate its own state in buckets->cxt */
+	entries = MemoryContextAlloc(buckets->cxt, allocated * sizeof(BucketedTuple));
+	usedSpace = allocated * sizeof(BucketedTuple);
+	for (;;) {
+		TupleTableSlot *slot = ExecProcNode(innerPlan);
+		MemoryContext oldContext;
+
+		if (TupIsNull(slot)) {
+			break;
+		}
+		if (n == allocated) {
+			usedSpace += allocated * sizeof(BucketedTuple);
+			allocated *= 2;
+			entries = repalloc_huge(entries, allocated * sizeof(BucketedTuple));
+		}
+		entries[n].length = JoinKeyLength(node, slot, false);
+		entries[n].seq = n;
+		oldContext = MemoryContextSwitchTo(buckets->cxt);
+		entries[n].tuple = ExecCopySlotMinimalTuple(slot);
+		MemoryContextSwitchTo(oldContext);
+		usedSpace += GetMemoryChunkSpace(entries[n].tuple);
+		n++;
+		if (usedSpace > allowedSpace) {
+			MemoryContextDelete(buckets->cxt);
+			pfree(buckets->clause);
+			pfree(buckets);
+			node->lengthBuckets = NULL;
+			ExecReScan(innerPlan);
+			return false;
+		}
+	}
+	qsort(entries, n, sizeof(BucketedTuple), CompareBucketedTuples);
+
+	buckets->ntuples = n;
+	buckets->tuples = MemoryContextAllocHuge(buckets->cxt, Max(n, 1) * sizeof(MinimalTuple));
+	buckets->npages = n / PAGE_SIZE + 1;
+	buckets->pageMinLength = MemoryContextAlloc(buckets->cxt, buckets->npages * sizeof(int));
+	buckets->pageMaxLength = MemoryContextAlloc(buckets->cxt, buckets->npages * sizeof(int));
+	buckets->pageOrder = MemoryContextAlloc(buckets->cxt, buckets->npages * sizeof(int));
+	buckets->pageRows = MemoryContextAllocZero(buckets->cxt, buckets->npages * sizeof(double));
+	buckets->pageVisits = MemoryContextAllocZero(buckets->cxt, buckets->npages * sizeof(long));
+	for (i = 0; i < buckets->npages; i++) {
+		buckets->pageMinLength[i] = PG_INT32_MAX;
+		buckets->pageMaxLength[i] = -1;
+		buckets->pageOrder[i] = i;
+	}
+	for (i = 0; i < n; i++) {
+		int page = i / PAGE_SIZE;
+
+		buckets->tuples[i] = entries[i].tuple;
+		if (entries[i].length >= 0) {
+			buckets->pageMinLength[page] = Min(buckets->pageMinLength[page], entries[i].length);
+			buckets->pageMaxLength[page] = Max(buckets->pageMaxLength[page], entries[i].length);
+		}
+	}
+	pfree(entries);
+	buckets->nextPage = 0;
+	buckets->built = true;
+	return true;
+}
+
+/*
+ * Order of two inner pages by the rows they have returned per visit, highest
+ * first.  Pages not visited yet come first, and ties keep the pages in their
+ * own order.
+ */
+static int CompareInnerPageYields(const void *a, const void *b, void *arg) {
+	LengthBucketedInner *buckets = (LengthBucketedInner *) arg;
+	int pa = *(const int *) a;
+	int pb = *(const int *) b;
+	double ya = buckets->pageVisits[pa] > 0 ? buckets->pageRows[pa] / buckets->pageVisits[pa] : DBL_MAX;
+	double yb = buckets->pageVisits[pb] > 0 ? buckets->pageRows[pb] / buckets->pageVisits[pb] : DBL_MAX;
+
+	if (ya != yb) {
+		return (ya > yb) ? -1 : 1;
+	}
+	return (pa < pb) ? -1 : (pa > pb);
+}
+
+/*
+ * Order the full inner pages for the next pass by their yield so far.  The
+ * partial or empty page stays last, so that the kernels still see the end of
+ * the inner side where they expect it.
+ */
+static void OrderInnerPagesByYield(LengthBucketedInner *buckets) {
+	if (!buckets->built || !buckets->orderByYield || buckets->npages < 3) {
+		return;
+	}
+	qsort_arg(buckets->pageOrder, buckets->npages - 1, sizeof(int),
+			CompareInnerPageYields, buckets);
+	buckets->orderedPasses++;
+}
+
+/*
+ * Add the block just joined to the yield of its inner page.  Pages skipped
+ * as out of reach, and blocks joined before, were not visited.
+ */
+static void RecordInnerPageYield(NestLoopState *node) {
+	LengthBucketedInner *buckets = node->lengthBuckets;
+
+	if (buckets == NULL || buckets->loadedPageSkipped || node->blockSkipped) {
+		return;
+	}
+	buckets->pageVisits[buckets->loadedPage]++;
+	buckets->pageRows[buckets->loadedPage] += node->blockRows;
+}
+
+static int CompareInts(const void *a, const void *b) {
+	int ia = *(const int *) a;
+	int ib = *(const int *) b;
+
+	return (ia < ib) ? -1 : (ia > ib);
+}
+
+/*
+ * Record the distinct join key lengths on a freshly loaded outer page.
+ */
+static void ComputeOuterLengths(NestLoopState *node) {
+	LengthBucketedInner *buckets = node->lengthBuckets;
+	RelationPage *page = node->outerPage;
+	int n = 0;
+	int i;
+
+	if (buckets == NULL) {
+		return;
+	}
+	for (i = 0; i < page->tupleCount; i++) {
+		int length = JoinKeyLength(node, page->tuples[i], true);
+
+		if (length >= 0) {
+			buckets->outerLengths[n++] = length;
+		}
+	}
+	qsort(buckets->outerLengths, n, sizeof(int), CompareInts);
+	buckets->nOuterLengths = 0;
+	for (i = 0; i < n; i++) {
+		if (i == 0 || buckets->outerLengths[i] != buckets->outerLengths[i - 1]) {
+			buckets->outerLengths[buckets->nOuterLengths++] = buckets->outerLengths[i];
+		}
+	}
+}
+
+/*
+ * Can an inner page with the given range of key lengths hold a match for
+ * any tuple of the current outer page?
+ */
+static bool InnerPageInReach(LengthBucketedInner *buckets, int minLength, int maxLength) {
+	int maxDistance = buckets->clause->maxDistance;
+	int i;
+
+	for (i = 0; i < buckets->nOuterLengths; i++) {
+		int length = buckets->outerLengths[i];
+
+		if (length + maxDistance >= minLength && length - maxDistance <= maxLength) {
+			return true;
+		}
+	}
+	return false;
+}
+
+/*
+ * Load the next page of the length-bucketed inner side, building it first
+ * if needed.  Pages come in the same sizes LoadNextPage would produce, so
+ * the kernels detect the end of the inner side as usual.
+ *
+ * Returns false if the page is full and its lengths are out of reach of the
+ * current outer page's.  Its tuples are then not loaded, and both page
+ * positions are left as if the pair of pages had been joined without a
+ * match; the kernels' bookkeeping thus proceeds exactly as it would have.
+ */
+static bool LoadNextBucketedPage(NestLoopState *node, RelationPage *page) {
+	LengthBucketedInner *buckets = node->lengthBuckets;
+	TupleDesc tupleDesc;
+	int first;
+	int count;
+	int p;
+	int i;
+
+	p = buckets->nextPage < buckets->npages ? buckets->pageOrder[buckets->nextPage] : buckets->nextPage;
+	buckets->nextPage++;
+	first = p * PAGE_SIZE;
+	count = Max(0, Min(PAGE_SIZE, buckets->ntuples - first));
+	page->index = 0;
+	page->tupleCount = count;
+	buckets->loadedPage = p;
+	buckets->loadedPageSkipped = false;
+	if (count == PAGE_SIZE &&
+			!InnerPageInReach(buckets, buckets->pageMinLength[p], buckets->pageMaxLength[p])) {
+		buckets->skippedPages++;
+		buckets->loadedPageSkipped = true;
+		page->index = count;
+		node->outerPage->index = node->outerPage->tupleCount - 1;
+		return false;
+	}
+	tupleDesc = ExecGetResultType(innerPlanState(node));
+	for (i = 0; i < count; i++) {
+		if (page->tuples[i] == NULL) {
+			page->tuples[i] = MakeSingleTupleTableSlot(tupleDesc);
+		}
+		ExecStoreMinimalTuple(buckets->tuples[first + i], page->tuples[i], false);
+	}
+	return true;
+}
+
+/*
+ * Compute the prefilter signatures of a freshly loaded page.  outerSide
+ * tells whether the page holds tuples of the outer plan (which the quals
+ * see as ecxt_outertuple), regardless of how the kernel names the page.
+ */
+static void ComputePageSignatures(NestLoopState *node, RelationPage *page, bool outerSide) {
+	EditDistanceFilter *filter = node->edFilter;
+	ExprContext *econtext = node->js.ps.ps_ExprContext;
+	ExprState *operandState;
+	EditDistanceOperand *operand;
+	int i;
+
+	if (filter == NULL) {
+		return;
+	}
+	if (page->signatures == NULL) {
+		page->signatures = palloc(PAGE_SIZE * sizeof(EditDistanceSignature));
+	}
+	if (outerSide) {
+		operandState = filter->outerOperand;
+		operand = &filter->clause->args[filter->outerArgno];
+	} else {
+		operandState = filter->innerOperand;
+		operand = &filter->clause->args[1 - filter->outerArgno];
+	}
+
+	for (i = 0; i < page->tupleCount; i++) {
+		MemoryContext oldContext;
+		Datum value;
+		bool isnull;
+
+		if (outerSide) {
+			econtext->ecxt_outertuple = page->tuples[i];
+		} else {
+			econtext->ecxt_innertuple = page->tuples[i];
+		}
+		oldContext = MemoryContextSwitchTo(econtext->ecxt_per_tuple_memory);
+		value = ExecEvalExpr(operandState, econtext, &isnull);
+		if (isnull) {
+			page->signatures[i].length = -1;
+		} else {
+			const char *str;
+			int len;
+
+			str = edit_distance_normalize(operand, value, &len);
+			edit_distance_signature(str, len, &page->signatures[i]);
+		}
+		MemoryContextSwitchTo(oldContext);
+		ResetExprContext(econtext);
+	}
+}
+
+/*
+ * Run the prefilter cascade on the current pair of page positions.
+ */
+static bool PassesEditDistanceFilter(EditDistanceFilter *filter,
+		EditDistanceSignature *outerSig, EditDistanceSignature *innerSig) {
+	filter->checkedPairs++;
+	switch (edit_distance_prefilter(outerSig, innerSig, filter->clause->maxDistance)) {
+		case EDFILTER_PASS:
+			return true;
+		case EDFILTER_LENGTH:
+			filter->lengthRejects++;
+			break;
+		case EDFILTER_BAG:
+			filter->bagRejects++;
+			break;
+		case EDFILTER_QGRAM:
+			filter->qgramRejects++;
+			break;
+	}
+	return false;
+}
+
+
+static int LoadNextPage(PlanState* planState, RelationPage* relationPage) {
+	int i;
+	if (relationPage == NULL){
+		elog(ERROR, "LoadNextPage: null page");
+	}
+	relationPage->index = 0;
+	relationPage->tupleCount = 0;
+	// Remove the old stored tuples
+	for (i = 0; i < PAGE_SIZE; i++) {
+		if (!TupIsNull(relationPage->tuples[i])) {
+			ExecDropSingleTupleTableSlot(relationPage->tuples[i]);
+			relationPage->tuples[i] = NULL;
+		}
+	}
+	for (i = 0; i < PAGE_SIZE; i++) {
+	 	TupleTableSlot* tts = ExecProcNode(planState);
+		if (TupIsNull(tts)){
+			relationPage->tuples[i] = NULL;
+			break;
+		} else {
+			relationPage->tuples[i] = MakeSingleTupleTableSlot(tts->tts_tupleDescriptor);
+			ExecCopySlot(relationPage->tuples[i], tts);
+			relationPage->tupleCount++;
+		}	
+	}
+	return relationPage->tupleCount;
+}
+
+/*
+ * Load the next inner page of ExecBanditJoin or ExecBlockNestedLoop,
+ * computing its signatures.
+ */
+static void LoadNextInnerPage(NestLoopState *node, PlanState *innerPlan) {
+	if (node->lengthBuckets != NULL && !node->lengthBuckets->built) {
+		BuildLengthBuckets(node);
+	}
+	if (node->lengthBuckets != NULL) {
+		if (LoadNextBucketedPage(node, node->innerPage)) {
+			ComputePageSignatures(node, node->innerPage, false);
+		}
+	} else {
+		LoadNextPage(innerPlan, node->innerPage);
+		ComputePageSignatures(node, node->innerPage, false);
+	}
+}
+
+/*
+ * Restart the inner side of ExecBanditJoin or ExecBlockNestedLoop.  A
+ * length-bucketed inner side is held in memory, so the next pass can visit
+ * its pages in the order of their yields.
+ */
+static void RewindInner(NestLoopState *node, PlanState *innerPlan) {
+	if (node->lengthBuckets != NULL) {
+		node->lengthBuckets->nextPage = 0;
+		OrderInnerPagesByYield(node->lengthBuckets);
+	} else {
+		ExecReScan(innerPlan);
+	}
+}
+
+static int LoadNextOuterPage(PlanState* outerPlan, RelationPage* relationPage, ScanKey xidScanKey, int fromPageIndex) {
+	int i;
+	TupleTableSlot* tts;
+	int fromXid;
+	fromXid = fromPageIndex * PAGE_SIZE + 1;
+	if (relationPage == NULL){
+		elog(ERROR, "LoadNextOuterPage: null page");
+	}
+	relationPage->index = 0;
+	relationPage->tupleCount = 0;
+	// Remove the old stored tuples
+	for (i = 0; i < PAGE_SIZE; i++) {
+		if (!TupIsNull(relationPage->tuples[i])) {
+			ExecDropSingleTupleTableSlot(relationPage->tuples[i]);
+			relationPage->tuples[i] = NULL;
+		}
+	}
+	for (i = 0; i < PAGE_SIZE; i++) {
+		ScanKeyEntryInitialize(xidScanKey, //TODO is it fine to init ScanKey once?
+				0, // flags
+				1, /* attribute number to scan */
+				3, /* op's strategy */
+				23, /* strategy subtype */
+				0, // ((OpExpr *) clause)->inputcollid,	/* collation */
+				65, /* reg proc to use */
+				fromXid + i); /* constant */
+		if (IsA(outerPlan, IndexScanState)) {
+			((IndexScanState*)outerPlan)->iss_NumScanKeys = 1;
+			((IndexScanState*)outerPlan)->iss_ScanKeys = xidScanKey;
+		} else if (IsA(outerPlan, IndexOnlyScanState)) {
+			((IndexOnlyScanState*)outerPlan)->ioss_NumScanKeys = 1;
+			((IndexOnlyScanState*)outerPlan)->ioss_ScanKeys = xidScanKey;
+		} else {
+			elog(ERROR, "Outer plan type is not index scan");
+		}
+		ExecReScan(outerPlan);
+	 	tts = ExecProcNode(outerPlan);
+		if (TupIsNull(tts)){
+			relationPage->tuples[i] = NULL;
+			break;
+		} else {
+			relationPage->tuples[i] = MakeSingleTupleTableSlot(tts->tts_tupleDescriptor);
+			ExecCopySlot(relationPage->tuples[i], tts);
+			relationPage->tupleCount++;
+		}	
+	}
+	return relationPage->tupleCount;
+}
+
+static int popBestPageXid(NestLoopState *node) {
+	int i;
+	int bestPageIndex;
+	int bestXid;
+	
+	bestPageIndex = 0;
+	for (i = 0; i < node->activeRelationPages; i++) {
+		if (node->rewards[i] > node->rewards[bestPageIndex]){
+			bestPageIndex = i;
+		}
+	}
+	bestXid = node->xids[bestPageIndex];
+	node->xids[bestPageIndex] = node->xids[node->activeRelationPages - 1];
+	node->rewards[bestPageIndex] = node->rewards[node->activeRelationPages - 1];
+	node->stepYields[bestPageIndex] = node->stepYields[node->activeRelationPages - 1];
+	node->activeRelationPages--;
+	return bestXid;
+}
+
+/*
+ * Estimate the pages of a join input from the size of the relation it scans,
+ * which the planner's row estimate can badly understate (for instance right
+ * after a bulk load).  Only a starting size: the bandit state grows when the
+ * join runs past it.
+ */
+static long EstimateChildPages(PlanState *child) {
+	double rows = child->plan->plan_rows;
+
+	switch (nodeTag(child->plan)) {
+		case T_SeqScan:
+		case T_SampleScan:
+		case T_IndexScan:
+		case T_IndexOnlyScan:
+		case T_BitmapHeapScan:
+		case T_TidScan: {
+			Relation rel = ((ScanState *) child)->ss_currentRelation;
+			BlockNumber relpages;
+			double reltuples;
+			double allvisfrac;
+
+			if (rel != NULL) {
+				estimate_rel_size(rel, NULL, &relpages, &reltuples, &allvisfrac);
+				rows = Max(rows, reltuples);
+			}
+			break;
+		}
+		default:
+			break;
+	}
+	return (long) (rows / PAGE_SIZE) + 1;
+}
+
+/*
+ * Make room in joinedBlocks for outer page pageIndex.  The array starts from
+ * an estimate and doubles when the join walks past it, so it stays
+ * proportional to the outer pages actually read.
+ */
+static void EnsureJoinedBlocks(NestLoopState *node, int pageIndex) {
+	long newSize = node->outerPageNumber;
+	long i;
+
+	if (pageIndex < node->outerPageNumber) {
+		return;
+	}
+	while (newSize <= pageIndex) {
+		newSize *= 2;
+	}
+	node->joinedBlocks = repalloc(node->joinedBlocks, newSize * sizeof(Bitmapset*));
+	for (i = node->outerPageNumber; i < newSize; i++) {
+		node->joinedBlocks[i] = NULL;
+	}
+	node->outerPageNumber = newSize;
+}
+
+/* Milliseconds left before the deadline of the join */
+static double BanditTimeLeft(NestLoopState *node) {
+	instr_time now;
+
+	INSTR_TIME_SET_CURRENT(now);
+	INSTR_TIME_SUBTRACT(now, node->deadlineStart);
+	return node->deadlineMs - INSTR_TIME_GET_MILLISEC(now);
+}
+
+/*
+ * Choose how many explored pages to hold before exploiting.  The base is
+ * sqrtOfInnerPages.  With adaptiveActiveSet, the scores of the pages explored
+ * so far move the limit away from it: when one active page scores far above
+ * the rest it is exploited at once, when the scores vary widely and several
+ * active pages look promising more pages are explored (up to
+ * ACTIVE_SET_MAX_GROWTH times the base), and when the scores are nearly
+ * uniform there is little to learn from exploring and the set is halved.
+ * Under a LIMIT, once an active page is expected to return all the rows still
+ * wanted when exploited, exploring further can only delay them, and that page
+ * is exploited at once whatever the scores say.  So is the best page held when
+ * a deadline leaves less time than an explored page has taken on average:
+ * exploiting returns rows from its first step.
+ *
+ * The limit never exceeds what work_mem allows.  xids and rewards only grow;
+ * when the limit shrinks, pages already in the set stay there until exploited.
+ */
+static void UpdateActiveSetLimit(NestLoopState *node) {
+	int limit = node->sqrtOfInnerPages;
+	long budget;
+
+	if (node->adaptiveActiveSet && node->scoredPages >= ACTIVE_SET_MIN_SCORES
+			&& node->scoreMean > 0) {
+		double sd = sqrt(node->scoreM2 / (node->scoredPages - 1));
+		double best = 0;
+		int promising = 0;
+		int i;
+
+		for (i = 0; i < node->activeRelationPages; i++) {
+			best = Max(best, node->rewards[i]);
+			if (node->rewards[i] > node->scoreMean) {
+				promising++;
+			}
+		}
+		if (node->activeRelationPages > 0 && best > node->scoreMean + 2 * sd) {
+			limit = node->activeRelationPages;
+		} else if (sd > node->scoreMean && promising >= 2) {
+			limit = (int) (limit * Min(sd / node->scoreMean, ACTIVE_SET_MAX_GROWTH));
+		} else if (sd < node->scoreMean / 4) {
+			limit = limit / 2;
+		}
+	}
+	if (node->tupleBound >= 0 && node->activeRelationPages > 0) {
+		double wanted = node->tupleBound - (node->exploreRows + node->exploitRows);
+		double bestYield = 0;
+		int i;
+
+		for (i = 0; i < node->activeRelationPages; i++) {
+			bestYield = Max(bestYield, node->stepYields[i]);
+		}
+		if (bestYield * node->innerPageNumber >= wanted) {
+			limit = Min(limit, node->activeRelationPages);
+		}
+	}
+	if (node->deadlineMs > 0 && node->exploredPages > 0 && node->activeRelationPages > 0
+			&& BanditTimeLeft(node) < node->exploreTime / node->exploredPages) {
+		limit = Min(limit, node->activeRelationPages);
+	}
+	budget = (long) work_mem * 1024L / (sizeof(int) + 2 * sizeof(double));
+	limit = (int) Max(Min(limit, budget), 1);
+	if (limit > node->maxActivePages) {
+		node->xids = repalloc(node->xids, limit * sizeof(int));
+		node->rewards = repalloc(node->rewards, limit * sizeof(double));
+		node->stepYields = repalloc(node->stepYields, limit * sizeof(double));
+		node->maxActivePages = limit;
+	}
+	node->activeSetLimit = limit;
+	node->peakActiveSetLimit = Max(node->peakActiveSetLimit, limit);
+}
+
+/* Size the active set for innerPageNumber inner pages */
+static void ResizeActiveSet(NestLoopState *node) {
+	node->sqrtOfInnerPages = Max((int) sqrt(node->innerPageNumber), 1);
+	UpdateActiveSetLimit(node);
+}
+
+/*
+ * Hand the rest of the join over to a block nested loop once the scores of
+ * the explored pages are nearly uniform: ranking the pages then gains
+ * nothing, and parking and reloading them, and recording the blocks each has
+ * met, is pure overhead.  With cost-aware rewards the scores are rows per ms,
+ * so pages that yield alike but cost differently still count as dispersed.
+ * Not while the warm-up is still choosing the arms.
+ *
+ * There is no further handover to a tuple nested loop: over the same pages it
+ * rereads the inner input once per outer tuple rather than once per page, so
+ * it never costs less than the block nested loop.
+ */
+static void ConsiderBlockStrategy(NestLoopState *node) {
+	double sd;
+
+	if (!node->adaptiveBlock || node->blockMode || node->warmup != NULL
+			|| node->scoredPages < BANDIT_BLOCK_MIN_SCORES) {
+		return;
+	}
+	sd = sqrt(node->scoreM2 / (node->scoredPages - 1));
+	if (sd > BANDIT_BLOCK_MAX_CV * node->scoreMean) {
+		return;
+	}
+	node->blockMode = true;
+	node->blockModeAfter = node->exploredPages;
+	node->blockModeScoreCV = node->scoreMean > 0 ? sd / node->scoreMean : 0;
+}
+
+/* Add the score of a fully explored page to the running mean and variance */
+static void RecordExploredScore(NestLoopState *node, double score) {
+	double delta = score - node->scoreMean;
+
+	node->scoredPages++;
+	node->scoreMean += delta / node->scoredPages;
+	node->scoreM2 += delta * (score - node->scoreMean);
+	if (node->nextents > 0 && node->pageIndex < node->explorePages) {
+		int extent = node->pageIndex / node->extentPages;
+
+		node->extentScores[extent] += score;
+		node->extentScored[extent]++;
+	}
+	UpdateActiveSetLimit(node);
+	ConsiderBlockStrategy(node);
+}
+
+/*
+ * Whether the next outer page is a new one rather than one of the active set.
+ * After the switch to a block nested loop the pages still active are
+ * exploited first, and then each remaining page is joined in full in turn.
+ */
+static bool BanditLoadsNewPage(NestLoopState *node) {
+	if (node->reachedEndOfOuter) {
+		return false;
+	}
+	if (node->blockMode) {
+		return node->activeRelationPages == 0;
+	}
+	return node->activeRelationPages < node->activeSetLimit;
+}
+
+/*
+ * Account for an inner page just read (loadedPage) or for an empty read at the
+ * end of the inner input.  Until the inner has been read to its end once,
+ * innerPageNumber is only an estimate, kept above the pages seen so that no
+ * outer page is retired before it has met all of them; the first end of the
+ * inner input makes it exact.  Returns false if that end came as an empty
+ * read after the current outer page had already met every inner page, in
+ * which case the caller moves on to another outer page instead of rescanning.
+ */
+static bool CountInnerPages(NestLoopState *node, bool loadedPage) {
+	int stepCounter;
+
+	if (node->innerPagesKnown) {
+		return true;
+	}
+	if (!node->reachedEndOfInner) {
+		if (node->innerPageNumber <= node->innerPageCounter) {
+			node->innerPageNumber = node->innerPageCounter + 1;
+			ResizeActiveSet(node);
+		}
+		return true;
+	}
+	node->innerPageNumber = Max(node->innerPageCounter, 1);
+	node->innerPagesKnown = true;
+	ResizeActiveSet(node);
+	if (loadedPage) {
+		return true;
+	}
+	stepCounter = node->isExploring ? node->exploreStepCounter : node->exploitStepCounter;
+	return stepCounter <= node->innerPageNumber;
+}
+
+/*
+ * Position of outer page page in a pseudo-random permutation of the pages
+ * [0, explorePages), drawn from exploreSeed.  A four-round Feistel network
+ * permutes the smallest domain of 2^(2 * exploreHalfBits) values covering
+ * them, and values falling outside the range are walked through it again
+ * until one lands inside; this is a permutation of the range itself, and it
+ * needs no memory beyond the seed.
+ */
+static int PermuteOuterPage(NestLoopState *node, int page) {
+	uint32 mask = ((uint32) 1 << node->exploreHalfBits) - 1;
+	uint32 value = (uint32) page;
+	uint32 left;
+	uint32 right;
+	uint32 swap;
+	int round;
+
+	do {
+		left = value >> node->exploreHalfBits;
+		right = value & mask;
+		for (round = 0; round < 4; round++) {
+			swap = right;
+			right = left ^ (DatumGetUInt32(hash_uint32(right ^ (node->exploreSeed + round))) & mask);
+			left = swap;
+		}
+		value = (left << node->exploreHalfBits) | right;
+	} while (value >= (uint32) node->explorePages);
+	return (int) value;
+}
+
+/* The low bits bits of value in reverse order */
+static uint32 ReverseBits(uint32 value, int bits) {
+	uint32 reversed = 0;
+	int i;
+
+	for (i = 0; i < bits; i++) {
+		reversed = (reversed << 1) | ((value >> i) & 1);
+	}
+	return reversed;
+}
+
+/*
+ * The next page to explore when the pages are grouped into extents.  The
+ * extents are the arms of a first level: each is probed once, and after that
+ * pages are explored from the extent whose explored pages have scored best
+ * on average, and from the least explored of extents that score alike.
+ * Within an extent the pages are taken in bit-reversed order of their
+ * offsets, halving the gaps between the pages explored so far, so that
+ * extents that score alike are sampled evenly across their length.  Skew that
+ * is clustered physically thus draws exploration to its extent once a probe
+ * falls in the cluster.
+ */
+static int NextExtentPage(NestLoopState *node) {
+	int best = -1;
+	double bestMean = 0;
+	int extent;
+	int size;
+	uint32 offset;
+
+	for (extent = 0; extent < node->nextents; extent++) {
+		double mean;
+
+		size = Min(node->extentPages, node->explorePages - extent * node->extentPages);
+		if (node->extentNext[extent] >= size) {
+			continue;
+		}
+		// an extent not probed yet ranks first, one whose pages were all empty
+		// so far last
+		if (node->extentNext[extent] == 0) {
+			mean = DBL_MAX;
+		} else if (node->extentScored[extent] == 0) {
+			mean = -1;
+		} else {
+			mean = node->extentScores[extent] / node->extentScored[extent];
+		}
+		if (best < 0 || mean > bestMean ||
+				(mean == bestMean && node->extentNext[extent] < node->extentNext[best])) {
+			best = extent;
+			bestMean = mean;
+		}
+	}
+	Assert(best >= 0);
+	size = Min(node->extentPages, node->explorePages - best * node->extentPages);
+	do {
+		offset = ReverseBits(node->extentCursor[best]++, node->extentBits);
+	} while (offset >= (uint32) size);
+	node->extentNext[best]++;
+	return best * node->extentPages + (int) offset;
+}
+
+/*
+ * Set up ranking the arm pages by block sketches.  The arm input must be an
+ * index scan on the xid, the join quals must hold an equality between a
+ * column of the arm relation and a column of the same type of the other
+ * input, and a statistics object of the arm relation must hold a block
+ * sketch covering both the xid and that column.  The sketch is loaded here;
+ * the pages are ranked at the first exploration.
+ */
+static BanditSketchPrior* InitSketchPrior(NestLoopState *nlstate, NestLoop *node) {
+	PlanState *armPlan = nlstate->flipped ? innerPlanState(nlstate) : outerPlanState(nlstate);
+	int armVarno = nlstate->flipped ? INNER_VAR : OUTER_VAR;
+	Relation heapRel;
+	Relation indexRel;
+	AttrNumber xidAttno;
+	AttrNumber keyAttno = InvalidAttrNumber;
+	AttrNumber otherAttno = InvalidAttrNumber;
+	Oid keyType = InvalidOid;
+	TypeCacheEntry *typentry;
+	BanditSketchPrior *prior;
+	List *statOids;
+	ListCell *lc;
+
+	if (!enable_banditsketches || node->nestParams != NIL || nlstate->simJoin != NULL
+			|| nlstate->lengthBuckets != NULL) {
+		return NULL;
+	}
+	if (IsA(armPlan, IndexScanState)) {
+		indexRel = ((IndexScanState*)armPlan)->iss_RelationDesc;
+	} else if (IsA(armPlan, IndexOnlyScanState)) {
+		indexRel = ((IndexOnlyScanState*)armPlan)->ioss_RelationDesc;
+	} else {
+		return NULL;
+	}
+	heapRel = ((ScanState*)armPlan)->ss_currentRelation;
+	if (indexRel == NULL || heapRel == NULL) {
+		return NULL;
+	}
+	xidAttno = indexRel->rd_index->indkey.values[0];
+	if (xidAttno <= 0) {
+		return NULL;
+	}
+
+	foreach(lc, node->join.joinqual) {
+		OpExpr *op = (OpExpr *) lfirst(lc);
+		Var *armVar;
+		Var *otherVar;
+		TargetEntry *tle;
+		Var *scanVar;
+
+		if (!IsA(op, OpExpr) || list_length(op->args) != 2 ||
+				!IsA(linitial(op->args), Var) || !IsA(lsecond(op->args), Var)) {
+			continue;
+		}
+		armVar = (Var *) linitial(op->args);
+		otherVar = (Var *) lsecond(op->args);
+		if (otherVar->varno == armVarno) {
+			armVar = (Var *) lsecond(op->args);
+			otherVar = (Var *) linitial(op->args);
+		}
+		if (armVar->varno != armVarno || otherVar->varno == armVarno ||
+				armVar->vartype != otherVar->vartype ||
+				!op_hashjoinable(op->opno, armVar->vartype)) {
+			continue;
+		}
+		// the arm Var names a column of the arm plan's output; find the
+		// relation's column behind it
+		tle = get_tle_by_resno(armPlan->plan->targetlist, armVar->varattno);
+		if (tle == NULL || !IsA(tle->expr, Var)) {
+			continue;
+		}
+		scanVar = (Var *) tle->expr;
+		if (scanVar->varno == INDEX_VAR) {
+			if (scanVar->varattno <= 0 || scanVar->varattno > indexRel->rd_index->indnatts) {
+				continue;
+			}
+			keyAttno = indexRel->rd_index->indkey.values[scanVar->varattno - 1];
+		} else {
+			keyAttno = scanVar->varattno;
+		}
+		if (keyAttno <= 0) {
+			continue;
+		}
+		otherAttno = otherVar->varattno;
+		keyType = armVar->vartype;
+		break;
+	}
+	if (otherAttno <= 0) {
+		return NULL;
+	}
+	typentry = lookup_type_cache(keyType, TYPECACHE_HASH_PROC_FINFO);
+	if (!OidIsValid(typentry->hash_proc_finfo.fn_oid)) {
+		return NULL;
+	}
+
+	prior = NULL;
+	statOids = RelationGetStatExtList(heapRel);
+	foreach(lc, statOids) {
+		Oid statOid = lfirst_oid(lc);
+		HeapTuple htup;
+		MVBlockSketch *sketch;
+		bool built;
+		int xidColumn = -1;
+		int keyColumn = -1;
+		int j;
+
+		htup = SearchSysCache1(STATEXTOID, ObjectIdGetDatum(statOid));
+		if (!HeapTupleIsValid(htup)) {
+			continue;
+		}
+		built = statext_is_kind_built(htup, STATS_EXT_BLOCKSKETCH);
+		ReleaseSysCache(htup);
+		if (!built) {
+			continue;
+		}
+		sketch = statext_blocksketch_load(statOid);
+		for (j = 0; j < sketch->ncolumns; j++) {
+			if (sketch->attnums[j] == xidAttno) {
+				xidColumn = j;
+			}
+			if (sketch->attnums[j] == keyAttno) {
+				keyColumn = j;
+			}
+		}
+		if (xidColumn < 0 || keyColumn < 0 || sketch->nblocks == 0) {
+			pfree(sketch);
+			continue;
+		}
+		prior = palloc0(sizeof(BanditSketchPrior));
+		prior->sketch = sketch;
+		prior->xidColumn = xidColumn;
+		prior->keyColumn = keyColumn;
+		break;
+	}
+	list_free(statOids);
+	if (prior == NULL) {
+		return NULL;
+	}
+	prior->otherKeyAttno = otherAttno;
+	prior->hashProc = &typentry->hash_proc_finfo;
+	prior->collation = TupleDescAttr(RelationGetDescr(heapRel), keyAttno - 1)->attcollation;
+	return prior;
+}
+
+static int CompareSharesByPage(const void *a, const void *b) {
+	const SketchPageShare *sa = (const SketchPageShare *) a;
+	const SketchPageShare *sb = (const SketchPageShare *) b;
+
+	return (sa->page > sb->page) - (sa->page < sb->page);
+}
+
+/* Higher yields first, and pages in order among equal yields */
+static int CompareSharesByYield(const void *a, const void *b) {
+	const SketchPageShare *sa = (const SketchPageShare *) a;
+	const SketchPageShare *sb = (const SketchPageShare *) b;
+
+	if (sa->yield != sb->yield) {
+		return sa->yield > sb->yield ? -1 : 1;
+	}
+	return (sa->page > sb->page) - (sa->page < sb->page);
+}
+
+/*
+ * Rank the arm pages by their predicted yield.  The other input is read once
+ * and its join keys hashed into the buckets of the sketches' signatures; the
+ * pass also tells how many pages that input has, and the kernel rescans it
+ * afterwards.  A block whose keys fall in buckets the other input's keys
+ * never do cannot join at all.  A block whose xids spread over more than
+ * BANDIT_SKETCH_MAX_SPAN pages says too little about any one of them and is
+ * left out.  Only the pages predicted to yield more than the sketched rows
+ * do on average are ranked: the others, like pages that were not sketched,
+ * are left to the usual exploration order.
+ */
+static void BuildSketchPrior(NestLoopState *node) {
+	BanditSketchPrior *prior = node->sketchPrior;
+	MVBlockSketch *sketch = prior->sketch;
+	PlanState *otherPlan = node->flipped ? outerPlanState(node) : innerPlanState(node);
+	ExprContext *econtext = node->js.ps.ps_ExprContext;
+	MemoryContext oldcxt;
+	double counts[STATS_BLOCKSKETCH_BITS];
+	SketchPageShare *shares;
+	int nshares = 0;
+	double totalRows = 0;
+	double totalMatches = 0;
+	long n = 0;
+	int i;
+	int j;
+
+	prior->usedBlocks = 0;
+	memset(counts, 0, sizeof(counts));
+	for (;;) {
+		TupleTableSlot *slot = ExecProcNode(otherPlan);
+		Datum value;
+		bool isnull;
+
+		if (TupIsNull(slot)) {
+			break;
+		}
+		n++;
+		value = slot_getattr(slot, prior->otherKeyAttno, &isnull);
+		if (!isnull) {
+			uint32 hash;
+
+			oldcxt = MemoryContextSwitchTo(econtext->ecxt_per_tuple_memory);
+			hash = DatumGetUInt32(FunctionCall1Coll(prior->hashProc, prior->collation, value));
+			MemoryContextSwitchTo(oldcxt);
+			ResetExprContext(econtext);
+			counts[hash % STATS_BLOCKSKETCH_BITS]++;
+		}
+	}
+	ExecReScan(otherPlan);
+	prior->otherRows = n;
+	node->innerPageNumber = Max((n + PAGE_SIZE - 1) / PAGE_SIZE, 1);
+	node->innerPagesKnown = true;
+	ResizeActiveSet(node);
+	node->reachedEndOfInner = true;
+
+	shares = palloc(sketch->nblocks * BANDIT_SKETCH_MAX_SPAN * sizeof(SketchPageShare));
+	for (i = 0; i < sketch->nblocks; i++) {
+		MVBlockSketchItem *item = BlockSketchGetItem(sketch, i);
+		MVBlockSketchColumn *xids = &item->columns[prior->xidColumn];
+		MVBlockSketchColumn *keys = &item->columns[prior->keyColumn];
+		int64 first;
+		int64 last;
+		double matches = 0;
+		int bits = 0;
+		double yield;
+		int64 page;
+
+		if (item->nrows == 0 || !xids->hasRange || !keys->hasHashes || xids->min < 1) {
+			continue;
+		}
+		first = (xids->min - 1) / PAGE_SIZE;
+		last = (xids->max - 1) / PAGE_SIZE;
+		if (last - first >= BANDIT_SKETCH_MAX_SPAN || last >= INT_MAX / 4) {
+			continue;
+		}
+		for (j = 0; j < STATS_BLOCKSKETCH_BITS; j++) {
+			if (keys->signature[j / 32] & ((uint32) 1 << (j % 32))) {
+				matches += counts[j];
+				bits++;
+			}
+		}
+		// each row of the block is taken to meet the other input's rows in
+		// the bucket of its key, and each bucket set to hold as many rows
+		yield = bits > 0 ? matches / bits : 0;
+		for (page = first; page <= last; page++) {
+			shares[nshares].page = (int) page;
+			shares[nshares].rows = (double) item->nrows / (last - first + 1);
+			shares[nshares].yield = yield;
+			nshares++;
+		}
+		totalRows += item->nrows;
+		totalMatches += item->nrows * yield;
+		prior->usedBlocks++;
+	}
+
+	// merge the shares of each page, weighting the yields by rows
+	qsort(shares, nshares, sizeof(SketchPageShare), CompareSharesByPage);
+	j = -1;
+	for (i = 0; i < nshares; i++) {
+		if (j >= 0 && shares[j].page == shares[i].page) {
+			double rows = shares[j].rows + shares[i].rows;
+
+			shares[j].yield = (shares[j].yield * shares[j].rows +
+					shares[i].yield * shares[i].rows) / rows;
+			shares[j].rows = rows;
+		} else {
+			shares[++j] = shares[i];
+		}
+	}
+	nshares = j + 1;
+	qsort(shares, nshares, sizeof(SketchPageShare), CompareSharesByYield);
+	prior->npages = 0;
+	while (prior->npages < nshares && shares[prior->npages].yield > 0 &&
+			shares[prior->npages].yield * totalRows > totalMatches) {
+		prior->npages++;
+	}
+	prior->pages = palloc(Max(prior->npages, 1) * sizeof(int));
+	for (i = 0; i < prior->npages; i++) {
+		prior->pages[i] = shares[i].page;
+	}
+	pfree(shares);
+	prior->nextPage = 0;
+	prior->built = true;
+}
+
+static void FreeSketchPrior(NestLoopState *node) {
+	BanditSketchPrior *prior = node->sketchPrior;
+
+	if (prior == NULL) {
+		return;
+	}
+	pfree(prior->sketch);
+	if (prior->pages != NULL) {
+		pfree(prior->pages);
+	}
+	bms_free(prior->served);
+	pfree(prior);
+	node->sketchPrior = NULL;
+}
+
+/*
+ * The outer page to explore next.  Without a seed the pages are explored in
+ * order.  With one, the pages the outer input was estimated to hold are
+ * explored in a permuted order, so that the bandit sees a random sample of
+ * the outer input without the table being physically shuffled.  With
+ * extents, they are explored extent by extent as NextExtentPage picks.  Any
+ * pages past the estimate follow in order.  With a sketch prior, the pages
+ * it ranks come before all of these, and are skipped when the usual order
+ * reaches them.  *pastPermutation tells the caller whether a short page here
+ * is the end of the outer input.
+ */
+static int NextExplorePage(NestLoopState *node, bool *pastPermutation) {
+	BanditSketchPrior *prior = node->sketchPrior;
+	int step;
+	int page;
+
+	if (prior != NULL) {
+		if (!prior->built) {
+			BuildSketchPrior(node);
+		}
+		if (prior->nextPage < prior->npages) {
+			page = prior->pages[prior->nextPage++];
+			prior->served = bms_add_member(prior->served, page);
+			*pastPermutation = false;
+			return page;
+		}
+	}
+	do {
+		step = node->exploreStep++;
+		*pastPermutation = (step >= node->explorePages);
+		if (*pastPermutation) {
+			page = step;
+		} else if (node->nextents > 0) {
+			page = NextExtentPage(node);
+		} else {
+			page = PermuteOuterPage(node, step);
+		}
+	} while (prior != NULL && bms_is_member(page, prior->served));
+	return page;
+}
+
+/*
+ * Set up the exploration order of a bandit join over outerPages pages.
+ * Extents take precedence over a seed, and are used only when there are at
+ * least two of them.
+ */
+static void InitExploreOrder(NestLoopState *node, long outerPages) {
+	node->exploreStep = 0;
+	node->explorePages = 0;
+	node->exploreHalfBits = 1;
+	node->exploreSeed = (uint32) bandit_explore_seed;
+	if (node->extentNext != NULL) {
+		pfree(node->extentNext);
+		pfree(node->extentCursor);
+		pfree(node->extentScores);
+		pfree(node->extentScored);
+		node->extentNext = NULL;
+		node->extentCursor = NULL;
+		node->extentScores = NULL;
+		node->extentScored = NULL;
+	}
+	node->nextents = 0;
+	node->extentPages = bandit_extent_pages;
+	if (bandit_extent_pages > 0 && outerPages > bandit_extent_pages) {
+		node->explorePages = (int) Min(outerPages, INT_MAX / 4);
+		node->nextents = (node->explorePages + bandit_extent_pages - 1) / bandit_extent_pages;
+		node->extentBits = 0;
+		while (((int64) 1 << node->extentBits) < bandit_extent_pages) {
+			node->extentBits++;
+		}
+		node->extentNext = palloc0(node->nextents * sizeof(int));
+		node->extentCursor = palloc0(node->nextents * sizeof(uint32));
+		node->extentScores = palloc0(node->nextents * sizeof(double));
+		node->extentScored = palloc0(node->nextents * sizeof(int));
+		return;
+	}
+	if (bandit_explore_seed == 0) {
+		return;
+	}
+	node->explorePages = (int) Min(outerPages, INT_MAX / 4);
+	while (((int64) 1 << (2 * node->exploreHalfBits)) < node->explorePages) {
+		node->exploreHalfBits++;
+	}
+}
+
+/*
+ * Charge the work done since clockStart to the current outer page.  The clock
+ * is read once per page step and once per returned row, and restarted when
+ * the join is resumed, so time the rest of the plan spends on the returned
+ * rows is not charged to the page.
+ */
+static void ChargeBanditWork(NestLoopState *node) {
+	instr_time now;
+	instr_time elapsed;
+	double ms;
+
+	INSTR_TIME_SET_CURRENT(now);
+	elapsed = now;
+	INSTR_TIME_SUBTRACT(elapsed, node->clockStart);
+	node->clockStart = now;
+	ms = INSTR_TIME_GET_MILLISEC(elapsed);
+	node->pageCost += ms;
+	if (node->isExploring) {
+		node->exploreTime += ms;
+	} else {
+		node->exploitTime += ms;
+	}
+}
+
+/*
+ * Score of an explored outer page in the active set.  Counting rows alone
+ * ranks a page of long strings, slow to compare, with a page of short ones
+ * that yields as many rows in a fraction of the time; rows per ms of work
+ * (including loading the pages) ranks pages by how soon they return rows.
+ */
+static double ExploredPageScore(NestLoopState *node) {
+	double rows = node->reward + node->lastReward;
+
+	if (!node->costAwareRewards) {
+		return rows;
+	}
+	return rows / Max(node->pageCost, 0.001);
+}
+
+/*
+ * In deadline mode, check the time left after a page step.  Once it is gone,
+ * report how much of the join was covered and tell the caller to end the
+ * join; the rows returned so far stand as its result.  While time remains,
+ * the active set limit is rechecked as the end draws near.
+ */
+static bool BanditDeadlinePassed(NestLoopState *node) {
+	double remaining;
+	double total;
 
-static int LoadNextPage(PlanState* planState, RelationPage* relationPage) {
-	int i;
-	if (relationPage == NULL){
-		elog(ERROR, "LoadNextPage: null page");
+	if (node->deadlineMs <= 0) {
+		return false;
 	}
-	relationPage->index = 0;
-	relationPage->tupleCount = 0;
-	// Remove the old stored tuples
-	for (i = 0; i < PAGE_SIZE; i++) {
-		if (!TupIsNull(relationPage->tuples[i])) {
-			ExecDropSingleTupleTableSlot(relationPage->tuples[i]);
-			relationPage->tuples[i] = NULL;
+	remaining = BanditTimeLeft(node);
+	if (remaining > 0) {
+		if (node->exploredPages > 0 && remaining < node->exploreTime / node->exploredPages) {
+			UpdateActiveSetLimit(node);
 		}
+		return false;
 	}
-	for (i = 0; i < PAGE_SIZE; i++) {
-	 	TupleTableSlot* tts = ExecProcNode(planState);
-		if (TupIsNull(tts)){
-			relationPage->tuples[i] = NULL;
-			break;
-		} else {
-			relationPage->tuples[i] = MakeSingleTupleTableSlot(tts->tts_tupleDescriptor);
-			ExecCopySlot(relationPage->tuples[i], tts);
-			relationPage->tupleCount++;
-		}	
+	node->deadlinePassed = true;
+	total = (double) node->outerPagesEstimate * node->innerPageNumber * PAGE_SIZE * PAGE_SIZE;
+	ereport(NOTICE,
+			(errmsg("bandit join stopped at its deadline of %d ms", node->deadlineMs),
+			 errdetail("It returned %ld rows after evaluating %ld row pairs, about %.1f%% of the join, over %ld explored and %ld exploited outer pages.",
+					   node->exploreRows + node->exploitRows,
+					   node->evaluatedPairs,
+					   Min(100.0 * node->evaluatedPairs / Max(total, 1), 100.0),
+					   node->exploredPages, node->exploitedPages)));
+	return true;
+}
+
+/*
+ * The current block: the pages of the outer and inner input being joined.
+ * The arm page is pageIndex, a page number by xid; the other input is read in
+ * order, so its page is innerPageCounter - 1, unless it is length-bucketed
+ * and its pages come in the order of their yields.  Outer pages as arms,
+ * inner as arms after a flip: a block keeps its numbers either way, provided
+ * both inputs are read in xid order.
+ */
+static void CurrentBlock(NestLoopState *node, int *outerPage, int *innerPage) {
+	if (node->flipped) {
+		*outerPage = node->innerPageCounter - 1;
+		*innerPage = node->pageIndex;
+	} else if (node->lengthBuckets != NULL) {
+		*outerPage = node->pageIndex;
+		*innerPage = node->lengthBuckets->loadedPage;
+	} else {
+		*outerPage = node->pageIndex;
+		*innerPage = node->innerPageCounter - 1;
 	}
-	return relationPage->tupleCount;
 }
 
-static int LoadNextOuterPage(PlanState* outerPlan, RelationPage* relationPage, ScanKey xidScanKey, int fromPageIndex) {
+/*
+ * Whether the current block has been joined already.  Blocks are met again
+ * when an exploited page comes round to inner pages it met while explored,
+ * and after a flip; their rows must not be returned twice.
+ */
+static bool BlockJoined(NestLoopState *node) {
+	int outerPage;
+	int innerPage;
+
+	CurrentBlock(node, &outerPage, &innerPage);
+	return outerPage < node->outerPageNumber &&
+		bms_is_member(innerPage, node->joinedBlocks[outerPage]);
+}
+
+static void MarkBlockJoined(NestLoopState *node) {
+	int outerPage;
+	int innerPage;
+
+	CurrentBlock(node, &outerPage, &innerPage);
+	EnsureJoinedBlocks(node, outerPage);
+	node->joinedBlocks[outerPage] = bms_add_member(node->joinedBlocks[outerPage], innerPage);
+}
+
+/*
+ * How skewed the yields of the pages of one input are.  The rows of a block
+ * depend on both of its pages, and which blocks the warm-up met depends on
+ * the bandit's choices, so a page's raw mean would mostly reflect the other
+ * input's pages it happened to meet.  Each block's rows are therefore first
+ * divided by the mean rows per block of its page of the other input, and the
+ * skew is the coefficient of variation of the resulting page means.  *pages
+ * is set to the number of pages measured.
+ */
+static double WarmupSkew(BanditFlipWarmup *warmup, int side, int *pages) {
+	int other = 1 - side;
+	int npages[2] = {0, 0};
+	double *otherRows;
+	int *otherBlocks;
+	double *ratio;
+	int *ratioBlocks;
+	double mean = 0;
+	double m2 = 0;
+	double yield;
+	double delta;
 	int i;
-	TupleTableSlot* tts;
-	int fromXid;
-	fromXid = fromPageIndex * PAGE_SIZE + 1;
-	if (relationPage == NULL){
-		elog(ERROR, "LoadNextOuterPage: null page");
+	int s;
+
+	for (i = 0; i < warmup->nblocks; i++) {
+		for (s = 0; s < 2; s++) {
+			npages[s] = Max(npages[s], warmup->blocks[i].page[s] + 1);
+		}
 	}
-	relationPage->index = 0;
-	relationPage->tupleCount = 0;
-	// Remove the old stored tuples
-	for (i = 0; i < PAGE_SIZE; i++) {
-		if (!TupIsNull(relationPage->tuples[i])) {
-			ExecDropSingleTupleTableSlot(relationPage->tuples[i]);
-			relationPage->tuples[i] = NULL;
+	otherRows = palloc0(npages[other] * sizeof(double));
+	otherBlocks = palloc0(npages[other] * sizeof(int));
+	ratio = palloc0(npages[side] * sizeof(double));
+	ratioBlocks = palloc0(npages[side] * sizeof(int));
+	for (i = 0; i < warmup->nblocks; i++) {
+		otherRows[warmup->blocks[i].page[other]] += warmup->blocks[i].rows;
+		otherBlocks[warmup->blocks[i].page[other]]++;
+	}
+	for (i = 0; i < warmup->nblocks; i++) {
+		int otherPage = warmup->blocks[i].page[other];
+
+		if (otherRows[otherPage] > 0) {
+			ratio[warmup->blocks[i].page[side]] +=
+				warmup->blocks[i].rows / (otherRows[otherPage] / otherBlocks[otherPage]);
+			ratioBlocks[warmup->blocks[i].page[side]]++;
 		}
 	}
-	for (i = 0; i < PAGE_SIZE; i++) {
-		ScanKeyEntryInitialize(xidScanKey, //TODO is it fine to init ScanKey once?
-				0, // flags
-				1, /* attribute number to scan */
-				3, /* op's strategy */
-				23, /* strategy subtype */
-				0, // ((OpExpr *) clause)->inputcollid,	/* collation */
-				65, /* reg proc to use */
-				fromXid + i); /* constant */
-		if (IsA(outerPlan, IndexScanState)) {
-			((IndexScanState*)outerPlan)->iss_NumScanKeys = 1;
-			((IndexScanState*)outerPlan)->iss_ScanKeys = xidScanKey;
-		} else if (IsA(outerPlan, IndexOnlyScanState)) {
-			((IndexOnlyScanState*)outerPlan)->ioss_NumScanKeys = 1;
-			((IndexOnlyScanState*)outerPlan)->ioss_ScanKeys = xidScanKey;
+	*pages = 0;
+	for (i = 0; i < npages[side]; i++) {
+		if (ratioBlocks[i] == 0) {
+			continue;
+		}
+		yield = ratio[i] / ratioBlocks[i];
+		(*pages)++;
+		delta = yield - mean;
+		mean += delta / *pages;
+		m2 += delta * (yield - mean);
+	}
+	pfree(otherRows);
+	pfree(otherBlocks);
+	pfree(ratio);
+	pfree(ratioBlocks);
+	if (*pages < 2 || mean <= 0) {
+		return 0;
+	}
+	return sqrt(m2 / (*pages - 1)) / mean;
+}
+
+/*
+ * Record the block just joined in the warm-up, and once enough blocks and
+ * enough pages of both inputs have been measured, choose the arms: the bandit
+ * gains most when the yields of its arms are skewed, so the input whose
+ * pages' yields vary more wins.  Returns true if that is not the current arm
+ * input, in which case the caller flips the join.
+ */
+static bool BanditWarmupFlips(NestLoopState *node) {
+	BanditFlipWarmup *warmup = node->warmup;
+	BanditWarmupBlock *block;
+	int armSide = node->flipped ? 1 : 0;
+	int pages[2];
+
+	if (warmup == NULL) {
+		return false;
+	}
+	if (!node->blockSkipped) {
+		block = &warmup->blocks[warmup->nblocks++];
+		CurrentBlock(node, &block->page[0], &block->page[1]);
+		block->rows = node->blockRows;
+	}
+	if (warmup->nblocks < BANDIT_WARMUP_MIN_BLOCKS) {
+		return false;
+	}
+	node->inputSkew[0] = WarmupSkew(warmup, 0, &pages[0]);
+	node->inputSkew[1] = WarmupSkew(warmup, 1, &pages[1]);
+	if ((pages[0] < BANDIT_WARMUP_MIN_PAGES || pages[1] < BANDIT_WARMUP_MIN_PAGES)
+			&& warmup->nblocks < BANDIT_WARMUP_BLOCKS) {
+		return false;
+	}
+	node->warmupBlocks = warmup->nblocks;
+	node->warmup = NULL;
+	pfree(warmup);
+	return node->inputSkew[1 - armSide] > BANDIT_FLIP_MARGIN * node->inputSkew[armSide];
+}
+
+static void SetIndexScanKeys(PlanState *planState, ScanKey keys, int nkeys) {
+	if (IsA(planState, IndexScanState)) {
+		((IndexScanState*)planState)->iss_NumScanKeys = nkeys;
+		((IndexScanState*)planState)->iss_ScanKeys = keys;
+	} else {
+		((IndexOnlyScanState*)planState)->ioss_NumScanKeys = nkeys;
+		((IndexOnlyScanState*)planState)->ioss_ScanKeys = keys;
+	}
+}
+
+/*
+ * Make the other input's pages the arms and restart the bandit over them.
+ * The blocks joined so far stay in joinedBlocks and are skipped.  The old arm
+ * input, paged by xid lookups until now, gets its own scan keys back to be
+ * read in order.
+ */
+static void FlipBanditJoin(NestLoopState *node) {
+	long armPages = node->innerPagesKnown ? node->innerPageNumber : EstimateChildPages(node->flipped ?
+			outerPlanState(node) : innerPlanState(node));
+	int oldArmSide = node->flipped ? 1 : 0;
+
+	SetIndexScanKeys(oldArmSide == 0 ? outerPlanState(node) : innerPlanState(node),
+			node->inputScanKeys[oldArmSide], node->inputNumScanKeys[oldArmSide]);
+	node->innerPageNumber = node->outerPagesEstimate;
+	node->innerPagesKnown = false;
+	node->outerPagesEstimate = armPages;
+	InitExploreOrder(node, armPages);
+	node->flipped = !node->flipped;
+	node->flippedAtRuntime = true;
+	// the sketches describe the old arm relation
+	FreeSketchPrior(node);
+	node->activeRelationPages = 0;
+	node->scoredPages = 0;
+	node->scoreMean = 0;
+	node->scoreM2 = 0;
+	ResizeActiveSet(node);
+	node->pageIndex = -1;
+	node->reachedEndOfOuter = false;
+	node->reachedEndOfInner = true;
+	node->needOuterPage = true;
+	node->needInnerPage = true;
+	RemoveRelationPage(&(node->outerPage));
+	RemoveRelationPage(&(node->innerPage));
+	node->outerPage = CreateRelationPage();
+	node->innerPage = CreateRelationPage();
+	elog(DEBUG1, "Flipping inner and outer relations after %ld warm-up blocks", node->warmupBlocks);
+}
+
+/*
+ * Whether the bandit join may flip its arms at runtime: both inputs must be
+ * index scans that can be paged by xid, nothing may pass from one to the
+ * other, and the inner input must be read in xid order rather than by key
+ * length, so that its page numbers stay the same after a flip.  Nor may
+ * explored pages be joined with a sample only, which leaves the warm-up no
+ * blocks to measure.
+ */
+static bool CanFlipAtRuntime(NestLoopState *nlstate, NestLoop *node) {
+	PlanState *inputs[2];
+	int i;
+
+	if (!enable_adaptiveflip || node->nestParams != NIL || nlstate->simJoin != NULL
+			|| nlstate->lengthBuckets != NULL || nlstate->samplePages > 0) {
+		return false;
+	}
+	inputs[0] = outerPlanState(nlstate);
+	inputs[1] = innerPlanState(nlstate);
+	for (i = 0; i < 2; i++) {
+		if (IsA(inputs[i], IndexScanState)) {
+			nlstate->inputScanKeys[i] = ((IndexScanState*)inputs[i])->iss_ScanKeys;
+			nlstate->inputNumScanKeys[i] = ((IndexScanState*)inputs[i])->iss_NumScanKeys;
+		} else if (IsA(inputs[i], IndexOnlyScanState)) {
+			nlstate->inputScanKeys[i] = ((IndexOnlyScanState*)inputs[i])->ioss_ScanKeys;
+			nlstate->inputNumScanKeys[i] = ((IndexOnlyScanState*)inputs[i])->ioss_NumScanKeys;
 		} else {
-			elog(ERROR, "Outer plan type is not index scan");
+			return false;
 		}
-		ExecReScan(outerPlan);
-	 	tts = ExecProcNode(outerPlan);
-		if (TupIsNull(tts)){
-			relationPage->tuples[i] = NULL;
-			break;
+		if (nlstate->inputNumScanKeys[i] != 1) {
+			return false;
+		}
+	}
+	return true;
+}
+
+/*
+ * Restart the bandit join and the block nested loop for a rescan.  The pages
+ * are estimated again and explored from scratch, and the counters start over
+ * too, so that EXPLAIN ANALYZE shows the last scan, as it does for a Sort.
+ */
+static void ResetPagedJoin(NestLoopState *node) {
+	long i;
+
+	// the arms go back to the input the plan chose, and the warm-up starts over
+	if (node->flippedAtRuntime) {
+		int armSide = node->flipped ? 1 : 0;
+
+		SetIndexScanKeys(armSide == 0 ? outerPlanState(node) : innerPlanState(node),
+				node->inputScanKeys[armSide], node->inputNumScanKeys[armSide]);
+		node->flipped = !node->flipped;
+		node->flippedAtRuntime = false;
+		node->sketchPrior = InitSketchPrior(node, (NestLoop *) node->js.ps.plan);
+	} else if (node->sketchPrior != NULL) {
+		node->sketchPrior->nextPage = 0;
+		bms_free(node->sketchPrior->served);
+		node->sketchPrior->served = NULL;
+	}
+	node->innerPageNumber = EstimateChildPages(node->flipped ? outerPlanState(node) : innerPlanState(node));
+	node->outerPagesEstimate = EstimateChildPages(node->flipped ? innerPlanState(node) : outerPlanState(node));
+	node->innerPagesKnown = false;
+	InitExploreOrder(node, node->outerPagesEstimate);
+	if (node->warmup == NULL && node->warmupBlocks > 0) {
+		node->warmup = palloc0(sizeof(BanditFlipWarmup));
+	} else if (node->warmup != NULL) {
+		node->warmup->nblocks = 0;
+	}
+	node->warmupBlocks = 0;
+	node->inputSkew[0] = node->inputSkew[1] = 0;
+	// joinedBlocks keeps its length, it only ever grows
+	for (i = 0; i < node->outerPageNumber; i++) {
+		bms_free(node->joinedBlocks[i]);
+		node->joinedBlocks[i] = NULL;
+	}
+	node->activeRelationPages = 0;
+	node->isExploring = true;
+	node->reward = 0;
+	node->lastReward = 0;
+	node->needOuterPage = true;
+	node->needInnerPage = true;
+	node->exploreStepCounter = 0;
+	node->exploitStepCounter = 0;
+	node->innerPageCounter = 0;
+	node->reachedEndOfOuter = false;
+	node->reachedEndOfInner = false;
+	node->pageIndex = -1;
+	node->scoredPages = 0;
+	node->scoreMean = 0;
+	node->scoreM2 = 0;
+	node->blockMode = false;
+	node->fullPage = false;
+	node->blockModeAfter = 0;
+	node->blockModeScoreCV = 0;
+	node->blockModePages = 0;
+	node->sampledPages = 0;
+	node->pageCost = 0;
+	node->exploredPages = 0;
+	node->exploitedPages = 0;
+	node->evaluatedPairs = 0;
+	node->exploreTime = 0;
+	node->exploitTime = 0;
+	node->exploreRows = 0;
+	node->exploitRows = 0;
+	// each scan has the whole deadline
+	node->deadlinePassed = false;
+	INSTR_TIME_SET_ZERO(node->deadlineStart);
+	node->peakActiveSetLimit = 0;
+	ResizeActiveSet(node);
+	RemoveRelationPage(&(node->outerPage));
+	RemoveRelationPage(&(node->innerPage));
+	node->outerPage = CreateRelationPage();
+	node->innerPage = CreateRelationPage();
+	INSTR_TIME_SET_CURRENT(node->clockStart);
+}
+
+/*
+ * Draw the exploration sample: samplePages pages of tuples of the sequential
+ * input, picked by reservoir sampling in one pass over it.  The pass also
+ * tells how many pages that input has.  The kernel rescans it afterwards.
+ */
+static void BuildExploreSample(NestLoopState *node, PlanState *seqPlan, bool seqIsOuter) {
+	LengthBucketedInner *buckets = node->lengthBuckets;
+	int capacity = node->samplePages * PAGE_SIZE;
+	TupleTableSlot **slots = palloc0(capacity * sizeof(TupleTableSlot*));
+	TupleTableSlot *bucketSlot = NULL;
+	uint32 seed = node->exploreSeed != 0 ? node->exploreSeed : BANDIT_SAMPLE_SEED;
+	long n = 0;
+	int i;
+
+	if (buckets != NULL && !buckets->built && !BuildLengthBuckets(node)) {
+		buckets = NULL;
+	}
+	if (buckets != NULL) {
+		bucketSlot = MakeSingleTupleTableSlot(ExecGetResultType(seqPlan));
+	}
+	for (;;) {
+		TupleTableSlot *slot;
+		long target = n;
+
+		if (buckets != NULL) {
+			if (n >= buckets->ntuples) {
+				break;
+			}
+			slot = ExecStoreMinimalTuple(buckets->tuples[n], bucketSlot, false);
 		} else {
-			relationPage->tuples[i] = MakeSingleTupleTableSlot(tts->tts_tupleDescriptor);
-			ExecCopySlot(relationPage->tuples[i], tts);
-			relationPage->tupleCount++;
-		}	
+			slot = ExecProcNode(seqPlan);
+			if (TupIsNull(slot)) {
+				break;
+			}
+		}
+		if (n >= capacity) {
+			target = DatumGetUInt32(hash_uint32((uint32) n ^ seed)) % (uint32) (n + 1);
+		}
+		if (target < capacity) {
+			if (slots[target] == NULL) {
+				slots[target] = MakeSingleTupleTableSlot(slot->tts_tupleDescriptor);
+			}
+			ExecCopySlot(slots[target], slot);
+		}
+		n++;
 	}
-	return relationPage->tupleCount;
+	if (bucketSlot != NULL) {
+		ExecDropSingleTupleTableSlot(bucketSlot);
+	}
+
+	node->sampleTuples = (int) Min(n, capacity);
+	node->sampleInputTuples = n;
+	node->sample = palloc(node->samplePages * sizeof(RelationPage*));
+	for (i = 0; i < node->samplePages; i++) {
+		RelationPage *page = CreateRelationPage();
+		int j;
+
+		for (j = 0; j < PAGE_SIZE && i * PAGE_SIZE + j < node->sampleTuples; j++) {
+			page->tuples[j] = slots[i * PAGE_SIZE + j];
+			page->tupleCount++;
+		}
+		ComputePageSignatures(node, page, seqIsOuter);
+		node->sample[i] = page;
+	}
+	pfree(slots);
+
+	node->innerPageNumber = Max((n + PAGE_SIZE - 1) / PAGE_SIZE, 1);
+	node->innerPagesKnown = true;
+	ResizeActiveSet(node);
+	node->reachedEndOfInner = true;
 }
 
-static int popBestPageXid(NestLoopState *node) {
+static void FreeExploreSample(NestLoopState *node) {
 	int i;
-	int bestPageIndex;
-	int bestXid;
-	
-	bestPageIndex = 0;
-	for (i = 0; i < node->activeRelationPages; i++) {
-		if (node->rewards[i] > node->rewards[bestPageIndex]){
-			bestPageIndex = i;
+
+	if (node->sample == NULL) {
+		return;
+	}
+	for (i = 0; i < node->samplePages; i++) {
+		RemoveRelationPage(&node->sample[i]);
+	}
+	pfree(node->sample);
+	node->sample = NULL;
+}
+
+/*
+ * Explore the arm page just loaded by joining it with the exploration sample
+ * only, and park it in the active set with the reward that predicts.  Rows
+ * found this way are not returned; the page is joined in full when it is
+ * exploited, and exploring costs the sample's size rather than the inner
+ * input's.  armsAreOuter tells whether the arm page holds the outer plan's
+ * tuples.
+ */
+static void ExploreWithSample(NestLoopState *node, PlanState *seqPlan, bool armsAreOuter) {
+	ExprContext *econtext = node->js.ps.ps_ExprContext;
+	ExprState *joinqual = node->js.joinqual;
+	ExprState *otherqual = node->js.ps.qual;
+	RelationPage *arm = node->outerPage;
+	long matches = 0;
+	double scale;
+	double rows;
+	int p;
+	int a;
+	int t;
+
+	if (node->sample == NULL) {
+		BuildExploreSample(node, seqPlan, !armsAreOuter);
+	}
+	for (p = 0; p < node->samplePages; p++) {
+		RelationPage *page = node->sample[p];
+
+		for (a = 0; a < arm->tupleCount; a++) {
+			for (t = 0; t < page->tupleCount; t++) {
+				if (node->edFilter != NULL &&
+						!PassesEditDistanceFilter(node->edFilter,
+							&arm->signatures[a], &page->signatures[t])) {
+					continue;
+				}
+				if (armsAreOuter) {
+					econtext->ecxt_outertuple = arm->tuples[a];
+					econtext->ecxt_innertuple = page->tuples[t];
+				} else {
+					econtext->ecxt_outertuple = page->tuples[t];
+					econtext->ecxt_innertuple = arm->tuples[a];
+				}
+				node->evaluatedPairs++;
+				if (ExecQual(joinqual, econtext) &&
+						(otherqual == NULL || ExecQual(otherqual, econtext))) {
+					matches++;
+				}
+				ResetExprContext(econtext);
+			}
 		}
 	}
-	bestXid = node->xids[bestPageIndex];
-	node->xids[bestPageIndex] = node->xids[node->activeRelationPages - 1];
-	node->rewards[bestPageIndex] = node->rewards[node->activeRelationPages - 1];
-	node->activeRelationPages--;
-	return bestXid;
+	ChargeBanditWork(node);
+
+	// the sample stands for scale times as many tuples, and as much work
+	scale = node->sampleTuples > 0 ? (double) node->sampleInputTuples / node->sampleTuples : 0;
+	rows = matches * scale;
+	node->reward = 0;
+	node->lastReward = 0;
+	node->xids[node->activeRelationPages] = node->pageIndex;
+	node->rewards[node->activeRelationPages] = node->costAwareRewards ?
+		rows / Max(node->pageCost * scale, 0.001) : rows;
+	node->stepYields[node->activeRelationPages] = rows / node->innerPageNumber;
+	node->activeRelationPages++;
+	node->sampledPages++;
+	RecordExploredScore(node, node->rewards[node->activeRelationPages - 1]);
 }
 
 static void PrintNodeCounters(NestLoopState *node){
-	elog(INFO, "Read outer pages: %d", node->outerPageCounter);
-	elog(INFO, "Read inner pages: %d", node->innerPageCounterTotal);
-	elog(INFO, "Read outer tuples: %ld", node->outerTupleCounter);
-	elog(INFO, "Read inner tuples: %ld", node->innerTupleCounter);
-	elog(INFO, "Generated joins: %d", node->generatedJoins);
-	elog(INFO, "Rescan Count: %d", node->rescanCount);
-	elog(INFO, "Current XidPage: %d", node->pageIndex);
-	elog(INFO, "Active Relations: %d", node->activeRelationPages);
-	elog(INFO, "Total page reads: %d", (node->outerPageCounter + node->innerPageCounterTotal));
+	elog(DEBUG1, "Read outer pages: %d", node->outerPageCounter);
+	elog(DEBUG1, "Read inner pages: %d", node->innerPageCounterTotal);
+	elog(DEBUG1, "Read outer tuples: %ld", node->outerTupleCounter);
+	elog(DEBUG1, "Read inner tuples: %ld", node->innerTupleCounter);
+	elog(DEBUG1, "Generated joins: %d", node->generatedJoins);
+	elog(DEBUG1, "Rescan Count: %d", node->rescanCount);
+	elog(DEBUG1, "Current XidPage: %d", node->pageIndex);
+	elog(DEBUG1, "Active Relations: %d", node->activeRelationPages);
+	elog(DEBUG1, "Total page reads: %d", (node->outerPageCounter + node->innerPageCounterTotal));
+	if (node->lengthBuckets != NULL && node->lengthBuckets->built) {
+		elog(DEBUG1, "Skipped inner pages: %ld", node->lengthBuckets->skippedPages);
+	}
 }
 
 static TupleTableSlot* ExecRightBanditJoin(PlanState *pstate)
@@ -210,6 +2007,7 @@ static TupleTableSlot* ExecRightBanditJoin(PlanState *pstate)
 	ExprState  *otherqual;
 	ExprContext *econtext;
 	ListCell   *lc;
+	bool		pastPermutation;
 
 	CHECK_FOR_INTERRUPTS();
 
@@ -230,6 +2028,13 @@ static TupleTableSlot* ExecRightBanditJoin(PlanState *pstate)
 	 * storage allocated in the previous tuple cycle.
 	 */
 	ResetExprContext(econtext);
+	INSTR_TIME_SET_CURRENT(node->clockStart);
+	if (node->deadlinePassed) {
+		return NULL;
+	}
+	if (node->deadlineMs > 0 && INSTR_TIME_IS_ZERO(node->deadlineStart)) {
+		node->deadlineStart = node->clockStart;
+	}
 
 	/*
 	 * Ok, everything is setup for the join so now loop until we return a
@@ -247,33 +2052,53 @@ static TupleTableSlot* ExecRightBanditJoin(PlanState *pstate)
 	for (;;)
 	{
 		if (node->needOuterPage) {
-			if (!node->reachedEndOfOuter && node->activeRelationPages < node->sqrtOfInnerPages) { 
-				// explore
-				node->isExploring = true;
-				node->pageIndex++;
-				node->pageIndex = MAX(node->pageIndex, node->lastPageIndex); 
+			if (BanditLoadsNewPage(node)) {
+				// explore, or after the switch to block join the page in full
+				ChargeBanditWork(node);
+				node->pageCost = 0;
+				node->reward = 0;
+				node->isExploring = !node->blockMode;
+				node->fullPage = node->blockMode;
+				node->pageIndex = NextExplorePage(node, &pastPermutation);
 				LoadNextOuterPage(outerPlan, node->outerPage, node->xidScanKey, node->pageIndex);
-				if (node->outerPage->tupleCount < PAGE_SIZE) {
-					elog(INFO, "Reached end of outer");
+				ComputePageSignatures(node, node->outerPage, false);
+				if (node->outerPage->tupleCount < PAGE_SIZE && pastPermutation) {
+					elog(DEBUG1, "Reached end of outer");
 					node->reachedEndOfOuter = true;
-					if (node->outerPage->tupleCount == 0) continue;
 				}
+				if (node->outerPage->tupleCount == 0) continue;
 				node->outerTupleCounter += node->outerPage->tupleCount;
 				node->outerPageCounter++;
+				if (node->blockMode) {
+					node->blockModePages++;
+					node->exploitStepCounter = 1;
+				} else {
+					node->exploredPages++;
+				}
 				node->lastReward = 0;
 				node->exploreStepCounter = 1;
-			} else if ((!node->reachedEndOfOuter && node->activeRelationPages == node->sqrtOfInnerPages) || 
-					(node->reachedEndOfOuter && node->activeRelationPages > 0)){
+				if (node->samplePages > 0 && !node->blockMode) {
+					ExploreWithSample(node, innerPlan, false);
+					if (BanditDeadlinePassed(node)) {
+						return NULL;
+					}
+					continue;
+				}
+			} else if (node->activeRelationPages > 0) {
 				// exploit
+				ChargeBanditWork(node);
+				node->pageCost = 0;
 				node->outerPage->index = 0;
 				node->isExploring = false;
+				node->fullPage = false;
+				node->exploitedPages++;
 				node->exploitStepCounter = 0;
-				node->lastPageIndex = MAX(node->pageIndex, node->lastPageIndex); 
 				node->pageIndex = popBestPageXid(node);
 				LoadNextOuterPage(outerPlan, node->outerPage, node->xidScanKey, node->pageIndex);
+				ComputePageSignatures(node, node->outerPage, false);
 			} else {
 				// join is done
-				elog(INFO, "Join finished normally");
+				elog(DEBUG1, "Join finished normally");
 				return NULL;
 
 			}
@@ -307,20 +2132,44 @@ static TupleTableSlot* ExecRightBanditJoin(PlanState *pstate)
 				node->reachedEndOfInner = false;
 			}
 			LoadNextPage(innerPlan, node->innerPage);
+			ComputePageSignatures(node, node->innerPage, true);
 			if (node->innerPage->tupleCount < PAGE_SIZE) {
 				node->reachedEndOfInner = true;
-				if (node->innerPage->tupleCount == 0) continue;
+				if (node->innerPage->tupleCount == 0) {
+					if (!CountInnerPages(node, false)) {
+						node->needOuterPage = true;
+					}
+					continue;
+				}
 			} 
 			node->innerTupleCounter += node->innerPage->tupleCount;
 			node->innerPageCounter++;
 			node->innerPageCounterTotal++;
 			node->needInnerPage = false;
+			CountInnerPages(node, true);
+			node->blockRows = 0;
+			node->blockSkipped = BlockJoined(node);
+			if (node->blockSkipped) {
+				node->outerPage->index = node->outerPage->tupleCount - 1;
+				node->innerPage->index = node->innerPage->tupleCount;
+			}
 		} 
 		if (node->innerPage->index == node->innerPage->tupleCount) {
 			if (node->outerPage->index < node->outerPage->tupleCount - 1) {
 				node->outerPage->index++;
 				node->innerPage->index = 0;
 			} else {
+				ChargeBanditWork(node);
+				if (BanditDeadlinePassed(node)) {
+					return NULL;
+				}
+				if (!node->fullPage) {
+					MarkBlockJoined(node);
+				}
+				if (BanditWarmupFlips(node)) {
+					FlipBanditJoin(node);
+					return ExecBanditJoin(pstate);
+				}
 				node->needInnerPage = true;
 				if (node->isExploring && node->lastReward > 0 
 						&& node->exploreStepCounter < node->innerPageNumber) { //stay with current
@@ -328,20 +2177,23 @@ static TupleTableSlot* ExecRightBanditJoin(PlanState *pstate)
 					node->reward += node->lastReward;
 					node->lastReward = 0;
 					node->exploreStepCounter++;
-				} else if (node->isExploring && node->exploreStepCounter == node->innerPageNumber) {
+				} else if (node->isExploring && node->exploreStepCounter >= node->innerPageNumber) {
 					// we have generated all possible joins for the current output page
 					// while exploring, no need to store it
+					RecordExploredScore(node, ExploredPageScore(node));
 					node->needOuterPage = true;
 				} else if (node->isExploring && node->lastReward == 0) {
 					//push the current explored page
 					node->xids[node->activeRelationPages] = node->pageIndex;
-					node->rewards[node->activeRelationPages] = node->reward;
+					node->rewards[node->activeRelationPages] = ExploredPageScore(node);
+					node->stepYields[node->activeRelationPages] = (double) node->reward / node->exploreStepCounter;
 					node->activeRelationPages++;
+					RecordExploredScore(node, node->rewards[node->activeRelationPages - 1]);
 					node->needOuterPage = true;
 				} else if (!node->isExploring && node->exploitStepCounter < node->innerPageNumber) { 
 					node->outerPage->index = 0;
 					node->exploitStepCounter++;
-				} else if (!node->isExploring && node->exploitStepCounter == node->innerPageNumber) {
+				} else if (!node->isExploring && node->exploitStepCounter >= node->innerPageNumber) {
 					// Done with this outer page forever
 					node->needOuterPage = true;
 				} else {
@@ -363,7 +2215,7 @@ static TupleTableSlot* ExecRightBanditJoin(PlanState *pstate)
 		if (TupIsNull(outerTupleSlot)){
 			if (node->activeRelationPages > 0) { // still has pages in stack
 				// elog(WARNING, "Finishing join while there are active pages");
-				elog(INFO, "Null outer detected");
+				elog(DEBUG1, "Null outer detected");
 				node->needOuterPage = true;
 				continue;
 			}
@@ -371,6 +2223,14 @@ static TupleTableSlot* ExecRightBanditJoin(PlanState *pstate)
 		}
 
 		ENL1_printf("testing qualification");
+		if (node->edFilter != NULL &&
+				!PassesEditDistanceFilter(node->edFilter,
+					&node->outerPage->signatures[node->outerPage->index],
+					&node->innerPage->signatures[node->innerPage->index - 1])) {
+			InstrCountFiltered1(node, 1);
+			continue;
+		}
+		node->evaluatedPairs++;
 		if (ExecQual(joinqual, econtext))
 		{
 
@@ -379,16 +2239,13 @@ static TupleTableSlot* ExecRightBanditJoin(PlanState *pstate)
 				ENL1_printf("qualification succeeded, projecting tuple");
 				node->lastReward++;
 				node->generatedJoins++;
-				if (node->pageIndex >= node->outerPageNumber){
-					elog(WARNING, "pageIndex > outerPageNumber!?");
-					return NULL;
-				}
-				//TODO do this check earlier in the algorithm
-				if (list_member_int(node->pageIdJoinIdLists[node->pageIndex], node->innerPageCounter)) {
-					continue;
+				node->blockRows++;
+				if (node->isExploring) {
+					node->exploreRows++;
+				} else {
+					node->exploitRows++;
 				}
-				// Add current xid-innerPageCounter to result sets
-				lcons_int(node->innerPageCounter, node->pageIdJoinIdLists[node->pageIndex]);  
+				ChargeBanditWork(node);
 				return ExecProject(node->js.ps.ps_ProjInfo);
 			}
 			else
@@ -414,6 +2271,7 @@ static TupleTableSlot* ExecBanditJoin(PlanState *pstate)
 	ExprState  *otherqual;
 	ExprContext *econtext;
 	ListCell   *lc;
+	bool		pastPermutation;
 
 	CHECK_FOR_INTERRUPTS();
 
@@ -434,6 +2292,13 @@ static TupleTableSlot* ExecBanditJoin(PlanState *pstate)
 	 * storage allocated in the previous tuple cycle.
 	 */
 	ResetExprContext(econtext);
+	INSTR_TIME_SET_CURRENT(node->clockStart);
+	if (node->deadlinePassed) {
+		return NULL;
+	}
+	if (node->deadlineMs > 0 && INSTR_TIME_IS_ZERO(node->deadlineStart)) {
+		node->deadlineStart = node->clockStart;
+	}
 
 	/*
 	 * Ok, everything is setup for the join so now loop until we return a
@@ -449,38 +2314,65 @@ static TupleTableSlot* ExecBanditJoin(PlanState *pstate)
 	for (;;)
 	{
 		if (node->needOuterPage) {
-			if (!node->reachedEndOfOuter && node->activeRelationPages < node->sqrtOfInnerPages) { 
-				// explore
-				node->isExploring = true;
-				node->pageIndex++;
-				node->pageIndex = MAX(node->pageIndex, node->lastPageIndex); 
+			if (BanditLoadsNewPage(node)) {
+				// explore, or after the switch to block join the page in full
+				ChargeBanditWork(node);
+				node->pageCost = 0;
+				node->reward = 0;
+				node->isExploring = !node->blockMode;
+				node->fullPage = node->blockMode;
+				node->pageIndex = NextExplorePage(node, &pastPermutation);
 				LoadNextOuterPage(outerPlan, node->outerPage, node->xidScanKey, node->pageIndex);
-				if (node->outerPage->tupleCount < PAGE_SIZE) {
-					elog(INFO, "Reached end of outer");
+				ComputePageSignatures(node, node->outerPage, true);
+				ComputeOuterLengths(node);
+				if (node->outerPage->tupleCount < PAGE_SIZE && pastPermutation) {
+					elog(DEBUG1, "Reached end of outer");
 					node->reachedEndOfOuter = true;
-					if (node->outerPage->tupleCount == 0) continue;
 				}
+				if (node->outerPage->tupleCount == 0) continue;
 				node->outerTupleCounter += node->outerPage->tupleCount;
 				node->outerPageCounter++;
+				if (node->blockMode) {
+					node->blockModePages++;
+					node->exploitStepCounter = 1;
+				} else {
+					node->exploredPages++;
+				}
 				node->lastReward = 0;
 				node->exploreStepCounter = 1;
-			} else if ((!node->reachedEndOfOuter && node->activeRelationPages == node->sqrtOfInnerPages) || 
-					(node->reachedEndOfOuter && node->activeRelationPages > 0)){
+				if (node->samplePages > 0 && !node->blockMode) {
+					ExploreWithSample(node, innerPlan, true);
+					if (BanditDeadlinePassed(node)) {
+						return NULL;
+					}
+					continue;
+				}
+			} else if (node->activeRelationPages > 0) {
 				// exploit
+				ChargeBanditWork(node);
+				node->pageCost = 0;
 				node->outerPage->index = 0;
 				node->isExploring = false;
+				node->fullPage = false;
+				node->exploitedPages++;
 				node->exploitStepCounter = 0;
-				node->lastPageIndex = MAX(node->pageIndex, node->lastPageIndex); 
 				node->pageIndex = popBestPageXid(node);
 				LoadNextOuterPage(outerPlan, node->outerPage, node->xidScanKey, node->pageIndex);
+				ComputePageSignatures(node, node->outerPage, true);
+				ComputeOuterLengths(node);
 			} else {
 				// join is done
-				elog(INFO, "Join finished normally");
+				elog(DEBUG1, "Join finished normally");
 				return NULL;
 
 			}
 			node->needOuterPage = false;
 			node->needInnerPage = true;
+			if (node->lengthBuckets != NULL) {
+				// rewinding costs nothing, so every outer page meets the inner
+				// pages in the order of their yields
+				node->reachedEndOfInner = true;
+			}
 		}
 		if (node->needInnerPage) {
 			if (node->reachedEndOfInner) {
@@ -504,25 +2396,49 @@ static TupleTableSlot* ExecBanditJoin(PlanState *pstate)
 					innerPlan->chgParam = bms_add_member(innerPlan->chgParam, paramno);
 				}
 				node->innerPageCounter = 0;
-				ExecReScan(innerPlan);
+				RewindInner(node, innerPlan);
 				node->rescanCount++;
 				node->reachedEndOfInner = false;
 			}
-			LoadNextPage(innerPlan, node->innerPage);
+			LoadNextInnerPage(node, innerPlan);
 			if (node->innerPage->tupleCount < PAGE_SIZE) {
 				node->reachedEndOfInner = true;
-				if (node->innerPage->tupleCount == 0) continue;
+				if (node->innerPage->tupleCount == 0) {
+					if (!CountInnerPages(node, false)) {
+						node->needOuterPage = true;
+					}
+					continue;
+				}
 			} 
 			node->innerTupleCounter += node->innerPage->tupleCount;
 			node->innerPageCounter++;
 			node->innerPageCounterTotal++;
 			node->needInnerPage = false;
+			CountInnerPages(node, true);
+			node->blockRows = 0;
+			node->blockSkipped = BlockJoined(node);
+			if (node->blockSkipped) {
+				node->outerPage->index = node->outerPage->tupleCount - 1;
+				node->innerPage->index = node->innerPage->tupleCount;
+			}
 		} 
 		if (node->innerPage->index == node->innerPage->tupleCount) {
 			if (node->outerPage->index < node->outerPage->tupleCount - 1) {
 				node->outerPage->index++;
 				node->innerPage->index = 0;
 			} else {
+				ChargeBanditWork(node);
+				if (BanditDeadlinePassed(node)) {
+					return NULL;
+				}
+				RecordInnerPageYield(node);
+				if (!node->fullPage) {
+					MarkBlockJoined(node);
+				}
+				if (BanditWarmupFlips(node)) {
+					FlipBanditJoin(node);
+					return ExecRightBanditJoin(pstate);
+				}
 				node->needInnerPage = true;
 				if (node->isExploring && node->lastReward > 0 
 						&& node->exploreStepCounter < node->innerPageNumber) { //stay with current
@@ -530,21 +2446,23 @@ static TupleTableSlot* ExecBanditJoin(PlanState *pstate)
 					node->reward += node->lastReward;
 					node->lastReward = 0;
 					node->exploreStepCounter++;
-				} else if (node->isExploring && node->exploreStepCounter == node->innerPageNumber) {
+				} else if (node->isExploring && node->exploreStepCounter >= node->innerPageNumber) {
 					// we have generated all possible joins for the current output page
 					// while exploring, no need to store it
+					RecordExploredScore(node, ExploredPageScore(node));
 					node->needOuterPage = true;
 				} else if (node->isExploring && node->lastReward == 0) {
 					//push the current explored page
 					node->xids[node->activeRelationPages] = node->pageIndex;
-					node->rewards[node->activeRelationPages] = node->reward;
-					node->reward = 0;
+					node->rewards[node->activeRelationPages] = ExploredPageScore(node);
+					node->stepYields[node->activeRelationPages] = (double) node->reward / node->exploreStepCounter;
 					node->activeRelationPages++;
+					RecordExploredScore(node, node->rewards[node->activeRelationPages - 1]);
 					node->needOuterPage = true;
 				} else if (!node->isExploring && node->exploitStepCounter < node->innerPageNumber) { 
 					node->outerPage->index = 0;
 					node->exploitStepCounter++;
-				} else if (!node->isExploring && node->exploitStepCounter == node->innerPageNumber) {
+				} else if (!node->isExploring && node->exploitStepCounter >= node->innerPageNumber) {
 					// Done with this outer page forever
 					node->needOuterPage = true;
 				} else {
@@ -566,7 +2484,7 @@ static TupleTableSlot* ExecBanditJoin(PlanState *pstate)
 		if (TupIsNull(outerTupleSlot)){
 			if (node->activeRelationPages > 0) { // still has pages in stack
 				// elog(WARNING, "Finishing join while there are active pages");
-				elog(INFO, "Null outer detected");
+				elog(DEBUG1, "Null outer detected");
 				node->needOuterPage = true;
 				continue;
 			}
@@ -574,6 +2492,14 @@ static TupleTableSlot* ExecBanditJoin(PlanState *pstate)
 		}
 
 		ENL1_printf("testing qualification");
+		if (node->edFilter != NULL &&
+				!PassesEditDistanceFilter(node->edFilter,
+					&node->outerPage->signatures[node->outerPage->index],
+					&node->innerPage->signatures[node->innerPage->index - 1])) {
+			InstrCountFiltered1(node, 1);
+			continue;
+		}
+		node->evaluatedPairs++;
 		if (ExecQual(joinqual, econtext))
 		{
 
@@ -582,16 +2508,13 @@ static TupleTableSlot* ExecBanditJoin(PlanState *pstate)
 				ENL1_printf("qualification succeeded, projecting tuple");
 				node->lastReward++;
 				node->generatedJoins++;
-				if (node->pageIndex >= node->outerPageNumber){
-					elog(WARNING, "pageIndex > outerPageNumber!?");
-					return NULL;
-				}
-				//TODO do this check earlier in the algorithm
-				if (list_member_int(node->pageIdJoinIdLists[node->pageIndex], node->innerPageCounter)) {
-					continue;
+				node->blockRows++;
+				if (node->isExploring) {
+					node->exploreRows++;
+				} else {
+					node->exploitRows++;
 				}
-				// Add current xid-innerPageCounter to result sets
-				lcons_int(node->innerPageCounter, node->pageIdJoinIdLists[node->pageIndex]);  
+				ChargeBanditWork(node);
 				return ExecProject(node->js.ps.ps_ProjInfo);
 			}
 			else
@@ -641,11 +2564,13 @@ static TupleTableSlot* ExecRightBlockNestedLoop(PlanState *pstate)
 		if (node->needOuterPage) {
 			if (node->reachedEndOfOuter){
 				RemoveRelationPage(&(node->outerPage));
-				elog(INFO, "Join Done");
+				elog(DEBUG1, "Join Done");
 				return NULL; 
 			}
+			RemoveRelationPage(&(node->outerPage));
 			node->outerPage = CreateRelationPage(); 
 			LoadNextPage(outerPlan, node->outerPage);
+			ComputePageSignatures(node, node->outerPage, false);
 			node->outerTupleCounter += node->outerPage->tupleCount;
 			node->outerPageCounter++;
 			node->needOuterPage = false;
@@ -659,6 +2584,7 @@ static TupleTableSlot* ExecRightBlockNestedLoop(PlanState *pstate)
 		}
 		if (node->needInnerPage) {
 			LoadNextPage(innerPlan, node->innerPage);
+			ComputePageSignatures(node, node->innerPage, true);
 			node->innerTupleCounter += node->innerPage->tupleCount;
 			node->innerPageCounter++;
 			node->innerPageCounterTotal++;
@@ -701,6 +2627,13 @@ static TupleTableSlot* ExecRightBlockNestedLoop(PlanState *pstate)
 		node->innerPage->index++;
 
 		ENL1_printf("testing qualification");
+		if (node->edFilter != NULL &&
+				!PassesEditDistanceFilter(node->edFilter,
+					&node->outerPage->signatures[node->outerPage->index],
+					&node->innerPage->signatures[node->innerPage->index - 1])) {
+			InstrCountFiltered1(node, 1);
+			continue;
+		}
 
 		if (ExecQual(joinqual, econtext)) {
 			if (otherqual == NULL || ExecQual(otherqual, econtext)) {
@@ -751,11 +2684,14 @@ static TupleTableSlot* ExecBlockNestedLoop(PlanState *pstate)
 		if (node->needOuterPage) {
 			if (node->reachedEndOfOuter){
 				RemoveRelationPage(&(node->outerPage));
-				elog(INFO, "Join Done");
+				elog(DEBUG1, "Join Done");
 				return NULL; 
 			}
+			RemoveRelationPage(&(node->outerPage));
 			node->outerPage = CreateRelationPage(); 
 			LoadNextPage(outerPlan, node->outerPage);
+			ComputePageSignatures(node, node->outerPage, true);
+			ComputeOuterLengths(node);
 			node->outerTupleCounter += node->outerPage->tupleCount;
 			node->outerPageCounter++;
 			node->needOuterPage = false;
@@ -765,7 +2701,8 @@ static TupleTableSlot* ExecBlockNestedLoop(PlanState *pstate)
 			}
 		}
 		if (node->needInnerPage) {
-			LoadNextPage(innerPlan, node->innerPage);
+			LoadNextInnerPage(node, innerPlan);
+			node->blockRows = 0;
 			node->innerTupleCounter += node->innerPage->tupleCount;
 			node->innerPageCounter++;
 			node->innerPageCounterTotal++;
@@ -790,17 +2727,15 @@ static TupleTableSlot* ExecBlockNestedLoop(PlanState *pstate)
 							paramno);
 				}
 				ENL1_printf("rescanning inner plan");
-				ExecReScan(innerPlan);
+				RewindInner(node, innerPlan);
 				node->rescanCount++;
-				node->needOuterPage = true;
 				if (node->innerPage->tupleCount == 0){
+					node->needOuterPage = true;
 					node->needInnerPage = true;
 					continue;
 				}
-				// node->needInnerPage = true;
-				// RemoveRelationPage(&(node->outerPage));
-				// node->needOuterPage = true;
-				// continue;
+				// the short page is still joined with the whole outer page;
+				// the next outer page is loaded once that mini join is done
 			}
 		} 
 		if (node->innerPage->index == node->innerPage->tupleCount) {
@@ -808,8 +2743,12 @@ static TupleTableSlot* ExecBlockNestedLoop(PlanState *pstate)
 				node->outerPage->index++;
 				node->innerPage->index = 0;
 			} else { // mini join is done 
+				RecordInnerPageYield(node);
 				node->needInnerPage = true;
 				node->outerPage->index = 0;
+				if (node->innerPage->tupleCount < PAGE_SIZE){ // was last inner page of the iteration
+					node->needOuterPage = true;
+				}
 			}
 			continue;
 		} 		
@@ -834,11 +2773,19 @@ static TupleTableSlot* ExecBlockNestedLoop(PlanState *pstate)
 		node->innerPage->index++;
 
 		ENL1_printf("testing qualification");
+		if (node->edFilter != NULL &&
+				!PassesEditDistanceFilter(node->edFilter,
+					&node->outerPage->signatures[node->outerPage->index],
+					&node->innerPage->signatures[node->innerPage->index - 1])) {
+			InstrCountFiltered1(node, 1);
+			continue;
+		}
 
 		if (ExecQual(joinqual, econtext)) {
 			if (otherqual == NULL || ExecQual(otherqual, econtext)) {
 				ENL1_printf("qualification succeeded, projecting tuple");
 				node->generatedJoins++;
+				node->blockRows++;
 				return ExecProject(node->js.ps.ps_ProjInfo);
 			}
 			else
@@ -1157,11 +3104,21 @@ static TupleTableSlot* ExecRegularNestLoop(PlanState *pstate)
 static TupleTableSlot* ExecNestLoop(PlanState *pstate)
 {
 	TupleTableSlot *tts;
+	NestLoopState *node = castNode(NestLoopState, pstate);
 	const char* fastjoin = GetConfigOption("enable_fastjoin", false, false);
 	const char* blocknestloop = GetConfigOption("enable_block", false, false);
 	const char* fliporder = GetConfigOption("enable_fliporder", false, false);
+	if (node->simJoin != NULL) {
+		tts = ExecSimilarityJoin(node);
+		if (!node->simJoin->overflowed) {
+			return tts;
+		}
+		// its dictionaries outgrew work_mem, so join with the kernels instead
+		ExecEndSimilarityJoin(node->simJoin);
+		node->simJoin = NULL;
+	}
 	if (strcmp(fastjoin, "on") == 0){
-		if (strcmp(fliporder, "on") == 0) {
+		if (node->flipped) {
 			tts = ExecRightBanditJoin(pstate);
 		} else {
 			tts = ExecBanditJoin(pstate);
@@ -1247,6 +3204,9 @@ ExecInitNestLoop(NestLoop *node, EState *estate, int eflags)
 	nlstate->js.jointype = node->join.jointype;
 	nlstate->js.joinqual =
 		ExecInitQual(node->join.joinqual, (PlanState *) nlstate);
+	nlstate->edFilter = InitEditDistanceFilter(nlstate, node);
+	nlstate->simJoin = InitSimilarityJoin(nlstate, node);
+	nlstate->lengthBuckets = (nlstate->simJoin == NULL) ? InitLengthBuckets(nlstate, node) : NULL;
 
 	/*
 	 * detect whether we need only consider the first matching inner tuple
@@ -1295,28 +3255,52 @@ ExecInitNestLoop(NestLoop *node, EState *estate, int eflags)
 	nlstate->generatedJoins = 0;
 	nlstate->rescanCount = 0;
 	if (strcmp(fliporder, "on") == 0) {
-		nlstate->outerPageNumber = innerPlan(node)->plan_rows / PAGE_SIZE + 1; 
-		nlstate->innerPageNumber = outerPlan(node)->plan_rows / PAGE_SIZE + 1;
+		nlstate->outerPageNumber = EstimateChildPages(innerPlanState(nlstate));
+		nlstate->innerPageNumber = EstimateChildPages(outerPlanState(nlstate));
 	} else {
-		nlstate->outerPageNumber = outerPlan(node)->plan_rows / PAGE_SIZE + 1;
-		nlstate->innerPageNumber = innerPlan(node)->plan_rows / PAGE_SIZE + 1; 
+		nlstate->outerPageNumber = EstimateChildPages(outerPlanState(nlstate));
+		nlstate->innerPageNumber = EstimateChildPages(innerPlanState(nlstate));
 	}
-	//TODO sometimes the inner plan_rows does not match the exact row numbers 
+	// Both are estimates: joinedBlocks grows past the outer one, and the
+	// inner one is replaced by the exact count once the inner has been read
+	InitExploreOrder(nlstate, nlstate->outerPageNumber);
+	nlstate->outerPagesEstimate = nlstate->outerPageNumber;
+	nlstate->outerPageNumber = Min(nlstate->outerPageNumber, MAX_INITIAL_OUTER_PAGES);
+	nlstate->innerPagesKnown = false;
 	// elog(INFO, "Outer page number: %ld", nlstate->outerPageNumber);
 	// elog(INFO, "Inner page number: %ld", nlstate->innerPageNumber);
 
-	nlstate->sqrtOfInnerPages = (int)sqrt(nlstate->innerPageNumber);
-	nlstate->xids = palloc(nlstate->sqrtOfInnerPages * sizeof(int));
-	nlstate->rewards = palloc(nlstate->sqrtOfInnerPages * sizeof(int));
+	nlstate->maxActivePages = 0;
+	nlstate->xids = palloc(sizeof(int));
+	nlstate->rewards = palloc(sizeof(double));
+	nlstate->stepYields = palloc(sizeof(double));
+	nlstate->tupleBound = -1;
+	nlstate->deadlineMs = bandit_join_deadline;
+	nlstate->deadlinePassed = false;
+	INSTR_TIME_SET_ZERO(nlstate->deadlineStart);
+	nlstate->adaptiveActiveSet = enable_adaptiveactiveset;
+	nlstate->adaptiveBlock = enable_adaptiveblock;
+	nlstate->samplePages = (node->nestParams == NIL) ? bandit_explore_sample_pages : 0;
+	nlstate->sample = NULL;
+	nlstate->blockMode = false;
+	nlstate->fullPage = false;
+	nlstate->costAwareRewards = enable_costawarebandit;
+	INSTR_TIME_SET_CURRENT(nlstate->clockStart);
+	ResizeActiveSet(nlstate);
 	nlstate->pageIndex = -1;
-	nlstate->lastPageIndex = 0;
 	nlstate->xidScanKey = (ScanKey) palloc(sizeof(ScanKeyData));
-	nlstate->pageIdJoinIdLists = palloc(nlstate->outerPageNumber * sizeof(List*));
+	nlstate->joinedBlocks = palloc(nlstate->outerPageNumber * sizeof(Bitmapset*));
 	i = 0;
 	while (i < nlstate->outerPageNumber){
-		nlstate->pageIdJoinIdLists[i] = NIL;
+		nlstate->joinedBlocks[i] = NULL;
 		i++;
 	}
+	nlstate->flipped = (strcmp(fliporder, "on") == 0);
+	nlstate->flippedAtRuntime = false;
+	nlstate->warmup = CanFlipAtRuntime(nlstate, node) ? palloc0(sizeof(BanditFlipWarmup)) : NULL;
+	nlstate->sketchPrior = InitSketchPrior(nlstate, node);
+	nlstate->warmupBlocks = 0;
+	nlstate->inputSkew[0] = nlstate->inputSkew[1] = 0;
 
 	nlstate->outerPage = CreateRelationPage();  
 	nlstate->innerPage = CreateRelationPage();
@@ -1326,22 +3310,30 @@ ExecInitNestLoop(NestLoop *node, EState *estate, int eflags)
 	/*
 	elog_node_display(INFO,"Left: ", node->join.plan.lefttree, true);
 	elog_node_display(INFO,"Right: ", node->join.plan.righttree, true);
-	elog(INFO, "Computed inner page count: %ld, and sqrt: %d", 
+	elog(DEBUG1, "Computed inner page count: %ld, and sqrt: %d", 
 		nlstate->innerPageNumber, nlstate->sqrtOfInnerPages);
 	*/
 	fastjoin = GetConfigOption("enable_fastjoin", false, false);
 	blocknestloop = GetConfigOption("enable_block", false, false);
-	if (strcmp(fastjoin, "on") == 0){
-		elog(INFO, "Running bandit join..");
+	if (nlstate->simJoin != NULL && nlstate->simJoin->useLSH) {
+		elog(DEBUG1, "Running approximate (LSH) similarity join..");
+	} else if (nlstate->simJoin != NULL && nlstate->simJoin->useBlocking) {
+		elog(DEBUG1, "Running blocking similarity join..");
+	} else if (nlstate->simJoin != NULL && nlstate->simJoin->usePassJoin) {
+		elog(DEBUG1, "Running PassJoin similarity join..");
+	} else if (nlstate->simJoin != NULL) {
+		elog(DEBUG1, "Running distinct-key similarity join..");
+	} else if (strcmp(fastjoin, "on") == 0){
+		elog(DEBUG1, "Running bandit join..");
 	} else {
 		if (strcmp(blocknestloop, "on") == 0) {
-			elog(INFO, "Running block nested loop..");
+			elog(DEBUG1, "Running block nested loop..");
 		} else {
-			elog(INFO, "Running nested loop..");
+			elog(DEBUG1, "Running nested loop..");
 		}
 	}
 	if (strcmp(fliporder, "on") == 0) {
-			elog(INFO, "flipping inner and outer relations");
+			elog(DEBUG1, "flipping inner and outer relations");
 	}
 	return nlstate;
 }
@@ -1359,7 +3351,11 @@ ExecEndNestLoop(NestLoopState *node)
 	NL1_printf("ExecEndNestLoop: %s\n",
 			   "ending node processing");
 
-	PrintNodeCounters(node);
+	// a similarity join does not page through its inputs, so the page
+	// counters say nothing about it; EXPLAIN ANALYZE reports its work
+	if (node->simJoin == NULL) {
+		PrintNodeCounters(node);
+	}
 	/*
 	 * Free the exprcontext
 	 */
@@ -1373,6 +3369,12 @@ ExecEndNestLoop(NestLoopState *node)
 	/*
 	 * close down subplans
 	 */
+	if (node->simJoin != NULL) {
+		ExecEndSimilarityJoin(node->simJoin);
+	}
+	if (node->lengthBuckets != NULL) {
+		MemoryContextDelete(node->lengthBuckets->cxt);
+	}
 	ExecEndNode(outerPlanState(node));
 	ExecEndNode(innerPlanState(node));
 
@@ -1383,16 +3385,28 @@ ExecEndNestLoop(NestLoopState *node)
 	//list_free
 	i = 0;
 	while (i < node->outerPageNumber){
-		list_free(node->pageIdJoinIdLists[i]);
-		node->pageIdJoinIdLists[i] = NULL;
+		bms_free(node->joinedBlocks[i]);
+		node->joinedBlocks[i] = NULL;
 		i++;
 	}
 	RemoveRelationPage(&(node->outerPage));
 	RemoveRelationPage(&(node->innerPage));
 	pfree(node->xids);
 	pfree(node->rewards);
+	pfree(node->stepYields);
 	pfree(node->xidScanKey);
-	pfree(node->pageIdJoinIdLists);//TODO remove each entry?
+	pfree(node->joinedBlocks);
+	if (node->warmup != NULL) {
+		pfree(node->warmup);
+	}
+	FreeExploreSample(node);
+	FreeSketchPrior(node);
+	if (node->extentNext != NULL) {
+		pfree(node->extentNext);
+		pfree(node->extentCursor);
+		pfree(node->extentScores);
+		pfree(node->extentScored);
+	}
 }
 
 /* ----------------------------------------------------------------
@@ -1404,8 +3418,6 @@ ExecReScanNestLoop(NestLoopState *node)
 {
 	PlanState  *outerPlan = outerPlanState(node);
 	PlanState  *innerPlan = innerPlanState(node);
-	const char* fliporder;
-	fliporder = GetConfigOption("enable_fliporder", false, false);
 
 	/*
 	 * If outerPlan->chgParam is not null then plan will be automatically
@@ -1420,13 +3432,40 @@ ExecReScanNestLoop(NestLoopState *node)
 	 * outer Vars are used as run-time keys...
 	 */
 
-	if (strcmp(fliporder, "on") == 0) {
-		RemoveRelationPage(&(node->outerPage));
-		RemoveRelationPage(&(node->innerPage));
-		node->outerPage = CreateRelationPage();
-		node->innerPage = CreateRelationPage();
+	if (node->simJoin != NULL) {
+		ExecReScanSimilarityJoin(node);
+	}
+
+	/* the buckets only need rebuilding if the inner side has changed */
+	if (node->lengthBuckets != NULL) {
+		if (innerPlan->chgParam != NULL && node->lengthBuckets->built) {
+			MemoryContextReset(node->lengthBuckets->cxt);
+			node->lengthBuckets->built = false;
+		}
+		node->lengthBuckets->nextPage = 0;
+	}
+
+	ResetPagedJoin(node);
+
+	/* nor does the exploration sample, nor the sketch prior's ranking */
+	if ((node->flipped ? outerPlan : innerPlan)->chgParam != NULL) {
+		FreeExploreSample(node);
+		if (node->sketchPrior != NULL && node->sketchPrior->built) {
+			pfree(node->sketchPrior->pages);
+			node->sketchPrior->pages = NULL;
+			node->sketchPrior->built = false;
+		}
+	}
+
+	if (node->flipped) {
 		ExecReScan(innerPlan);
 		node->innerTupleCounter = 0;
+	} else if (((NestLoop *) node->js.ps.plan)->nestParams == NIL) {
+		// the paged kernels read the inner side in runs, not per outer tuple
+		RewindInner(node, innerPlan);
 	}
+
+	node->nl_NeedNewOuter = true;
+	node->nl_MatchedOuter = false;
 }
 
@@ -1850,6 +1850,12 @@ llvm_compile_expr(ExprState *state)
 				LLVMBuildBr(b, opblocks[i + 1]);
 				break;
 
+			case EEOP_EDIT_DISTANCE:
+				build_EvalXFunc(b, mod, "ExecEvalEditDistance",
+								v_state, v_econtext, op);
+				LLVMBuildBr(b, opblocks[i + 1]);
+				break;
+
 			case EEOP_FIELDSELECT:
 				build_EvalXFunc(b, mod, "ExecEvalFieldSelect",
 								v_state, v_econtext, op);
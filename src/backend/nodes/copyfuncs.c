@@ -847,6 +847,9 @@ _copyNestLoop(const NestLoop *from)
 	 * copy remainder of node
 	 */
 	COPY_NODE_FIELD(nestParams);
+	COPY_SCALAR_FIELD(simJoinStrategy);
+	COPY_STRING_FIELD(simJoinBlockingKeys);
+	COPY_SCALAR_FIELD(distanceOrdered);
 
 	return newnode;
 }
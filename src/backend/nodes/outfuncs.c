@@ -743,6 +743,9 @@ _outNestLoop(StringInfo str, const NestLoop *node)
 	_outJoinPlanInfo(str, (const Join *) node);
 
 	WRITE_NODE_FIELD(nestParams);
+	WRITE_ENUM_FIELD(simJoinStrategy, SimilarityJoinStrategy);
+	WRITE_STRING_FIELD(simJoinBlockingKeys);
+	WRITE_BOOL_FIELD(distanceOrdered);
 }
 
 static void
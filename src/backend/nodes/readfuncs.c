@@ -2039,6 +2039,9 @@ _readNestLoop(void)
 	ReadCommonJoin(&local_node->join);
 
 	READ_NODE_FIELD(nestParams);
+	READ_ENUM_FIELD(simJoinStrategy, SimilarityJoinStrategy);
+	READ_STRING_FIELD(simJoinBlockingKeys);
+	READ_BOOL_FIELD(distanceOrdered);
 
 	READ_DONE();
 }
@@ -17,6 +17,7 @@
 #include "nodes/makefuncs.h"
 #include "optimizer/clauses.h"
 #include "optimizer/cost.h"
+#include "optimizer/editdist.h"
 #include "optimizer/pathnode.h"
 #include "optimizer/plancat.h"
 #include "utils/fmgroids.h"
@@ -580,6 +581,7 @@ clause_selectivity(PlannerInfo *root,
 	Selectivity s1 = 0.5;		/* default for any unhandled clause type */
 	RestrictInfo *rinfo = NULL;
 	bool		cacheable = false;
+	EditDistanceClause edc;
 
 	if (clause == NULL)			/* can this still happen? */
 		return s1;
@@ -728,6 +730,11 @@ clause_selectivity(PlannerInfo *root,
 			s1 = s1 + s2 - s1 * s2;
 		}
 	}
+	else if (match_edit_distance_clause(clause, &edc))
+	{
+		/* levenshtein(a, b) <= k and the like; see selfuncs.c */
+		s1 = edit_distance_selectivity(root, &edc, varRelid);
+	}
 	else if (is_opclause(clause) || IsA(clause, DistinctExpr))
 	{
 		OpExpr	   *opclause = (OpExpr *) clause;
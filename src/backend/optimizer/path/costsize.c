@@ -85,12 +85,14 @@
 #include "nodes/nodeFuncs.h"
 #include "optimizer/clauses.h"
 #include "optimizer/cost.h"
+#include "optimizer/editdist.h"
 #include "optimizer/pathnode.h"
 #include "optimizer/paths.h"
 #include "optimizer/placeholder.h"
 #include "optimizer/plancat.h"
 #include "optimizer/planmain.h"
 #include "optimizer/restrictinfo.h"
+#include "optimizer/var.h"
 #include "parser/parsetree.h"
 #include "utils/lsyscache.h"
 #include "utils/selfuncs.h"
@@ -100,6 +102,16 @@
 
 #define LOG2(x)  (log(x) / 0.693147180559945)
 
+/*
+ * Fraction of all pairs of distinct join keys that a similarity join
+ * (execSimjoin.c) compares, with length-band, PassJoin, LSH and phonetic
+ * blocking candidate generation respectively.
+ */
+#define SIMJOIN_LENGTH_FRACTION		0.5
+#define SIMJOIN_PASSJOIN_FRACTION	0.05
+#define SIMJOIN_LSH_FRACTION		0.005
+#define SIMJOIN_BLOCKING_FRACTION	0.01
+
 /*
  * Append and MergeAppend nodes are less expensive than some other operations
  * which use cpu_tuple_cost; instead of adding a separate GUC, estimate the
@@ -136,6 +148,24 @@ bool		enable_hashjoin = true;
 bool		enable_fastjoin = false;
 bool		enable_block = false;
 bool		enable_fliporder= false;
+bool		enable_fusedlevenshtein = true;
+bool		enable_levenshteinfilter = true;
+bool		enable_dedupjoin = false;
+bool		enable_passjoin = false;
+bool		enable_lshjoin = false;
+bool		enable_lengthbuckets = true;
+bool		enable_innerpageorder = true;
+bool		enable_progressivejoin = true;
+bool		enable_costawarebandit = false;
+bool		enable_adaptiveactiveset = false;
+bool		enable_adaptiveflip = false;
+bool		enable_adaptiveblock = false;
+bool		enable_banditsketches = true;
+char	   *similarity_join_blocking_keys = NULL;
+int			bandit_explore_seed = 0;
+int			bandit_explore_sample_pages = 0;
+int			bandit_extent_pages = 0;
+int			bandit_join_deadline = 0;
 bool		enable_gathermerge = true;
 bool		enable_partitionwise_join = false;
 bool		enable_partitionwise_aggregate = false;
@@ -2330,6 +2360,23 @@ initial_cost_nestloop(PlannerInfo *root, JoinCostWorkspace *workspace,
 	Cost		inner_rescan_total_cost;
 	Cost		inner_run_cost;
 	Cost		inner_rescan_run_cost;
+	EditDistanceClause edc;
+	int			outerArgno;
+
+	/*
+	 * A similarity join reads both inputs once, completely, before it
+	 * returns its first row.  Its comparisons are costed in
+	 * final_cost_nestloop.
+	 */
+	if (similarity_join_clause(jointype, outer_path, inner_path,
+							   extra->restrictlist, &edc, &outerArgno))
+	{
+		workspace->startup_cost = outer_path->total_cost +
+			inner_path->total_cost;
+		workspace->total_cost = workspace->startup_cost;
+		workspace->run_cost = 0;
+		return;
+	}
 
 	/* estimate costs to rescan the inner relation */
 	cost_rescan(root, inner_path,
@@ -2406,6 +2453,9 @@ final_cost_nestloop(PlannerInfo *root, NestPath *path,
 	Cost		cpu_per_tuple;
 	QualCost	restrict_qual_cost;
 	double		ntuples;
+	RestrictInfo *simclause;
+	EditDistanceClause edc;
+	int			outerArgno;
 
 	/* Protect some assumptions below that rowcounts aren't zero or NaN */
 	if (outer_path_rows <= 0 || isnan(outer_path_rows))
@@ -2413,6 +2463,10 @@ final_cost_nestloop(PlannerInfo *root, NestPath *path,
 	if (inner_path_rows <= 0 || isnan(inner_path_rows))
 		inner_path_rows = 1;
 
+	simclause = similarity_join_clause(path->jointype, outer_path, inner_path,
+									   path->joinrestrictinfo, &edc,
+									   &outerArgno);
+
 	/* Mark the path with the correct row estimate */
 	if (path->path.param_info)
 		path->path.rows = path->path.param_info->ppi_rows;
@@ -2438,8 +2492,54 @@ final_cost_nestloop(PlannerInfo *root, NestPath *path,
 
 	/* cost of inner-relation source data (we already dealt with outer rel) */
 
-	if (path->jointype == JOIN_SEMI || path->jointype == JOIN_ANTI ||
-		extra->inner_unique)
+	if (simclause != NULL)
+	{
+		/*
+		 * A similarity join sorts the distinct keys of both inputs and then
+		 * evaluates the edit-distance clause once per candidate key pair; the
+		 * remaining quals are checked for the row pairs of matching key
+		 * pairs, which we approximate by the output rows.
+		 */
+		double		outer_keys;
+		double		inner_keys;
+		double		key_pairs;
+		QualCost	clause_cost;
+
+		outer_keys = estimate_num_groups(root,
+										 list_make1(edc.args[outerArgno].expr),
+										 outer_path_rows, NULL);
+		inner_keys = estimate_num_groups(root,
+										 list_make1(edc.args[1 - outerArgno].expr),
+										 inner_path_rows, NULL);
+		switch (similarity_join_strategy())
+		{
+			case SIMJOIN_LSH:
+				key_pairs = SIMJOIN_LSH_FRACTION;
+				break;
+			case SIMJOIN_BLOCKING:
+				key_pairs = SIMJOIN_BLOCKING_FRACTION;
+				break;
+			case SIMJOIN_PASSJOIN:
+				key_pairs = SIMJOIN_PASSJOIN_FRACTION;
+				break;
+			default:
+				key_pairs = SIMJOIN_LENGTH_FRACTION;
+				break;
+		}
+		key_pairs *= outer_keys * inner_keys;
+
+		startup_cost += cpu_operator_cost *
+			(outer_path_rows * LOG2(outer_path_rows + 1) +
+			 inner_path_rows * LOG2(inner_path_rows + 1));
+
+		cost_qual_eval_node(&clause_cost, (Node *) simclause->clause, root);
+		startup_cost += clause_cost.startup;
+		run_cost += clause_cost.per_tuple * key_pairs;
+
+		ntuples = path->path.rows;
+	}
+	else if (path->jointype == JOIN_SEMI || path->jointype == JOIN_ANTI ||
+			 extra->inner_unique)
 	{
 		/*
 		 * With a SEMI or ANTI join, or if the innerrel is known unique, the
@@ -4218,6 +4318,77 @@ has_indexed_join_quals(NestPath *joinpath)
 	return found_one;
 }
 
+/*
+ * similarity_join_strategy
+ *		How a nestloop with an edit distance join clause is to be run as a
+ *		similarity join under the current settings.
+ *
+ * LSH takes precedence over blocking, and blocking over pass-join.
+ */
+SimilarityJoinStrategy
+similarity_join_strategy(void)
+{
+	if (enable_lshjoin)
+		return SIMJOIN_LSH;
+	if (similarity_join_blocking_keys[0] != '\0')
+		return SIMJOIN_BLOCKING;
+	if (enable_passjoin)
+		return SIMJOIN_PASSJOIN;
+	if (enable_dedupjoin)
+		return SIMJOIN_DEDUP;
+	return SIMJOIN_NONE;
+}
+
+/*
+ * similarity_join_clause
+ *		Will the executor run this nestloop as a similarity join?
+ *
+ * This mirrors InitSimilarityJoin() in nodeNestloop.c: the join must be an
+ * unparameterized inner join with a "levenshtein(o, i) <= k" clause whose
+ * operands read the outer and the inner input respectively.  Returns that
+ * clause and fills in *edc and *outerArgno, or returns NULL.
+ */
+RestrictInfo *
+similarity_join_clause(JoinType jointype, Path *outer_path, Path *inner_path,
+					   List *restrictlist, EditDistanceClause *edc,
+					   int *outerArgno)
+{
+	Relids		outer_relids = outer_path->parent->relids;
+	Relids		inner_relids = inner_path->parent->relids;
+	ListCell   *lc;
+
+	if (similarity_join_strategy() == SIMJOIN_NONE ||
+		jointype != JOIN_INNER || inner_path->param_info != NULL)
+		return NULL;
+
+	foreach(lc, restrictlist)
+	{
+		RestrictInfo *rinfo = lfirst_node(RestrictInfo, lc);
+		Relids		relids0;
+		Relids		relids1;
+
+		if (!match_edit_distance_clause((Node *) rinfo->clause, edc))
+			continue;
+
+		relids0 = pull_varnos((Node *) edc->args[0].expr);
+		relids1 = pull_varnos((Node *) edc->args[1].expr);
+		if (bms_is_empty(relids0) || bms_is_empty(relids1))
+			continue;
+
+		if (bms_is_subset(relids0, outer_relids) &&
+			bms_is_subset(relids1, inner_relids))
+			*outerArgno = 0;
+		else if (bms_is_subset(relids0, inner_relids) &&
+				 bms_is_subset(relids1, outer_relids))
+			*outerArgno = 1;
+		else
+			continue;
+		return rinfo;
+	}
+
+	return NULL;
+}
+
 
 /*
  * approx_tuple_count
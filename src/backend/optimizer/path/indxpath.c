@@ -27,6 +27,7 @@
 #include "nodes/makefuncs.h"
 #include "optimizer/clauses.h"
 #include "optimizer/cost.h"
+#include "optimizer/editdist.h"
 #include "optimizer/pathnode.h"
 #include "optimizer/paths.h"
 #include "optimizer/predtest.h"
@@ -175,10 +176,13 @@ static bool match_boolean_index_clause(Node *clause, int indexcol,
 static bool match_special_index_operator(Expr *clause,
 							 Oid opfamily, Oid idxcollation,
 							 bool indexkey_on_left);
+static bool match_edit_distance_index_clause(Expr *clause,
+								 IndexOptInfo *index, int indexcol,
+								 Expr **indexqual);
 static Expr *expand_boolean_index_clause(Node *clause, int indexcol,
 							IndexOptInfo *index);
 static List *expand_indexqual_opclause(RestrictInfo *rinfo,
-						  Oid opfamily, Oid idxcollation);
+						  IndexOptInfo *index, int indexcol);
 static RestrictInfo *expand_indexqual_rowcompare(RestrictInfo *rinfo,
 							IndexOptInfo *index,
 							int indexcol);
@@ -2474,6 +2478,15 @@ match_clause_to_indexcol(IndexOptInfo *index,
 		return false;
 	}
 
+	/*
+	 * An edit-distance threshold on the indexkey, "levenshtein(indexkey,
+	 * expr) <= k", can be turned into an index search if the opfamily
+	 * supports one.
+	 */
+	if (plain_op &&
+		match_edit_distance_index_clause(clause, index, indexcol, NULL))
+		return true;
+
 	return false;
 }
 
@@ -3559,6 +3572,80 @@ match_special_index_operator(Expr *clause, Oid opfamily, Oid idxcollation,
 	return isIndexable;
 }
 
+/*
+ * match_edit_distance_index_clause
+ *	  Is the clause an edit-distance threshold "levenshtein(a, b) <= k" (as
+ *	  recognized by match_edit_distance_clause) with a or b matching the index
+ *	  column, for which the column's opfamily offers a search operator?
+ *
+ * The other argument of levenshtein() must be "const" in the same liberal
+ * sense as in match_clause_to_indexcol.  If indexqual isn't NULL, it is set
+ * to the index condition "indexkey <~ ROW(other, k)", which selects a
+ * superset of the rows satisfying the clause.
+ */
+static bool
+match_edit_distance_index_clause(Expr *clause, IndexOptInfo *index,
+								 int indexcol, Expr **indexqual)
+{
+	EditDistanceClause edc;
+	FuncExpr   *funcexpr;
+	Node	   *keyarg;
+	Node	   *otherarg;
+	Oid			boundop;
+	Oid			boundtype;
+	RowExpr    *bound;
+
+	if (!match_edit_distance_clause((Node *) clause, &edc))
+		return false;
+
+	funcexpr = (FuncExpr *) get_leftop(clause);
+	if (!IsA(funcexpr, FuncExpr))
+		funcexpr = (FuncExpr *) get_rightop(clause);
+
+	keyarg = (Node *) linitial(funcexpr->args);
+	otherarg = (Node *) lsecond(funcexpr->args);
+	if (!match_index_to_operand(keyarg, indexcol, index))
+	{
+		/* levenshtein() is symmetric, so the key can be either argument */
+		keyarg = (Node *) lsecond(funcexpr->args);
+		otherarg = (Node *) linitial(funcexpr->args);
+		if (!match_index_to_operand(keyarg, indexcol, index))
+			return false;
+	}
+
+	if (bms_is_member(index->rel->relid, pull_varnos(otherarg)) ||
+		contain_volatile_functions(otherarg) ||
+		!IndexCollMatchesExprColl(index->indexcollations[indexcol],
+								  funcexpr->inputcollid))
+		return false;
+
+	boundop = edit_distance_index_operator(index->opfamily[indexcol],
+										   &boundtype);
+	if (!OidIsValid(boundop))
+		return false;
+
+	if (indexqual)
+	{
+		bound = makeNode(RowExpr);
+		bound->args = list_make2(copyObject(otherarg),
+								 makeConst(INT4OID, -1, InvalidOid,
+										   sizeof(int32),
+										   Int32GetDatum(edc.maxDistance),
+										   false, true));
+		bound->row_typeid = boundtype;
+		bound->row_format = COERCE_EXPLICIT_CAST;
+		bound->colnames = NIL;
+		bound->location = -1;
+
+		*indexqual = make_opclause(boundop, BOOLOID, false,
+								   (Expr *) copyObject(keyarg),
+								   (Expr *) bound,
+								   InvalidOid, funcexpr->inputcollid);
+	}
+
+	return true;
+}
+
 /*
  * expand_indexqual_conditions
  *	  Given a list of RestrictInfo nodes, produce a list of directly usable
@@ -3595,12 +3682,10 @@ expand_indexqual_conditions(IndexOptInfo *index,
 		int			indexcol = lfirst_int(lci);
 		Expr	   *clause = rinfo->clause;
 		Oid			curFamily;
-		Oid			curCollation;
 
 		Assert(indexcol < index->nkeycolumns);
 
 		curFamily = index->opfamily[indexcol];
-		curCollation = index->indexcollations[indexcol];
 
 		/* First check for boolean cases */
 		if (IsBooleanOpfamily(curFamily))
@@ -3627,8 +3712,8 @@ expand_indexqual_conditions(IndexOptInfo *index,
 		{
 			indexquals = list_concat(indexquals,
 									 expand_indexqual_opclause(rinfo,
-															   curFamily,
-															   curCollation));
+															   index,
+															   indexcol));
 			/* expand_indexqual_opclause can produce multiple clauses */
 			while (list_length(indexqualcols) < list_length(indexquals))
 				indexqualcols = lappend_int(indexqualcols, indexcol);
@@ -3736,9 +3821,13 @@ expand_boolean_index_clause(Node *clause,
  * expand special cases that were accepted by match_special_index_operator().
  */
 static List *
-expand_indexqual_opclause(RestrictInfo *rinfo, Oid opfamily, Oid idxcollation)
+expand_indexqual_opclause(RestrictInfo *rinfo, IndexOptInfo *index,
+						  int indexcol)
 {
 	Expr	   *clause = rinfo->clause;
+	Oid			opfamily = index->opfamily[indexcol];
+	Oid			idxcollation = index->indexcollations[indexcol];
+	Expr	   *boundqual;
 
 	/* we know these will succeed */
 	Node	   *leftop = get_leftop(clause);
@@ -3749,6 +3838,13 @@ expand_indexqual_opclause(RestrictInfo *rinfo, Oid opfamily, Oid idxcollation)
 	Const	   *prefix = NULL;
 	Pattern_Prefix_Status pstatus;
 
+	/*
+	 * An edit-distance threshold only selects a superset of the matches, so
+	 * the original clause stays behind as a filter on the fetched rows.
+	 */
+	if (match_edit_distance_index_clause(clause, index, indexcol, &boundqual))
+		return list_make1(make_simple_restrictinfo(boundqual));
+
 	/*
 	 * LIKE and regex operators are not members of any btree index opfamily,
 	 * but they can be members of opfamilies for more exotic index types such
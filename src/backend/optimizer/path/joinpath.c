@@ -419,6 +419,8 @@ try_nestloop_path(PlannerInfo *root,
 	 * The latter two steps are expensive enough to make this two-phase
 	 * methodology worthwhile.
 	 */
+	pathkeys = similarity_join_pathkeys(root, jointype, outer_path, inner_path,
+										extra->restrictlist, pathkeys);
 	initial_cost_nestloop(root, &workspace, jointype,
 						  outer_path, inner_path, extra);
 
@@ -513,6 +515,8 @@ try_partial_nestloop_path(PlannerInfo *root,
 	 * Before creating a path, get a quick lower bound on what it is likely to
 	 * cost.  Bail out right away if it looks terrible.
 	 */
+	pathkeys = similarity_join_pathkeys(root, jointype, outer_path, inner_path,
+										extra->restrictlist, pathkeys);
 	initial_cost_nestloop(root, &workspace, jointype,
 						  outer_path, inner_path, extra);
 	if (!add_partial_path_precheck(joinrel, workspace.total_cost, pathkeys))
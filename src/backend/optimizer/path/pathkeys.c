@@ -18,10 +18,13 @@
 #include "postgres.h"
 
 #include "access/stratnum.h"
+#include "catalog/pg_opfamily.h"
 #include "nodes/makefuncs.h"
 #include "nodes/nodeFuncs.h"
 #include "nodes/plannodes.h"
 #include "optimizer/clauses.h"
+#include "optimizer/cost.h"
+#include "optimizer/editdist.h"
 #include "optimizer/pathnode.h"
 #include "optimizer/paths.h"
 #include "optimizer/tlist.h"
@@ -880,6 +883,69 @@ build_join_pathkeys(PlannerInfo *root,
 	return truncate_useless_pathkeys(root, joinrel, outer_pathkeys);
 }
 
+/*
+ * similarity_join_pathkeys
+ *	  Build the path keys for a nestloop join, given the keys that
+ *	  build_join_pathkeys gave it, taking into account that the executor
+ *	  may run it as a similarity join.
+ *
+ *	  A similarity join returns its rows grouped by pairs of join keys, so
+ *	  the outer path's order is lost.  But if the query's first sort key is
+ *	  the ascending edit distance that the join clause bounds, the join can
+ *	  return its rows in that order instead (enable_progressivejoin), and
+ *	  the sort is saved; create_nestloop_plan tells the executor so.
+ *
+ * Returns the list of new path keys.
+ */
+List *
+similarity_join_pathkeys(PlannerInfo *root,
+						 JoinType jointype,
+						 Path *outer_path,
+						 Path *inner_path,
+						 List *restrictlist,
+						 List *pathkeys)
+{
+	RestrictInfo *rinfo;
+	EditDistanceClause edc;
+	int			outerArgno;
+	PathKey    *pathkey;
+	ListCell   *lc;
+
+	rinfo = similarity_join_clause(jointype, outer_path, inner_path,
+								   restrictlist, &edc, &outerArgno);
+	if (rinfo == NULL)
+		return pathkeys;
+
+	if (!enable_progressivejoin || root->query_pathkeys == NIL)
+		return NIL;
+
+	/* the executor must pick the same clause to order by */
+	foreach(lc, restrictlist)
+	{
+		RestrictInfo *other = lfirst_node(RestrictInfo, lc);
+
+		if (other != rinfo &&
+			match_edit_distance_clause((Node *) other->clause, &edc))
+			return NIL;
+	}
+
+	pathkey = (PathKey *) linitial(root->query_pathkeys);
+	if (pathkey->pk_strategy != BTLessStrategyNumber ||
+		pathkey->pk_opfamily != INTEGER_BTREE_FAM_OID ||
+		pathkey->pk_eclass->ec_has_volatile)
+		return NIL;
+
+	/* the join never returns a pair whose distance is null */
+	foreach(lc, pathkey->pk_eclass->ec_members)
+	{
+		EquivalenceMember *em = (EquivalenceMember *) lfirst(lc);
+
+		if (is_edit_distance_of_clause(em->em_expr, (Node *) rinfo->clause))
+			return list_make1(pathkey);
+	}
+	return NIL;
+}
+
 /****************************************************************************
  *		PATHKEYS AND SORT CLAUSES
  ****************************************************************************/
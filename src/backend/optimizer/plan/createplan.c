@@ -3725,6 +3725,8 @@ create_nestloop_plan(PlannerInfo *root,
 	Relids		outerrelids;
 	List	   *nestParams;
 	Relids		saveOuterRels = root->curOuterRels;
+	EditDistanceClause edc;
+	int			outerArgno;
 
 	/* NestLoop can project, so no need to be picky about child tlists */
 	outer_plan = create_plan_recurse(root, best_path->outerjoinpath, 0);
@@ -3782,6 +3784,22 @@ create_nestloop_plan(PlannerInfo *root,
 							  best_path->jointype,
 							  best_path->inner_unique);
 
+	/* fix the similarity join strategy the path was costed with */
+	if (similarity_join_clause(best_path->jointype,
+							   best_path->outerjoinpath,
+							   best_path->innerjoinpath,
+							   best_path->joinrestrictinfo,
+							   &edc, &outerArgno) != NULL)
+	{
+		join_plan->simJoinStrategy = similarity_join_strategy();
+		if (join_plan->simJoinStrategy == SIMJOIN_BLOCKING)
+			join_plan->simJoinBlockingKeys =
+				pstrdup(similarity_join_blocking_keys);
+
+		/* it only has path keys if it is distance-ordered */
+		join_plan->distanceOrdered = best_path->path.pathkeys != NIL;
+	}
+
 	copy_generic_path_info(&join_plan->join.plan, &best_path->path);
 
 	return join_plan;
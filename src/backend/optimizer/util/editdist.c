@@ -0,0 +1,552 @@
+/*-------------------------------------------------------------------------
+ *
+ * editdist.c
+ *	  Routines to recognise edit-distance threshold predicates, such as
+ *	  levenshtein(trim(a::varchar(10)), trim(b::varchar(10))) <= k, in
+ *	  expression trees.
+ *
+ * levenshtein() lives in contrib/fuzzystrmatch, so it has no fixed OID; we
+ * identify it by its C symbol instead.  The executor and planner use the
+ * decomposed form to evaluate the predicate with a bounded distance
+ * computation and to apply cheaper filters ahead of it.
+ *
+ * Portions Copyright (c) 1996-2018, PostgreSQL Global Development Group
+ * Portions Copyright (c) 1994, Regents of the University of California
+ *
+ *
+ * IDENTIFICATION
+ *	  src/backend/optimizer/util/editdist.c
+ *
+ *-------------------------------------------------------------------------
+ */
+#include "postgres.h"
+
+#include "access/htup_details.h"
+#include "catalog/pg_amop.h"
+#include "catalog/pg_language.h"
+#include "catalog/pg_proc.h"
+#include "catalog/pg_type.h"
+#include "mb/pg_wchar.h"
+#include "optimizer/editdist.h"
+#include "utils/builtins.h"
+#include "utils/catcache.h"
+#include "utils/fmgroids.h"
+#include "utils/lsyscache.h"
+#include "utils/syscache.h"
+
+
+static bool proc_has_c_symbol(HeapTuple tuple, const char *symbol);
+static bool is_levenshtein_within_function(Oid funcid);
+static bool match_levenshtein_within_clause(NullTest *ntest,
+								EditDistanceClause *edc);
+static FuncExpr *edit_distance_clause_function(Node *clause);
+static void peel_edit_distance_operand(Expr *expr,
+						   EditDistanceOperand *operand);
+
+
+/*
+ * is_levenshtein_function
+ *		Is funcid the two-argument levenshtein(text, text) of fuzzystrmatch?
+ */
+bool
+is_levenshtein_function(Oid funcid)
+{
+	HeapTuple	tuple;
+	Form_pg_proc procform;
+	bool		result = false;
+
+	tuple = SearchSysCache1(PROCOID, ObjectIdGetDatum(funcid));
+	if (!HeapTupleIsValid(tuple))
+		return false;
+	procform = (Form_pg_proc) GETSTRUCT(tuple);
+
+	if (procform->pronargs == 2 &&
+		procform->prorettype == INT4OID &&
+		procform->proargtypes.values[0] == TEXTOID &&
+		procform->proargtypes.values[1] == TEXTOID)
+		result = proc_has_c_symbol(tuple, "levenshtein");
+
+	ReleaseSysCache(tuple);
+	return result;
+}
+
+/*
+ * is_levenshtein_within_function
+ *		Is funcid levenshtein_within(text, text, int) of fuzzystrmatch?
+ */
+static bool
+is_levenshtein_within_function(Oid funcid)
+{
+	HeapTuple	tuple;
+	Form_pg_proc procform;
+	bool		result = false;
+
+	tuple = SearchSysCache1(PROCOID, ObjectIdGetDatum(funcid));
+	if (!HeapTupleIsValid(tuple))
+		return false;
+	procform = (Form_pg_proc) GETSTRUCT(tuple);
+
+	if (procform->pronargs == 3 &&
+		procform->prorettype == INT4OID &&
+		procform->proargtypes.values[0] == TEXTOID &&
+		procform->proargtypes.values[1] == TEXTOID &&
+		procform->proargtypes.values[2] == INT4OID)
+		result = proc_has_c_symbol(tuple, "levenshtein_within");
+
+	ReleaseSysCache(tuple);
+	return result;
+}
+
+/*
+ * edit_distance_index_operator
+ *		Find the operator of an index opfamily that selects the strings
+ *		within a given edit distance of a target, if it has one.
+ *
+ * That is the "text <~ levenshtein_bound" operator of pg_trgm, whose right
+ * input is a composite of the target text and the distance; like
+ * levenshtein() itself, it is recognised by its function's C symbol.  On
+ * success *boundtype is set to the composite type.
+ */
+Oid
+edit_distance_index_operator(Oid opfamily, Oid *boundtype)
+{
+	CatCList   *catlist;
+	Oid			result = InvalidOid;
+	int			i;
+
+	catlist = SearchSysCacheList1(AMOPSTRATEGY, ObjectIdGetDatum(opfamily));
+
+	for (i = 0; i < catlist->n_members && !OidIsValid(result); i++)
+	{
+		Form_pg_amop amopform = (Form_pg_amop) GETSTRUCT(&catlist->members[i]->tuple);
+		HeapTuple	tuple;
+		Form_pg_proc procform;
+
+		if (amopform->amoppurpose != AMOP_SEARCH ||
+			amopform->amoplefttype != TEXTOID ||
+			get_typtype(amopform->amoprighttype) != TYPTYPE_COMPOSITE)
+			continue;
+
+		tuple = SearchSysCache1(PROCOID,
+								ObjectIdGetDatum(get_opcode(amopform->amopopr)));
+		if (!HeapTupleIsValid(tuple))
+			continue;
+		procform = (Form_pg_proc) GETSTRUCT(tuple);
+
+		if (procform->pronargs == 2 &&
+			procform->prorettype == BOOLOID &&
+			procform->proargtypes.values[0] == TEXTOID &&
+			procform->proargtypes.values[1] == amopform->amoprighttype &&
+			proc_has_c_symbol(tuple, "levenshtein_bound_op"))
+		{
+			result = amopform->amopopr;
+			*boundtype = amopform->amoprighttype;
+		}
+
+		ReleaseSysCache(tuple);
+	}
+
+	ReleaseSysCacheList(catlist);
+	return result;
+}
+
+/*
+ * proc_has_c_symbol
+ *		Is the pg_proc tuple a C-language function implemented by symbol?
+ */
+static bool
+proc_has_c_symbol(HeapTuple tuple, const char *symbol)
+{
+	Form_pg_proc procform = (Form_pg_proc) GETSTRUCT(tuple);
+	Datum		prosrc;
+	bool		isnull;
+	bool		result = false;
+
+	if (procform->prolang != ClanguageId)
+		return false;
+
+	prosrc = SysCacheGetAttr(PROCOID, tuple, Anum_pg_proc_prosrc, &isnull);
+	if (!isnull)
+	{
+		char	   *src = TextDatumGetCString(prosrc);
+
+		result = (strcmp(src, symbol) == 0);
+		pfree(src);
+	}
+
+	return result;
+}
+
+/*
+ * match_edit_distance_clause
+ *		Check whether clause is "levenshtein(a, b) op k" with op one of
+ *		<, <=, >= or > (the constant may be on either side), or
+ *		"levenshtein_within(a, b, k) IS NOT NULL", and if so fill in *edc.
+ */
+bool
+match_edit_distance_clause(Node *clause, EditDistanceClause *edc)
+{
+	OpExpr	   *opexpr;
+	Node	   *leftop;
+	Node	   *rightop;
+	FuncExpr   *funcexpr;
+	Const	   *bound;
+	bool		funcOnLeft;
+	bool		strict;
+	int			i;
+
+	if (clause != NULL && IsA(clause, NullTest))
+		return match_levenshtein_within_clause((NullTest *) clause, edc);
+	if (clause == NULL || !IsA(clause, OpExpr))
+		return false;
+	opexpr = (OpExpr *) clause;
+	if (list_length(opexpr->args) != 2)
+		return false;
+
+	leftop = (Node *) linitial(opexpr->args);
+	rightop = (Node *) lsecond(opexpr->args);
+	if (IsA(leftop, FuncExpr) && IsA(rightop, Const))
+	{
+		funcexpr = (FuncExpr *) leftop;
+		bound = (Const *) rightop;
+		funcOnLeft = true;
+	}
+	else if (IsA(leftop, Const) && IsA(rightop, FuncExpr))
+	{
+		funcexpr = (FuncExpr *) rightop;
+		bound = (Const *) leftop;
+		funcOnLeft = false;
+	}
+	else
+		return false;
+
+	switch (opexpr->opfuncid)
+	{
+		case F_INT4LE:
+			if (!funcOnLeft)
+				return false;
+			strict = false;
+			break;
+		case F_INT4LT:
+			if (!funcOnLeft)
+				return false;
+			strict = true;
+			break;
+		case F_INT4GE:
+			if (funcOnLeft)
+				return false;
+			strict = false;
+			break;
+		case F_INT4GT:
+			if (funcOnLeft)
+				return false;
+			strict = true;
+			break;
+		default:
+			return false;
+	}
+
+	if (bound->constisnull || bound->consttype != INT4OID)
+		return false;
+	if (list_length(funcexpr->args) != 2 ||
+		!is_levenshtein_function(funcexpr->funcid))
+		return false;
+
+	for (i = 0; i < 2; i++)
+		peel_edit_distance_operand((Expr *) list_nth(funcexpr->args, i),
+								   &edc->args[i]);
+
+	edc->collation = funcexpr->inputcollid;
+
+	/*
+	 * No distance is negative, so any negative bound rejects every pair.
+	 * Clamp it to -1 first so that "< INT_MIN" cannot wrap around.
+	 */
+	edc->maxDistance = DatumGetInt32(bound->constvalue);
+	if (edc->maxDistance < 0)
+		edc->maxDistance = -1;
+	else if (strict)
+		edc->maxDistance--;
+	return true;
+}
+
+/*
+ * match_levenshtein_within_clause
+ *		Workhorse of match_edit_distance_clause for the IS NOT NULL form.
+ *
+ * levenshtein_within() is strict and yields null exactly when the distance
+ * exceeds its constant bound, so the test holds iff the distance is at most
+ * that bound.  Only the test is decomposed: the function's value is still
+ * computed by the function wherever the query uses it.
+ */
+static bool
+match_levenshtein_within_clause(NullTest *ntest, EditDistanceClause *edc)
+{
+	FuncExpr   *funcexpr;
+	Const	   *bound;
+	int			i;
+
+	if (ntest->nulltesttype != IS_NOT_NULL || ntest->argisrow ||
+		!IsA(ntest->arg, FuncExpr))
+		return false;
+	funcexpr = (FuncExpr *) ntest->arg;
+
+	if (list_length(funcexpr->args) != 3 ||
+		!IsA(lthird(funcexpr->args), Const))
+		return false;
+	bound = (Const *) lthird(funcexpr->args);
+	if (bound->constisnull || bound->consttype != INT4OID ||
+		!is_levenshtein_within_function(funcexpr->funcid))
+		return false;
+
+	for (i = 0; i < 2; i++)
+		peel_edit_distance_operand((Expr *) list_nth(funcexpr->args, i),
+								   &edc->args[i]);
+
+	edc->maxDistance = DatumGetInt32(bound->constvalue);
+	edc->collation = funcexpr->inputcollid;
+	return true;
+}
+
+/*
+ * is_edit_distance_of_clause
+ *		Does expr compute the edit distance that clause bounds?
+ *
+ * clause must have been recognised by match_edit_distance_clause.  expr
+ * qualifies if it is levenshtein() of the clause's own operands, in either
+ * order, or the clause's very distance function call; it then yields the
+ * distance, never null, for every pair of rows satisfying the clause.
+ */
+bool
+is_edit_distance_of_clause(Expr *expr, Node *clause)
+{
+	FuncExpr   *clausefunc = edit_distance_clause_function(clause);
+	FuncExpr   *funcexpr;
+	Node	   *a;
+	Node	   *b;
+
+	while (IsA(expr, RelabelType))
+		expr = ((RelabelType *) expr)->arg;
+	if (!IsA(expr, FuncExpr))
+		return false;
+	funcexpr = (FuncExpr *) expr;
+
+	if (equal(funcexpr, clausefunc))
+		return true;
+
+	if (list_length(funcexpr->args) != 2 ||
+		!is_levenshtein_function(funcexpr->funcid))
+		return false;
+	a = (Node *) linitial(clausefunc->args);
+	b = (Node *) lsecond(clausefunc->args);
+	return (equal(linitial(funcexpr->args), a) &&
+			equal(lsecond(funcexpr->args), b)) ||
+		(equal(linitial(funcexpr->args), b) &&
+		 equal(lsecond(funcexpr->args), a));
+}
+
+/*
+ * edit_distance_clause_function
+ *		The distance function call of a recognised edit-distance clause.
+ */
+static FuncExpr *
+edit_distance_clause_function(Node *clause)
+{
+	if (IsA(clause, NullTest))
+		return (FuncExpr *) ((NullTest *) clause)->arg;
+
+	Assert(IsA(clause, OpExpr));
+	if (IsA(linitial(((OpExpr *) clause)->args), FuncExpr))
+		return (FuncExpr *) linitial(((OpExpr *) clause)->args);
+	return (FuncExpr *) lsecond(((OpExpr *) clause)->args);
+}
+
+/*
+ * peel_edit_distance_operand
+ *		Strip an optional btrim() and an optional explicit varchar(n) cast
+ *		beneath it from a levenshtein() argument.
+ *
+ * Binary-compatible relabelings are stripped as well, so the remaining
+ * expression always yields a text-compatible varlena.
+ */
+static void
+peel_edit_distance_operand(Expr *expr, EditDistanceOperand *operand)
+{
+	operand->truncLen = -1;
+	operand->trim = false;
+
+	while (IsA(expr, RelabelType))
+		expr = ((RelabelType *) expr)->arg;
+
+	if (IsA(expr, FuncExpr) && ((FuncExpr *) expr)->funcid == F_BTRIM1)
+	{
+		operand->trim = true;
+		expr = (Expr *) linitial(((FuncExpr *) expr)->args);
+		while (IsA(expr, RelabelType))
+			expr = ((RelabelType *) expr)->arg;
+	}
+
+	if (IsA(expr, FuncExpr) && ((FuncExpr *) expr)->funcid == F_VARCHAR &&
+		list_length(((FuncExpr *) expr)->args) == 3)
+	{
+		FuncExpr   *coerce = (FuncExpr *) expr;
+		Node	   *typmod = (Node *) lsecond(coerce->args);
+		Node	   *isExplicit = (Node *) lthird(coerce->args);
+
+		/*
+		 * Only an explicit cast silently truncates; an implicit one may
+		 * raise an error, which we leave to the real function.
+		 */
+		if (IsA(typmod, Const) && !((Const *) typmod)->constisnull &&
+			IsA(isExplicit, Const) && !((Const *) isExplicit)->constisnull &&
+			DatumGetBool(((Const *) isExplicit)->constvalue))
+		{
+			int32		maxlen = DatumGetInt32(((Const *) typmod)->constvalue) - VARHDRSZ;
+
+			if (maxlen >= 0)
+			{
+				operand->truncLen = maxlen;
+				expr = (Expr *) linitial(coerce->args);
+				while (IsA(expr, RelabelType))
+					expr = ((RelabelType *) expr)->arg;
+			}
+		}
+	}
+
+	operand->expr = expr;
+}
+
+/*
+ * edit_distance_normalize
+ *		Apply an operand's truncation and trimming to a string datum.
+ *
+ * Returns a pointer into the (detoasted) string and its length in bytes;
+ * nothing is copied.  This mirrors varchar() followed by btrim1(), and byte
+ * level trimming of ' ' is safe because all server encodings are ASCII-safe.
+ */
+const char *
+edit_distance_normalize(const EditDistanceOperand *operand, Datum value,
+						int *len)
+{
+	text	   *t = DatumGetTextPP(value);
+	const char *s = VARDATA_ANY(t);
+	int			slen = VARSIZE_ANY_EXHDR(t);
+
+	if (operand->truncLen >= 0 && slen > operand->truncLen)
+		slen = pg_mbcharcliplen(s, slen, operand->truncLen);
+
+	if (operand->trim)
+	{
+		while (slen > 0 && *s == ' ')
+		{
+			s++;
+			slen--;
+		}
+		while (slen > 0 && s[slen - 1] == ' ')
+			slen--;
+	}
+
+	*len = slen;
+	return s;
+}
+
+/*
+ * edit_distance_signature
+ *		Summarise a normalised string for edit_distance_prefilter().
+ */
+void
+edit_distance_signature(const char *s, int len, EditDistanceSignature *sig)
+{
+	const char *end = s + len;
+	uint32		prev = 0;
+	int			nchars = 0;
+
+	memset(sig, 0, sizeof(EditDistanceSignature));
+
+	while (s < end)
+	{
+		int			clen = pg_mblen(s);
+		uint32		h = 0;
+		int			i;
+
+		for (i = 0; i < clen && s + i < end; i++)
+			h = h * 31 + (unsigned char) s[i];
+		h ^= h >> 5;
+
+		if (sig->chars[h % EDSIG_BUCKETS] < PG_UINT8_MAX)
+			sig->chars[h % EDSIG_BUCKETS]++;
+		if (nchars > 0)
+		{
+			uint32		g = (prev * 0x9E3779B1) ^ h;
+
+			g ^= g >> 16;
+			sig->qgrams[g % EDSIG_BUCKETS]++;
+		}
+
+		prev = h;
+		nchars++;
+		s += clen;
+
+		/* keep the bigram counters from wrapping around */
+		if (nchars >= PG_UINT16_MAX)
+		{
+			sig->length = -1;
+			return;
+		}
+	}
+
+	sig->length = nchars;
+}
+
+/*
+ * edit_distance_prefilter
+ *		Test necessary conditions for distance(a, b) <= maxDistance, cheapest
+ *		first.
+ *
+ * 1. Each edit changes the length by at most one.
+ * 2. Each edit changes the character multiset by at most one insertion and
+ *	  one removal, so the bag distance is a lower bound.
+ * 3. Each edit destroys at most q = 2 of the |s| - 1 bigrams of a string, so
+ *	  the strings share at least max(|a|, |b|) - 1 - 2k bigrams (the count
+ *	  filter of the q-gram lemma).  Summing per-bucket minima over-counts
+ *	  the shared bigrams, which keeps the test safe.
+ */
+EditDistanceFilterResult
+edit_distance_prefilter(const EditDistanceSignature *a,
+						const EditDistanceSignature *b, int maxDistance)
+{
+	int			more = 0;
+	int			less = 0;
+	int			common = 0;
+	int			needed;
+	int			i;
+
+	if (a->length < 0 || b->length < 0)
+		return EDFILTER_PASS;
+
+	if (Abs(a->length - b->length) > maxDistance)
+		return EDFILTER_LENGTH;
+
+	for (i = 0; i < EDSIG_BUCKETS; i++)
+	{
+		int			diff = (int) a->chars[i] - (int) b->chars[i];
+
+		if (diff > 0)
+			more += diff;
+		else
+			less -= diff;
+	}
+	if (Max(more, less) > maxDistance)
+		return EDFILTER_BAG;
+
+	needed = Max(a->length, b->length) - 1 - 2 * maxDistance;
+	if (needed > 0)
+	{
+		for (i = 0; i < EDSIG_BUCKETS; i++)
+			common += Min(a->qgrams[i], b->qgrams[i]);
+		if (common < needed)
+			return EDFILTER_QGRAM;
+	}
+
+	return EDFILTER_PASS;
+}
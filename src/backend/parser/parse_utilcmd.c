@@ -1680,6 +1680,8 @@ generateClonedExtStatsStmt(RangeVar *heapRel, Oid heapRelid,
 			stat_types = lappend(stat_types, makeString("ndistinct"));
 		else if (enabled[i] == STATS_EXT_DEPENDENCIES)
 			stat_types = lappend(stat_types, makeString("dependencies"));
+		else if (enabled[i] == STATS_EXT_BLOCKSKETCH)
+			stat_types = lappend(stat_types, makeString("blocksketch"));
 		else
 			elog(ERROR, "unrecognized statistics kind %c", enabled[i]);
 	}
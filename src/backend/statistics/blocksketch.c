@@ -0,0 +1,326 @@
+/*-------------------------------------------------------------------------
+ *
+ * blocksketch.c
+ *	  POSTGRES per-block sketches of column values
+ *
+ * A block sketch summarises, for each heap block sampled by ANALYZE, the
+ * values each column of the statistics object takes in that block: their
+ * range for integer columns, and a small hash signature for any column whose
+ * type has a hash function.  The planner does not use them; the bandit join
+ * uses them to guess which pages of its arm input join well before it has
+ * read them.
+ *
+ * Portions Copyright (c) 1996-2018, PostgreSQL Global Development Group
+ * Portions Copyright (c) 1994, Regents of the University of California
+ *
+ * IDENTIFICATION
+ *	  src/backend/statistics/blocksketch.c
+ *
+ *-------------------------------------------------------------------------
+ */
+#include "postgres.h"
+
+#include "access/htup_details.h"
+#include "catalog/pg_class.h"
+#include "catalog/pg_statistic_ext.h"
+#include "catalog/pg_type.h"
+#include "statistics/extended_stats_internal.h"
+#include "statistics/statistics.h"
+#include "storage/bufmgr.h"
+#include "storage/procarray.h"
+#include "utils/memutils.h"
+#include "utils/rel.h"
+#include "utils/syscache.h"
+#include "utils/tqual.h"
+#include "utils/typcache.h"
+
+
+static void sketch_block(Relation onerel, BlockNumber block,
+			 TransactionId OldestXmin, BufferAccessStrategy strategy,
+			 MVBlockSketch *sketch, MVBlockSketchItem *item,
+			 FmgrInfo **hashprocs, Oid *collations);
+
+
+/*
+ * Compute the block sketch of the columns attrs, over the heap blocks the
+ * sample rows came from.
+ *
+ * The sample holds a few rows of each block at best, so each block is read
+ * again and summarised in full, counting the rows ANALYZE would count as
+ * live.  The sample rows are in physical order, and the blocks were read just
+ * now, so this mostly rereads shared buffers.  When the sample spans more
+ * than STATS_BLOCKSKETCH_MAX_BLOCKS blocks, every few of them is sketched.
+ *
+ * Only plain tables and materialized views have heap blocks to sketch; for
+ * others, NULL is returned and nothing is stored.
+ */
+MVBlockSketch *
+statext_blocksketch_build(Relation onerel, int numrows, HeapTuple *rows,
+						  Bitmapset *attrs, VacAttrStats **stats)
+{
+	MVBlockSketch *sketch;
+	BlockNumber *blocks;
+	int			nblocks = 0;
+	int			stride;
+	int			ncolumns = bms_num_members(attrs);
+	FmgrInfo  **hashprocs;
+	Oid		   *collations;
+	TransactionId OldestXmin;
+	BufferAccessStrategy strategy;
+	MemoryContext cxt;
+	MemoryContext oldcxt;
+	int			i;
+	int			k;
+
+	if (onerel->rd_rel->relkind != RELKIND_RELATION &&
+		onerel->rd_rel->relkind != RELKIND_MATVIEW)
+		return NULL;
+
+	/* the distinct blocks of the sample, which is sorted by t_self */
+	blocks = (BlockNumber *) palloc(Max(numrows, 1) * sizeof(BlockNumber));
+	for (i = 0; i < numrows; i++)
+	{
+		BlockNumber block = ItemPointerGetBlockNumber(&rows[i]->t_self);
+
+		if (nblocks == 0 || blocks[nblocks - 1] != block)
+			blocks[nblocks++] = block;
+	}
+	stride = (nblocks + STATS_BLOCKSKETCH_MAX_BLOCKS - 1) / STATS_BLOCKSKETCH_MAX_BLOCKS;
+	stride = Max(stride, 1);
+
+	sketch = (MVBlockSketch *) palloc0(SizeOfBlockSketch +
+									   ((nblocks + stride - 1) / stride) *
+									   SizeOfBlockSketchItem(ncolumns));
+	sketch->magic = STATS_BLOCKSKETCH_MAGIC;
+	sketch->type = STATS_BLOCKSKETCH_TYPE_BASIC;
+	sketch->ncolumns = ncolumns;
+	k = -1;
+	i = 0;
+	while ((k = bms_next_member(attrs, k)) >= 0)
+		sketch->attnums[i++] = k;
+
+	/* the hash function of each column, if its type has one */
+	hashprocs = (FmgrInfo **) palloc0(ncolumns * sizeof(FmgrInfo *));
+	collations = (Oid *) palloc(ncolumns * sizeof(Oid));
+	for (i = 0; i < ncolumns; i++)
+	{
+		TypeCacheEntry *type = lookup_type_cache(stats[i]->attrtypid,
+												 TYPECACHE_HASH_PROC_FINFO);
+
+		if (OidIsValid(type->hash_proc_finfo.fn_oid))
+			hashprocs[i] = &type->hash_proc_finfo;
+		collations[i] = stats[i]->attr->attcollation;
+	}
+
+	OldestXmin = GetOldestXmin(onerel, PROCARRAY_FLAGS_VACUUM);
+	strategy = GetAccessStrategy(BAS_BULKREAD);
+	cxt = AllocSetContextCreate(CurrentMemoryContext,
+								"block sketch",
+								ALLOCSET_DEFAULT_SIZES);
+	for (i = 0; i < nblocks; i += stride)
+	{
+		MVBlockSketchItem *item = BlockSketchGetItem(sketch, sketch->nblocks);
+
+		vacuum_delay_point();
+
+		oldcxt = MemoryContextSwitchTo(cxt);
+		sketch_block(onerel, blocks[i], OldestXmin, strategy,
+					 sketch, item, hashprocs, collations);
+		MemoryContextSwitchTo(oldcxt);
+		MemoryContextReset(cxt);
+
+		sketch->nblocks++;
+	}
+	MemoryContextDelete(cxt);
+	FreeAccessStrategy(strategy);
+	pfree(blocks);
+	pfree(hashprocs);
+	pfree(collations);
+
+	return sketch;
+}
+
+/*
+ * Summarise the live rows of one heap block into item.  They are copied out
+ * of the buffer first, so that hashing values that need detoasting does not
+ * happen under the buffer lock.
+ */
+static void
+sketch_block(Relation onerel, BlockNumber block,
+			 TransactionId OldestXmin, BufferAccessStrategy strategy,
+			 MVBlockSketch *sketch, MVBlockSketchItem *item,
+			 FmgrInfo **hashprocs, Oid *collations)
+{
+	TupleDesc	tupdesc = RelationGetDescr(onerel);
+	HeapTuple  *tuples;
+	int			ntuples = 0;
+	Buffer		buffer;
+	Page		page;
+	OffsetNumber offnum;
+	OffsetNumber maxoff;
+	int			i;
+	int			j;
+
+	item->block = block;
+	item->nrows = 0;
+
+	buffer = ReadBufferExtended(onerel, MAIN_FORKNUM, block, RBM_NORMAL,
+								strategy);
+	LockBuffer(buffer, BUFFER_LOCK_SHARE);
+	page = BufferGetPage(buffer);
+	maxoff = PageGetMaxOffsetNumber(page);
+	tuples = (HeapTuple *) palloc(Max(maxoff, 1) * sizeof(HeapTuple));
+	for (offnum = FirstOffsetNumber; offnum <= maxoff; offnum++)
+	{
+		ItemId		itemid = PageGetItemId(page, offnum);
+		HeapTupleData tuple;
+
+		if (!ItemIdIsNormal(itemid))
+			continue;
+
+		ItemPointerSet(&tuple.t_self, block, offnum);
+		tuple.t_tableOid = RelationGetRelid(onerel);
+		tuple.t_data = (HeapTupleHeader) PageGetItem(page, itemid);
+		tuple.t_len = ItemIdGetLength(itemid);
+
+		if (HeapTupleSatisfiesVacuum(&tuple, OldestXmin, buffer) == HEAPTUPLE_LIVE)
+			tuples[ntuples++] = heap_copytuple(&tuple);
+	}
+	UnlockReleaseBuffer(buffer);
+
+	item->nrows = ntuples;
+	for (j = 0; j < sketch->ncolumns; j++)
+	{
+		MVBlockSketchColumn *column = &item->columns[j];
+		AttrNumber	attnum = sketch->attnums[j];
+		Oid			typid = TupleDescAttr(tupdesc, attnum - 1)->atttypid;
+		bool		isint = (typid == INT2OID || typid == INT4OID ||
+							 typid == INT8OID);
+
+		column->hasHashes = (hashprocs[j] != NULL);
+		for (i = 0; i < ntuples; i++)
+		{
+			bool		isnull;
+			Datum		value = heap_getattr(tuples[i], attnum, tupdesc, &isnull);
+
+			if (isnull)
+				continue;
+
+			if (isint)
+			{
+				int64		v;
+
+				if (typid == INT2OID)
+					v = DatumGetInt16(value);
+				else if (typid == INT4OID)
+					v = DatumGetInt32(value);
+				else
+					v = DatumGetInt64(value);
+
+				if (!column->hasRange || v < column->min)
+					column->min = v;
+				if (!column->hasRange || v > column->max)
+					column->max = v;
+				column->hasRange = true;
+			}
+
+			if (hashprocs[j] != NULL)
+			{
+				uint32		bit;
+
+				bit = DatumGetUInt32(FunctionCall1Coll(hashprocs[j],
+													   collations[j],
+													   value)) % STATS_BLOCKSKETCH_BITS;
+				column->signature[bit / 32] |= ((uint32) 1 << (bit % 32));
+			}
+		}
+	}
+}
+
+/*
+ * Serialize a block sketch into a bytea value.  The items are stored as they
+ * are in memory.
+ */
+bytea *
+statext_blocksketch_serialize(MVBlockSketch *sketch)
+{
+	Size		len;
+	bytea	   *output;
+
+	len = SizeOfBlockSketch +
+		sketch->nblocks * SizeOfBlockSketchItem(sketch->ncolumns);
+	output = (bytea *) palloc(VARHDRSZ + len);
+	SET_VARSIZE(output, VARHDRSZ + len);
+	memcpy(VARDATA(output), sketch, len);
+
+	return output;
+}
+
+/*
+ * Reads a serialized block sketch into an MVBlockSketch structure.
+ */
+MVBlockSketch *
+statext_blocksketch_deserialize(bytea *data)
+{
+	MVBlockSketch *sketch;
+	Size		expected_size;
+
+	if (data == NULL)
+		return NULL;
+
+	if (VARSIZE_ANY_EXHDR(data) < SizeOfBlockSketch)
+		elog(ERROR, "invalid MVBlockSketch size %zd (expected at least %zd)",
+			 VARSIZE_ANY_EXHDR(data), SizeOfBlockSketch);
+
+	/* copy the data, which also aligns it */
+	sketch = (MVBlockSketch *) palloc(VARSIZE_ANY_EXHDR(data));
+	memcpy(sketch, VARDATA_ANY(data), VARSIZE_ANY_EXHDR(data));
+
+	if (sketch->magic != STATS_BLOCKSKETCH_MAGIC)
+		elog(ERROR, "invalid block sketch magic %08x (expected %08x)",
+			 sketch->magic, STATS_BLOCKSKETCH_MAGIC);
+	if (sketch->type != STATS_BLOCKSKETCH_TYPE_BASIC)
+		elog(ERROR, "invalid block sketch type %d (expected %d)",
+			 sketch->type, STATS_BLOCKSKETCH_TYPE_BASIC);
+	if (sketch->ncolumns < 1 || sketch->ncolumns > STATS_MAX_DIMENSIONS)
+		elog(ERROR, "invalid number of columns in block sketch: %u",
+			 sketch->ncolumns);
+
+	expected_size = SizeOfBlockSketch +
+		sketch->nblocks * SizeOfBlockSketchItem(sketch->ncolumns);
+	if (VARSIZE_ANY_EXHDR(data) != expected_size)
+		elog(ERROR, "invalid block sketch size %zd (expected %zd)",
+			 VARSIZE_ANY_EXHDR(data), expected_size);
+
+	return sketch;
+}
+
+/*
+ * statext_blocksketch_load
+ *		Load the block sketch for the indicated pg_statistic_ext tuple
+ */
+MVBlockSketch *
+statext_blocksketch_load(Oid mvoid)
+{
+	MVBlockSketch *result;
+	bool		isnull;
+	Datum		sketch;
+	HeapTuple	htup;
+
+	htup = SearchSysCache1(STATEXTOID, ObjectIdGetDatum(mvoid));
+	if (!HeapTupleIsValid(htup))
+		elog(ERROR, "cache lookup failed for statistics object %u", mvoid);
+
+	sketch = SysCacheGetAttr(STATEXTOID, htup,
+							 Anum_pg_statistic_ext_stxblocksketch, &isnull);
+	if (isnull)
+		elog(ERROR,
+			 "requested statistic kind \"%c\" is not yet built for statistics object %u",
+			 STATS_EXT_BLOCKSKETCH, mvoid);
+
+	result = statext_blocksketch_deserialize(DatumGetByteaPP(sketch));
+
+	ReleaseSysCache(htup);
+
+	return result;
+}
@@ -9,7 +9,8 @@
  * Levenshtein distance with custom costings, and (2) Levenshtein distance with
  * custom costings and a "max" value above which exact distances are not
  * interesting.  Before the inclusion, we rely on the presence of the inline
- * function rest_of_char_same().
+ * function rest_of_char_same().  Each variant also has a "_prepared" entry
+ * point taking a source string already run through varstr_levenshtein_prepare().
  *
  * Written based on a description of the algorithm by Michael Gilleland found
  * at http://www.merriampark.com/ld.htm.  Also looked at levenshtein.c in the
@@ -23,8 +24,6 @@
  *
  *-------------------------------------------------------------------------
  */
-#define MAX_LEVENSHTEIN_STRLEN		255
-
 /*
  * Calculates Levenshtein distance metric between supplied strings, which are
  * not necessarily null-terminated.
@@ -36,6 +35,9 @@
  *		cases, but your mileage may vary.
  * max_d: if provided and >= 0, maximum distance we care about; see below.
  * trusted: caller is trusted and need not obey MAX_LEVENSHTEIN_STRLEN.
+ * prepared: if not NULL, the result of varstr_levenshtein_prepare() for
+ *		source, whose character lengths and row buffers are used instead of
+ *		being computed and allocated here.
  *
  * One way to compute Levenshtein distance is to incrementally construct
  * an (m+1)x(n+1) matrix where cell (i, j) represents the minimum number
@@ -63,17 +65,20 @@
  * identify the portion of the matrix close to the diagonal which can still
  * affect the final answer.
  */
-int
 #ifdef LEVENSHTEIN_LESS_EQUAL
-varstr_levenshtein_less_equal(const char *source, int slen,
-							  const char *target, int tlen,
-							  int ins_c, int del_c, int sub_c,
-							  int max_d, bool trusted)
+static inline int
+levenshtein_less_equal_internal(const char *source, int slen,
+								const LevenshteinSource *prepared,
+								const char *target, int tlen,
+								int ins_c, int del_c, int sub_c,
+								int max_d, bool trusted)
 #else
-varstr_levenshtein(const char *source, int slen,
-				   const char *target, int tlen,
-				   int ins_c, int del_c, int sub_c,
-				   bool trusted)
+static inline int
+levenshtein_internal(const char *source, int slen,
+					 const LevenshteinSource *prepared,
+					 const char *target, int tlen,
+					 int ins_c, int del_c, int sub_c,
+					 bool trusted)
 #endif
 {
 	int			m,
@@ -106,7 +111,7 @@ varstr_levenshtein(const char *source, int slen,
 #endif
 
 	/* Convert string lengths (in bytes) to lengths in characters */
-	m = pg_mbstrlen_with_len(source, slen);
+	m = prepared ? prepared->m : pg_mbstrlen_with_len(source, slen);
 	n = pg_mbstrlen_with_len(target, tlen);
 
 	/*
@@ -191,7 +196,9 @@ varstr_levenshtein(const char *source, int slen,
 	 * multi-byte characters, we still build the array, so that the fast-path
 	 * needn't deal with the case where the array hasn't been initialized.
 	 */
-	if (m != slen || n != tlen)
+	if ((m != slen || n != tlen) && prepared != NULL)
+		s_char_len = prepared->char_len;
+	else if (m != slen || n != tlen)
 	{
 		int			i;
 		const char *cp = source;
@@ -210,7 +217,7 @@ varstr_levenshtein(const char *source, int slen,
 	++n;
 
 	/* Previous and current rows of notional array. */
-	prev = (int *) palloc(2 * m * sizeof(int));
+	prev = prepared ? prepared->rows : (int *) palloc(2 * m * sizeof(int));
 	curr = prev + m;
 
 	/*
@@ -399,3 +406,53 @@ varstr_levenshtein(const char *source, int slen,
 	 */
 	return prev[m - 1];
 }
+
+#ifdef LEVENSHTEIN_LESS_EQUAL
+int
+varstr_levenshtein_less_equal(const char *source, int slen,
+							  const char *target, int tlen,
+							  int ins_c, int del_c, int sub_c,
+							  int max_d, bool trusted)
+{
+	return levenshtein_less_equal_internal(source, slen, NULL,
+										   target, tlen,
+										   ins_c, del_c, sub_c,
+										   max_d, trusted);
+}
+
+int
+varstr_levenshtein_less_equal_prepared(const LevenshteinSource *source,
+									   const char *target, int tlen,
+									   int ins_c, int del_c, int sub_c,
+									   int max_d, bool trusted)
+{
+	return levenshtein_less_equal_internal(source->str, source->slen, source,
+										   target, tlen,
+										   ins_c, del_c, sub_c,
+										   max_d, trusted);
+}
+#else
+int
+varstr_levenshtein(const char *source, int slen,
+				   const char *target, int tlen,
+				   int ins_c, int del_c, int sub_c,
+				   bool trusted)
+{
+	return levenshtein_internal(source, slen, NULL,
+								target, tlen,
+								ins_c, del_c, sub_c,
+								trusted);
+}
+
+int
+varstr_levenshtein_prepared(const LevenshteinSource *source,
+							const char *target, int tlen,
+							int ins_c, int del_c, int sub_c,
+							bool trusted)
+{
+	return levenshtein_internal(source->str, source->slen, source,
+								target, tlen,
+								ins_c, del_c, sub_c,
+								trusted);
+}
+#endif
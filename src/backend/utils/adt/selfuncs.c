@@ -153,6 +153,33 @@
 #include "utils/varlena.h"
 
 
+/*
+ * Values standing for one operand of an edit-distance clause in
+ * edit_distance_selectivity.  values[0 .. nmcv - 1] are distinct common
+ * values, the others are histogram bounds drawn from the remaining rows.
+ * Weights are fractions of all rows, nulls included.
+ */
+typedef struct EditDistanceSample
+{
+	int			nvalues;
+	int			nmcv;
+	const char **values;		/* normalised, not null-terminated */
+	int		   *bytes;
+	int		   *chars;
+	double	   *weights;
+	double		restfrac;		/* fraction of non-null rows not in MCVs */
+	double		restdistinct;	/* number of distinct values among them */
+} EditDistanceSample;
+
+/*
+ * At most this many most common values and histogram bounds per operand are
+ * compared, so that a high statistics target does not cost more than
+ * (EDSEL_MCV_SAMPLES + EDSEL_HIST_SAMPLES)^2 distance computations per
+ * clause.  Less common values beyond the limit count among the other rows.
+ */
+#define EDSEL_MCV_SAMPLES	100
+#define EDSEL_HIST_SAMPLES	50
+
 /* Hooks for plugins to get control when we ask for stats */
 get_relation_stats_hook_type get_relation_stats_hook = NULL;
 get_index_stats_hook_type get_index_stats_hook = NULL;
@@ -168,6 +195,12 @@ static double ineq_histogram_selectivity(PlannerInfo *root,
 						   VariableStatData *vardata,
 						   FmgrInfo *opproc, bool isgt, bool iseq,
 						   Datum constval, Oid consttype);
+static bool edit_distance_sample(PlannerInfo *root,
+					 EditDistanceOperand *operand, int varRelid,
+					 EditDistanceSample *sample);
+static void edit_distance_sample_value(EditDistanceSample *sample,
+						   EditDistanceOperand *operand, Datum value,
+						   double weight);
 static double eqjoinsel_inner(Oid operator,
 				VariableStatData *vardata1, VariableStatData *vardata2);
 static double eqjoinsel_semi(Oid operator,
@@ -2287,6 +2320,211 @@ rowcomparesel(PlannerInfo *root,
 	return s1;
 }
 
+/*
+ *		edit_distance_selectivity	- Selectivity of an edit-distance clause
+ *
+ * The clause, "levenshtein(a, b) <= k" or an equivalent recognised by
+ * match_edit_distance_clause, has no operator of its own to estimate it, and
+ * the default inequality selectivity is orders of magnitude too high.  We
+ * compare the values that the statistics of a and b offer instead: their
+ * most common values, weighted by frequency, and a sample of their
+ * histogram bounds, each standing for an equal share of the other rows.  A
+ * constant operand is a single value.
+ *
+ * Pairs of equal values are rare among histogram bounds even if the columns
+ * share many values, so equality involving the non-MCV rows is estimated
+ * from the numbers of distinct values, as eqjoinsel does; the bounds only
+ * estimate the near matches.  This serves restriction and join clauses
+ * alike.
+ */
+Selectivity
+edit_distance_selectivity(PlannerInfo *root, EditDistanceClause *edc,
+						  int varRelid)
+{
+	EditDistanceSample a;
+	EditDistanceSample b;
+	int			k = edc->maxDistance;
+	double		selec = 0.0;
+	int			i;
+	int			j;
+
+	if (k < 0)
+		return 0.0;
+
+	if (!edit_distance_sample(root, &edc->args[0], varRelid, &a) ||
+		!edit_distance_sample(root, &edc->args[1], varRelid, &b))
+		return Min(DEFAULT_EQ_SEL * (k + 1), 1.0);
+
+	for (i = 0; i < a.nvalues; i++)
+	{
+		bool		mcvmatch = false;
+
+		for (j = 0; j < b.nvalues; j++)
+		{
+			bool		equal;
+
+			if (abs(a.chars[i] - b.chars[j]) > k)
+				continue;
+			equal = (a.bytes[i] == b.bytes[j] &&
+					 memcmp(a.values[i], b.values[j], a.bytes[i]) == 0);
+
+			if (i < a.nmcv && j < b.nmcv)
+			{
+				/* both are common values: the pair is exact */
+				if (equal)
+					mcvmatch = true;
+				else if (varstr_levenshtein_less_equal(a.values[i], a.bytes[i],
+													   b.values[j], b.bytes[j],
+													   1, 1, 1, k, true) > k)
+					continue;
+				selec += a.weights[i] * b.weights[j];
+			}
+			else if (!equal &&
+					 varstr_levenshtein_less_equal(a.values[i], a.bytes[i],
+												   b.values[j], b.bytes[j],
+												   1, 1, 1, k, true) <= k)
+				selec += a.weights[i] * b.weights[j];
+		}
+
+		/* a common value of a may be among the other rows of b */
+		if (i < a.nmcv && !mcvmatch)
+			selec += a.weights[i] * b.restfrac / b.restdistinct;
+	}
+
+	for (j = 0; j < b.nmcv; j++)
+	{
+		for (i = 0; i < a.nmcv; i++)
+		{
+			if (a.bytes[i] == b.bytes[j] &&
+				memcmp(a.values[i], b.values[j], a.bytes[i]) == 0)
+				break;
+		}
+		if (i == a.nmcv)
+			selec += b.weights[j] * a.restfrac / a.restdistinct;
+	}
+
+	selec += a.restfrac * b.restfrac / Max(a.restdistinct, b.restdistinct);
+
+	CLAMP_PROBABILITY(selec);
+	return selec;
+}
+
+/*
+ * Collect the values standing for an edit-distance operand, or return false
+ * if there is nothing to go by.
+ */
+static bool
+edit_distance_sample(PlannerInfo *root, EditDistanceOperand *operand,
+					 int varRelid, EditDistanceSample *sample)
+{
+	Node	   *expr = estimate_expression_value(root, (Node *) operand->expr);
+	VariableStatData vardata;
+	AttStatsSlot mcvslot;
+	AttStatsSlot histslot;
+	bool		havemcv;
+	bool		havehist;
+	double		nullfrac;
+	double		mcvfrac = 0.0;
+	double		ndistinct;
+	bool		isdefault;
+	int			nmcv;
+	int			nhist;
+	int			i;
+
+	memset(sample, 0, sizeof(EditDistanceSample));
+
+	if (IsA(expr, Const))
+	{
+		Const	   *con = (Const *) expr;
+
+		sample->values = palloc(sizeof(char *));
+		sample->bytes = palloc(sizeof(int));
+		sample->chars = palloc(sizeof(int));
+		sample->weights = palloc(sizeof(double));
+		sample->restdistinct = 1;
+		if (!con->constisnull)
+		{
+			edit_distance_sample_value(sample, operand, con->constvalue, 1.0);
+			sample->nmcv = 1;
+		}
+		return true;
+	}
+
+	examine_variable(root, expr, varRelid, &vardata);
+	if (!HeapTupleIsValid(vardata.statsTuple) ||
+		(vardata.atttype != TEXTOID && vardata.atttype != VARCHAROID) ||
+		!statistic_proc_security_check(&vardata, F_TEXTEQ))
+	{
+		ReleaseVariableStats(vardata);
+		return false;
+	}
+
+	nullfrac = ((Form_pg_statistic) GETSTRUCT(vardata.statsTuple))->stanullfrac;
+	havemcv = get_attstatsslot(&mcvslot, vardata.statsTuple,
+							   STATISTIC_KIND_MCV, InvalidOid,
+							   ATTSTATSSLOT_VALUES | ATTSTATSSLOT_NUMBERS);
+	havehist = get_attstatsslot(&histslot, vardata.statsTuple,
+								STATISTIC_KIND_HISTOGRAM, InvalidOid,
+								ATTSTATSSLOT_VALUES);
+	ndistinct = get_variable_numdistinct(&vardata, &isdefault);
+
+	/* the MCVs are stored most common first */
+	nmcv = havemcv ? Min(mcvslot.nvalues, EDSEL_MCV_SAMPLES) : 0;
+	nhist = havehist ? Min(histslot.nvalues, EDSEL_HIST_SAMPLES) : 0;
+	sample->values = palloc((nmcv + nhist + 1) * sizeof(char *));
+	sample->bytes = palloc((nmcv + nhist + 1) * sizeof(int));
+	sample->chars = palloc((nmcv + nhist + 1) * sizeof(int));
+	sample->weights = palloc((nmcv + nhist + 1) * sizeof(double));
+
+	for (i = 0; i < nmcv; i++)
+	{
+		edit_distance_sample_value(sample, operand, mcvslot.values[i],
+								   mcvslot.numbers[i]);
+		mcvfrac += mcvslot.numbers[i];
+	}
+	sample->nmcv = nmcv;
+
+	sample->restfrac = Max(1.0 - nullfrac - mcvfrac, 0.0);
+	sample->restdistinct = Max(ndistinct - sample->nmcv, 1.0);
+
+	/*
+	 * Evenly spaced bounds, each standing for an equal share of the rest.
+	 * Without a histogram, the other rows only take part in equality.
+	 */
+	for (i = 0; i < nhist; i++)
+		edit_distance_sample_value(sample, operand,
+								   histslot.values[(int) ((double) i * histslot.nvalues / nhist)],
+								   sample->restfrac / nhist);
+
+	if (havemcv)
+		free_attstatsslot(&mcvslot);
+	if (havehist)
+		free_attstatsslot(&histslot);
+	ReleaseVariableStats(vardata);
+
+	return sample->nvalues > 0 || sample->restfrac > 0;
+}
+
+/*
+ * Add one value, normalised as the clause would, to an operand's sample.
+ * The value is copied, as the statistics it comes from are released.
+ */
+static void
+edit_distance_sample_value(EditDistanceSample *sample,
+						   EditDistanceOperand *operand, Datum value,
+						   double weight)
+{
+	int			n = sample->nvalues++;
+	const char *str;
+	int			len;
+
+	str = edit_distance_normalize(operand, value, &len);
+	sample->values[n] = pnstrdup(str, len);
+	sample->bytes[n] = len;
+	sample->chars[n] = pg_mbstrlen_with_len(str, len);
+	sample->weights[n] = weight;
+}
+
 /*
  *		eqjoinsel		- Join selectivity of "="
  */
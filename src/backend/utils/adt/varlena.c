@@ -5614,3 +5614,58 @@ rest_of_char_same(const char *s1, const char *s2, int len)
 #include "levenshtein.c"
 #define LEVENSHTEIN_LESS_EQUAL
 #include "levenshtein.c"
+
+/*
+ * varstr_levenshtein_prepare
+ *		Preprocess a Levenshtein source string that is going to be compared
+ *		against many targets.
+ *
+ * The string is copied, and the byte length of each of its characters and
+ * the work rows needed by the distance computation are set up front.  *src
+ * must be zeroed before its first use; after that, buffers allocated by an
+ * earlier call are reused whenever they are large enough, so all calls for
+ * one LevenshteinSource must happen in the same memory context.
+ */
+void
+varstr_levenshtein_prepare(LevenshteinSource *src, const char *source,
+						   int slen)
+{
+	const char *cp;
+	int			m;
+	int			i;
+
+	if (src->str == NULL)
+	{
+		src->str_space = Max(slen, 16);
+		src->str = palloc(src->str_space);
+	}
+	else if (slen > src->str_space)
+	{
+		src->str_space = Max(slen, 2 * src->str_space);
+		src->str = repalloc(src->str, src->str_space);
+	}
+	memcpy(src->str, source, slen);
+	src->slen = slen;
+
+	m = pg_mbstrlen_with_len(source, slen);
+	if (src->char_len == NULL)
+	{
+		src->char_space = Max(m + 1, 16);
+		src->char_len = palloc(src->char_space * sizeof(int));
+		src->rows = palloc(2 * src->char_space * sizeof(int));
+	}
+	else if (m + 1 > src->char_space)
+	{
+		src->char_space = Max(m + 1, 2 * src->char_space);
+		src->char_len = repalloc(src->char_len, src->char_space * sizeof(int));
+		src->rows = repalloc(src->rows, 2 * src->char_space * sizeof(int));
+	}
+	src->m = m;
+
+	for (cp = source, i = 0; i < m; i++)
+	{
+		src->char_len[i] = pg_mblen(cp);
+		cp += src->char_len[i];
+	}
+	src->char_len[m] = 0;
+}
@@ -944,6 +944,123 @@ static struct config_bool ConfigureNamesBool[] =
 		false,
 		NULL, NULL, NULL
 	},
+	{
+		{"enable_fusedlevenshtein", PGC_USERSET, QUERY_TUNING_METHOD,
+			gettext_noop("Evaluates levenshtein() threshold predicates with a fused, bounded step."),
+			NULL
+		},
+		&enable_fusedlevenshtein,
+		true,
+		NULL, NULL, NULL
+	},
+	{
+		{"enable_levenshteinfilter", PGC_USERSET, QUERY_TUNING_METHOD,
+			gettext_noop("Enables length, bag and q-gram prefilters for levenshtein() join clauses in paged nested loops."),
+			NULL
+		},
+		&enable_levenshteinfilter,
+		true,
+		NULL, NULL, NULL
+	},
+	{
+		{"enable_dedupjoin", PGC_USERSET, QUERY_TUNING_METHOD,
+			gettext_noop("Enables similarity joins that compare each pair of distinct levenshtein() join keys once."),
+			NULL
+		},
+		&enable_dedupjoin,
+		false,
+		NULL, NULL, NULL
+	},
+	{
+		{"enable_passjoin", PGC_USERSET, QUERY_TUNING_METHOD,
+			gettext_noop("Enables partition-based (PassJoin) candidate generation for levenshtein() similarity joins."),
+			NULL
+		},
+		&enable_passjoin,
+		false,
+		NULL, NULL, NULL
+	},
+	{
+		{"enable_lshjoin", PGC_USERSET, QUERY_TUNING_METHOD,
+			gettext_noop("Enables approximate MinHash/LSH candidate generation for levenshtein() similarity joins."),
+			gettext_noop("Such joins may miss matching rows; EXPLAIN ANALYZE shows an estimate of the fraction found.")
+		},
+		&enable_lshjoin,
+		false,
+		NULL, NULL, NULL
+	},
+	{
+		{"enable_lengthbuckets", PGC_USERSET, QUERY_TUNING_METHOD,
+			gettext_noop("Enables length-bucketed inner pages for levenshtein() join clauses in paged nested loops."),
+			NULL
+		},
+		&enable_lengthbuckets,
+		true,
+		NULL, NULL, NULL
+	},
+	{
+		{"enable_innerpageorder", PGC_USERSET, QUERY_TUNING_METHOD,
+			gettext_noop("Enables visiting length-bucketed inner pages in order of their observed yield."),
+			NULL
+		},
+		&enable_innerpageorder,
+		true,
+		NULL, NULL, NULL
+	},
+	{
+		{"enable_progressivejoin", PGC_USERSET, QUERY_TUNING_METHOD,
+			gettext_noop("Enables similarity joins that return their rows by increasing edit distance."),
+			NULL
+		},
+		&enable_progressivejoin,
+		true,
+		NULL, NULL, NULL
+	},
+	{
+		{"enable_costawarebandit", PGC_USERSET, QUERY_TUNING_METHOD,
+			gettext_noop("Enables ranking bandit join pages by rows per unit of work rather than by rows."),
+			NULL
+		},
+		&enable_costawarebandit,
+		false,
+		NULL, NULL, NULL
+	},
+	{
+		{"enable_adaptiveactiveset", PGC_USERSET, QUERY_TUNING_METHOD,
+			gettext_noop("Enables sizing the bandit join's active set from the rewards observed."),
+			NULL
+		},
+		&enable_adaptiveactiveset,
+		false,
+		NULL, NULL, NULL
+	},
+	{
+		{"enable_adaptiveflip", PGC_USERSET, QUERY_TUNING_METHOD,
+			gettext_noop("Enables bandit joins to choose at runtime which input's pages are the arms."),
+			NULL
+		},
+		&enable_adaptiveflip,
+		false,
+		NULL, NULL, NULL
+	},
+	{
+		{"enable_adaptiveblock", PGC_USERSET, QUERY_TUNING_METHOD,
+			gettext_noop("Enables bandit joins to switch to a block nested loop when page rewards are uniform."),
+			NULL
+		},
+		&enable_adaptiveblock,
+		false,
+		NULL, NULL, NULL
+	},
+	{
+		{"enable_banditsketches", PGC_USERSET, QUERY_TUNING_METHOD,
+			gettext_noop("Enables bandit joins to explore first the pages that block sketches predict to join well."),
+			NULL
+		},
+		&enable_banditsketches,
+		true,
+		NULL, NULL, NULL
+	},
 	{
 		{"enable_gathermerge", PGC_USERSET, QUERY_TUNING_METHOD,
 			gettext_noop("Enables the planner's use of gather merge plans."),
@@ -1924,6 +2041,48 @@ static struct config_int ConfigureNamesInt[] =
 		8, 1, INT_MAX,
 		NULL, NULL, NULL
 	},
+	{
+		{"bandit_explore_seed", PGC_USERSET, QUERY_TUNING_OTHER,
+			gettext_noop("Sets the seed of the order in which a bandit join explores outer pages."),
+			gettext_noop("Zero explores the outer pages in order; any other value "
+						 "explores them in a pseudo-random order drawn from this seed.")
+		},
+		&bandit_explore_seed,
+		0, 0, INT_MAX,
+		NULL, NULL, NULL
+	},	{
+		{"bandit_explore_sample_pages", PGC_USERSET, QUERY_TUNING_OTHER,
+			gettext_noop("Sets the pages of the other input a bandit join explores its pages against."),
+			gettext_noop("Explored pages are joined with a random sample of this many pages "
+						 "only, and joined in full when exploited. Zero explores by joining.")
+		},
+		&bandit_explore_sample_pages,
+		0, 0, 1024,
+		NULL, NULL, NULL
+	},	{
+		{"bandit_extent_pages", PGC_USERSET, QUERY_TUNING_OTHER,
+			gettext_noop("Sets the outer pages per extent a bandit join explores first."),
+			gettext_noop("The bandit probes one page of each extent, then explores the "
+						 "pages of the extents that score best. Zero explores pages directly.")
+		},
+		&bandit_extent_pages,
+		0, 0, INT_MAX / 4,
+		NULL, NULL, NULL
+	},
+
+
+	{
+		{"bandit_join_deadline", PGC_USERSET, QUERY_TUNING_OTHER,
+			gettext_noop("Sets the time after which a bandit join stops returning rows."),
+			gettext_noop("The join ends with a notice rather than an error, and "
+						 "spends the time on the outer pages that yield rows fastest. "
+						 "Zero means no deadline."),
+			GUC_UNIT_MS
+		},
+		&bandit_join_deadline,
+		0, 0, INT_MAX,
+		NULL, NULL, NULL
+	},
 	{
 		{"geqo_threshold", PGC_USERSET, QUERY_TUNING_GEQO,
 			gettext_noop("Sets the threshold of FROM items beyond which GEQO is used."),
@@ -3378,6 +3537,19 @@ static struct config_string ConfigureNamesString[] =
 		check_temp_tablespaces, assign_temp_tablespaces, NULL
 	},
 
+	{
+		{"similarity_join_blocking_keys", PGC_USERSET, QUERY_TUNING_METHOD,
+			gettext_noop("Sets the functions computing blocking keys for levenshtein() similarity joins."),
+			gettext_noop("Each must take and return text, like soundex or dmetaphone. Only keys "
+						 "sharing a blocking key are compared, so such joins may miss matching "
+						 "rows. An empty string disables blocking."),
+			GUC_LIST_INPUT
+		},
+		&similarity_join_blocking_keys,
+		"",
+		NULL, NULL, NULL
+	},
+
 	{
 		{"dynamic_library_path", PGC_SUSET, CLIENT_CONN_OTHER,
 			gettext_noop("Sets the path for dynamically loadable modules."),
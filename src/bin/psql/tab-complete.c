@@ -2702,7 +2702,7 @@ psql_completion(const char *text, int start, int end)
 	else if (Matches3("CREATE", "STATISTICS", MatchAny))
 		COMPLETE_WITH_LIST2("(", "ON");
 	else if (Matches4("CREATE", "STATISTICS", MatchAny, "("))
-		COMPLETE_WITH_LIST2("ndistinct", "dependencies");
+		COMPLETE_WITH_LIST3("ndistinct", "dependencies", "blocksketch");
 	else if (HeadMatches3("CREATE", "STATISTICS", MatchAny) &&
 			 previous_words[0][0] == '(' &&
 			 previous_words[0][strlen(previous_words[0]) - 1] == ')')
@@ -169,6 +169,9 @@ typedef enum ExprEvalOp
 	/* evaluate GREATEST() or LEAST() */
 	EEOP_MINMAX,
 
+	/* evaluate a levenshtein(a, b) <= k predicate with a bounded distance */
+	EEOP_EDIT_DISTANCE,
+
 	/* evaluate FieldSelect expression */
 	EEOP_FIELDSELECT,
 
@@ -461,6 +464,16 @@ typedef struct ExprEvalStep
 			FunctionCallInfo fcinfo_data;
 		}			minmax;
 
+		/* for EEOP_EDIT_DISTANCE */
+		struct
+		{
+			/* workspace for the two raw string operands */
+			Datum	   *values;
+			bool	   *nulls;
+			/* decomposed predicate: normalisation steps and threshold */
+			struct EditDistanceClause *clause;
+		}			editdistance;
+
 		/* for EEOP_FIELDSELECT */
 		struct
 		{
@@ -711,6 +724,7 @@ extern void ExecEvalArrayCoerce(ExprState *state, ExprEvalStep *op,
 					ExprContext *econtext);
 extern void ExecEvalRow(ExprState *state, ExprEvalStep *op);
 extern void ExecEvalMinMax(ExprState *state, ExprEvalStep *op);
+extern void ExecEvalEditDistance(ExprState *state, ExprEvalStep *op);
 extern void ExecEvalFieldSelect(ExprState *state, ExprEvalStep *op,
 					ExprContext *econtext);
 extern void ExecEvalFieldStoreDeForm(ExprState *state, ExprEvalStep *op,
@@ -0,0 +1,153 @@
+/*-------------------------------------------------------------------------
+ *
+ * simjoin.h
+ *	  internal structures for similarity joins over edit-distance clauses
+ *
+ * A nested loop whose join quals contain "levenshtein(o, i) <= k", with o
+ * reading only the outer input and i only the inner one, can be run by the
+ * routines in execSimjoin.c instead of comparing every pair of rows.
+ *
+ *
+ * Portions Copyright (c) 1996-2018, PostgreSQL Global Development Group
+ * Portions Copyright (c) 1994, Regents of the University of California
+ *
+ * src/include/executor/simjoin.h
+ *
+ *-------------------------------------------------------------------------
+ */
+#ifndef SIMJOIN_H
+#define SIMJOIN_H
+
+#include "nodes/execnodes.h"
+#include "optimizer/editdist.h"
+#include "utils/varlena.h"
+
+/*
+ * All rows of one join input, grouped by their normalised join key.
+ *
+ * Keys are ordered by character length, so the keys within edit distance k
+ * of a given key form a contiguous range of lengths.  The rows of key v are
+ * postings[firstPosting[v]] .. postings[firstPosting[v + 1] - 1].  Rows with
+ * a null key can never satisfy the clause and are not kept at all.
+ */
+typedef struct SimilarityDictionary
+{
+	int			nrows;			/* number of rows kept */
+	MinimalTuple *rows;			/* the rows, in input order */
+	int			nvalues;		/* number of distinct keys */
+	char	  **values;			/* the keys (not null-terminated) */
+	int		   *bytes;			/* byte length of each key */
+	int		   *chars;			/* character length of each key */
+	EditDistanceSignature *sigs;	/* prefilter signature of each key */
+	int		   *firstPosting;	/* nvalues + 1 offsets into postings */
+	int		   *postings;		/* row numbers, grouped by key */
+} SimilarityDictionary;
+
+/*
+ * One segment of an inner key in the PassJoin index.  Each key of at least
+ * k + 1 characters is cut into k + 1 segments; two keys within distance k
+ * must share one of them at a nearby position.
+ *
+ * The LSH index uses the same entries, one per band of each key's MinHash
+ * signature, and so does the blocking index, one per blocking key.
+ */
+typedef struct PassJoinSegment
+{
+	uint32		hash;			/* of key length, segment number and text, of
+								 * band number and band, or of blocking key */
+	int			value;			/* inner key number */
+} PassJoinSegment;
+
+/* LSH banding: SIMJOIN_LSH_BANDS bands of SIMJOIN_LSH_ROWS MinHashes each */
+#define SIMJOIN_LSH_BANDS	20
+#define SIMJOIN_LSH_ROWS	3
+#define SIMJOIN_LSH_HASHES	(SIMJOIN_LSH_BANDS * SIMJOIN_LSH_ROWS)
+
+/* Blocking checks about this many outer keys exhaustively */
+#define SIMJOIN_BLOCKING_SAMPLES	64
+
+typedef struct SimilarityJoinState
+{
+	EditDistanceClause clause;	/* the edit-distance join clause */
+	int			outerArgno;		/* which clause argument reads the outer */
+	ExprState  *outerKey;		/* clause argument over the outer input */
+	ExprState  *innerKey;		/* clause argument over the inner input */
+	ExprState  *restQual;		/* the remaining join quals */
+
+	MemoryContext cxt;			/* holds the dictionaries */
+	bool		built;			/* dictionaries have been built */
+	long		spaceUsed;		/* bytes taken by them so far */
+	bool		overflowed;		/* they did not fit in work_mem */
+	SimilarityDictionary outer;
+	SimilarityDictionary inner;
+	int		   *outerOrder;		/* outer keys, most frequent first */
+	TupleTableSlot *outerSlot;
+	TupleTableSlot *innerSlot;
+	LevenshteinSource source;	/* current outer key, preprocessed */
+
+	/* PassJoin index over the inner keys, sorted by hash */
+	bool		usePassJoin;
+	int			nsegments;
+	PassJoinSegment *segments;
+	int		   *probeStamp;		/* per inner key, last outerPos it was a
+								 * candidate for */
+
+	/* approximate (LSH) candidate generation; also uses the index above */
+	bool		useLSH;
+	int		   *innerGramStart; /* nvalues + 1 offsets into innerGrams */
+	uint32	   *innerGrams;		/* sorted bigram hashes of each inner key */
+	uint32	   *outerGrams;		/* ... of the current outer key */
+	int			nouterGrams;
+	double		lshFoundRows;	/* matching row pairs found */
+	double		lshEstimatedRows;	/* ... each weighted by 1 / P(found) */
+
+	/* blocking on phonetic or other keys; also uses the index above */
+	bool		useBlocking;
+	char	   *blockingKeys;	/* similarity_join_blocking_keys, for EXPLAIN */
+	int			nblockingFuncs;
+	FmgrInfo   *blockingFuncs;	/* text -> text key functions */
+	uint32	   *outerBlocks;	/* nblockingFuncs key hashes per outer key */
+	int			nblocks;		/* distinct blocking keys of the inner keys */
+	int			sampleInterval; /* check every sampleInterval-th outer key */
+	double		sampleRows;		/* matching row pairs of the sampled outer
+								 * keys */
+	double		sampleFoundRows;	/* ... that were candidates */
+
+	/*
+	 * distance-ordered output: the key pairs at distance 0 are found by exact
+	 * lookup and returned first, then each tier d = 1, 2, ... is found by
+	 * comparing the candidate pairs again with bound d
+	 */
+	bool		distanceOrdered;
+	int			tier;			/* distance being returned */
+	int			maxTier;		/* last tier that can hold a pair */
+	long	   *tierPairs;		/* key pairs found at distance 1 .. tier */
+	long		exactPairs;		/* key pairs at distance 0 */
+
+	/* position of the scan over key pairs */
+	int			outerPos;		/* current index into outerOrder */
+	int		   *candidates;		/* inner keys to compare with it */
+	int			ncandidates;
+	int			nextCandidate;
+	int			outerValue;		/* outer key of the current key pair */
+	int			innerValue;		/* inner key of the current key pair */
+	bool		expanding;		/* emitting the rows of a matched key pair */
+	int			outerPosting;	/* current row pair of that key pair */
+	int			innerPosting;
+
+	/* statistics shown by EXPLAIN ANALYZE */
+	long		candidatePairs; /* key pairs proposed for comparison */
+	long		prefilterRejects;	/* ... rejected by their signatures */
+	long		distanceCalls;	/* ... whose distance was computed */
+	long		matchedPairs;	/* ... that satisfied the clause */
+} SimilarityJoinState;
+
+extern SimilarityJoinState *ExecInitSimilarityJoin(NestLoopState *nlstate,
+					   Node *clause, EditDistanceClause *edc,
+					   int outerArgno);
+extern TupleTableSlot *ExecSimilarityJoin(NestLoopState *nlstate);
+extern void ExecReScanSimilarityJoin(NestLoopState *nlstate);
+extern double ExecSimilarityJoinRecall(SimilarityJoinState *sjstate);
+extern void ExecEndSimilarityJoin(SimilarityJoinState *sjstate);
+
+#endif							/* SIMJOIN_H */
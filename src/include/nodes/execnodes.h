@@ -1714,8 +1714,104 @@ typedef struct RelationPage {
 	TupleTableSlot* tuples[PAGE_SIZE]; 
 	int index;
 	int tupleCount;
+	struct EditDistanceSignature *signatures; /* per tuple, if prefiltering */
 } RelationPage;
 
+/*
+ * Prefilter for a levenshtein() join clause.  Signatures of both operands
+ * are computed as tuples enter a page, and pairs that fail the cheap bounds
+ * never reach the join quals.
+ */
+typedef struct EditDistanceFilter {
+	struct EditDistanceClause *clause;
+	ExprState *outerOperand; /* operand that reads the outer plan's tuple */
+	ExprState *innerOperand;
+	int outerArgno; /* index of outerOperand in clause->args */
+	long checkedPairs;
+	long lengthRejects;
+	long bagRejects;
+	long qgramRejects;
+} EditDistanceFilter;
+
+/*
+ * The inner side of a paged kernel with a levenshtein() join clause, read
+ * once and sorted by the character length of its join key.  Cut into pages,
+ * each inner page then covers a narrow range of lengths, and a page whose
+ * range is more than k away from every key length on the current outer page
+ * cannot hold a match for any of its tuples.  Such pages are skipped without being
+ * loaded.  The full pages of each pass may be visited in descending order of
+ * the rows they have returned per visit, so that outer pages meet the inner
+ * pages likely to match them first.  An inner side that does not fit in
+ * work_mem is paged through unbucketed instead.
+ */
+typedef struct LengthBucketedInner {
+	struct EditDistanceClause *clause;
+	ExprState *outerOperand;
+	ExprState *innerOperand;
+	int outerArgno;
+	MemoryContext cxt; /* holds the tuples */
+	bool built;
+	int ntuples;
+	MinimalTuple *tuples; /* by key length, null keys first */
+	int npages; /* full pages, then a partial or empty one */
+	int *pageMinLength; /* per page, over its non-null keys */
+	int *pageMaxLength;
+	int nextPage; /* next page to load, as a position in pageOrder */
+	bool orderByYield; /* reorder the pages on each rewind */
+	int *pageOrder; /* the pages of the current pass, in visiting order */
+	double *pageRows; /* per page, rows returned ... */
+	long *pageVisits; /* ... over this many visits */
+	int loadedPage; /* the page last loaded */
+	bool loadedPageSkipped; /* ... was out of reach and not loaded */
+	long orderedPasses; /* passes in order of yield */
+	int outerLengths[PAGE_SIZE]; /* distinct non-null key lengths of the
+								  * current outer page, ascending */
+	int nOuterLengths;
+	long skippedPages;
+} LengthBucketedInner;
+
+/*
+ * The blocks joined during the warm-up of a bandit join that chooses at
+ * runtime which input's pages are the arms, and the rows each returned.
+ * The warm-up ends at the latest when BANDIT_WARMUP_BLOCKS are recorded.
+ */
+#define BANDIT_WARMUP_BLOCKS 1024
+
+typedef struct BanditWarmupBlock {
+	int page[2]; /* of the outer [0] and inner [1] input */
+	long rows;
+} BanditWarmupBlock;
+
+typedef struct BanditFlipWarmup {
+	int nblocks;
+	BanditWarmupBlock blocks[BANDIT_WARMUP_BLOCKS];
+} BanditFlipWarmup;
+
+/*
+ * A prior on the yield of the arm pages of a bandit join, taken from the
+ * block sketches ANALYZE collected on the arm relation.  The other input's
+ * join keys are hashed into the buckets of the sketches' signatures, and
+ * each sketched block is predicted to yield, per row, the mean count of the
+ * buckets its own keys fall in.  Blocks are mapped to arm pages through the
+ * range of their xids.  The pages predicted to yield are explored first,
+ * best first, before the usual exploration order takes over.
+ */
+typedef struct BanditSketchPrior {
+	struct MVBlockSketch *sketch; /* of the arm relation */
+	int xidColumn; /* column of the sketch holding the xid ... */
+	int keyColumn; /* ... and the join key */
+	AttrNumber otherKeyAttno; /* join key in the other input's tuples */
+	FmgrInfo *hashProc; /* hash function of the join key's type */
+	Oid collation;
+	bool built; /* the pages have been ranked */
+	long otherRows; /* rows of the other input hashed */
+	int usedBlocks; /* sketched blocks that mapped to few enough pages */
+	int npages; /* pages predicted to yield ... */
+	int *pages; /* ... best first */
+	int nextPage; /* next of them to explore */
+	Bitmapset *served; /* the pages explored from the list */
+} BanditSketchPrior;
+
 typedef struct NestLoopState
 {
 	JoinState	js;				/* its first field is NodeTag */
@@ -1731,9 +1827,22 @@ typedef struct NestLoopState
 	int lastReward;
 	int reward;
 	bool isExploring;
-	long innerPageNumber;
-	long outerPageNumber;
+	long innerPageNumber; /* estimated until the inner has been read once */
+	long outerPageNumber; /* allocated length of joinedBlocks */
 	int sqrtOfInnerPages;
+	bool innerPagesKnown; /* innerPageNumber is exact */
+	int maxActivePages; /* allocated length of xids and rewards */
+	int activeSetLimit; /* explored pages held before exploiting */
+	int peakActiveSetLimit;
+	bool adaptiveActiveSet; /* activeSetLimit follows the scores */
+	long scoredPages; /* explored pages scored so far ... */
+	double scoreMean; /* ... the mean of their scores ... */
+	double scoreM2; /* ... and the sum of squared deviations from it */
+	int64 tupleBound; /* rows the parent will fetch, -1 if not known */
+	int deadlineMs; /* time budget of the join, 0 if none */
+	instr_time deadlineStart; /* when the join first ran */
+	bool deadlinePassed;
+	long outerPagesEstimate; /* outer pages expected at startup */
 	
 	bool needOuterPage;
 	bool needInnerPage;
@@ -1751,12 +1860,70 @@ typedef struct NestLoopState
 	int rescanCount;
 
 	int* xids; //TODO these could be heaps to improve time
-	int* rewards;
+	double* rewards; /* score of each active page: rows, or rows per ms */
+	double* stepYields; /* rows per inner page step of each active page */
 	int pageIndex;
-	int lastPageIndex;
+	int exploreStep; /* outer pages explored so far */
+	int explorePages; /* pages explored in permuted or extent order, 0 if
+					   * none */
+	int exploreHalfBits; /* half the width of the permutation's domain */
+	uint32 exploreSeed;
+	int extentPages; /* pages per extent ... */
+	int nextents; /* ... and extents, 0 if not exploring by extent */
+	int extentBits; /* bits of a page offset within an extent */
+	int *extentNext; /* per extent, pages explored so far */
+	uint32 *extentCursor; /* ... and the next offset to bit-reverse */
+	double *extentScores; /* ... the sum of their scores ... */
+	int *extentScored; /* ... and how many were scored */
 	ScanKey xidScanKey;
 
-	List** pageIdJoinIdLists;
+	Bitmapset** joinedBlocks; /* per outer input page, the inner input pages
+							   * fully joined with it */
+
+	/* runtime choice of which input's pages are the arms */
+	bool flipped; /* the inner input's pages are the arms */
+	bool flippedAtRuntime;
+	struct BanditFlipWarmup *warmup; /* NULL unless still deciding */
+	long warmupBlocks; /* blocks joined when the orientation was decided */
+	double inputSkew[2]; /* page yield skew of the outer and inner input */
+	ScanKey inputScanKeys[2]; /* the inputs' own index scan keys */
+	int inputNumScanKeys[2];
+	long blockRows; /* rows of the current block */
+	bool blockSkipped; /* the current block was joined before */
+
+	/* runtime switch to a block nested loop over the remaining pages */
+	bool adaptiveBlock; /* the switch is enabled */
+	bool blockMode; /* the switch has been made */
+	bool fullPage; /* the current outer page meets each inner page once */
+	long blockModeAfter; /* explored pages before the switch */
+	double blockModeScoreCV; /* their scores' coefficient of variation */
+	long blockModePages; /* outer pages joined in full after it */
+
+	/* exploring by joining arm pages with a sample of the other input */
+	int samplePages; /* pages in the sample, 0 if not sampling */
+	RelationPage **sample; /* drawn at the first exploration */
+	int sampleTuples; /* tuples in the sample ... */
+	long sampleInputTuples; /* ... out of this many */
+	long sampledPages; /* arm pages explored with the sample */
+
+	/* ranking arm pages by the block sketches of the arm relation */
+	struct BanditSketchPrior *sketchPrior; /* NULL unless ranking */
+
+	/* cost of the bandit join's work, for cost-aware rewards and EXPLAIN */
+	bool costAwareRewards; /* score pages by rows per ms, not rows */
+	instr_time clockStart; /* start of the work not yet charged */
+	double pageCost; /* ms charged to the current outer page */
+	long exploredPages;
+	long exploitedPages;
+	long evaluatedPairs; /* pairs whose join qual was evaluated */
+	double exploreTime; /* ms spent on explored pages */
+	double exploitTime; /* ... and on exploited ones */
+	long exploreRows; /* rows returned while exploring */
+	long exploitRows; /* ... and while exploiting */
+
+	EditDistanceFilter *edFilter; /* NULL unless prefiltering */
+	struct SimilarityJoinState *simJoin; /* NULL unless joining distinct keys */
+	LengthBucketedInner *lengthBuckets; /* NULL unless bucketing the inner */
 
 } NestLoopState;
 
@@ -694,12 +694,30 @@ typedef struct Join
  * Vars, but perhaps someday that'd be worth relaxing.  (Note: during plan
  * creation, the paramval can actually be a PlaceHolderVar expression; but it
  * must be a Var with varno OUTER_VAR by the time it gets to the executor.)
+ *
+ * simJoinStrategy tells the executor to run the join as a similarity join
+ * (see execSimjoin.c), and how.  The planner picks it from the settings in
+ * effect when the plan is made, so a cached plan keeps its strategy.
  * ----------------
  */
+typedef enum SimilarityJoinStrategy
+{
+	SIMJOIN_NONE,				/* not a similarity join */
+	SIMJOIN_DEDUP,				/* compare the distinct keys, length-filtered */
+	SIMJOIN_PASSJOIN,			/* ... segment-filtered */
+	SIMJOIN_BLOCKING,			/* ... sharing a blocking key (approximate) */
+	SIMJOIN_LSH					/* ... sharing an LSH band (approximate) */
+} SimilarityJoinStrategy;
+
 typedef struct NestLoop
 {
 	Join		join;
 	List	   *nestParams;		/* list of NestLoopParam nodes */
+	SimilarityJoinStrategy simJoinStrategy; /* how to run the edit distance
+											 * join clause, if at all */
+	char	   *simJoinBlockingKeys;	/* key functions for SIMJOIN_BLOCKING */
+	bool		distanceOrdered;	/* similarity join must return its rows
+									 * by increasing edit distance */
 } NestLoop;
 
 typedef struct NestLoopParam
@@ -16,6 +16,7 @@
 
 #include "nodes/plannodes.h"
 #include "nodes/relation.h"
+#include "optimizer/editdist.h"
 
 
 /* defaults for costsize.c's Cost parameters */
@@ -69,6 +70,24 @@ extern PGDLLIMPORT bool enable_hashjoin;
 extern PGDLLIMPORT bool enable_fastjoin;
 extern PGDLLIMPORT bool enable_block;
 extern PGDLLIMPORT bool enable_fliporder;
+extern PGDLLIMPORT bool enable_fusedlevenshtein;
+extern PGDLLIMPORT bool enable_levenshteinfilter;
+extern PGDLLIMPORT bool enable_dedupjoin;
+extern PGDLLIMPORT bool enable_passjoin;
+extern PGDLLIMPORT bool enable_lshjoin;
+extern PGDLLIMPORT bool enable_lengthbuckets;
+extern PGDLLIMPORT bool enable_innerpageorder;
+extern PGDLLIMPORT bool enable_progressivejoin;
+extern PGDLLIMPORT bool enable_costawarebandit;
+extern PGDLLIMPORT bool enable_adaptiveactiveset;
+extern PGDLLIMPORT bool enable_adaptiveflip;
+extern PGDLLIMPORT bool enable_adaptiveblock;
+extern PGDLLIMPORT bool enable_banditsketches;
+extern PGDLLIMPORT char *similarity_join_blocking_keys;
+extern PGDLLIMPORT int bandit_explore_seed;
+extern PGDLLIMPORT int bandit_explore_sample_pages;
+extern PGDLLIMPORT int bandit_extent_pages;
+extern PGDLLIMPORT int bandit_join_deadline;
 extern PGDLLIMPORT bool enable_gathermerge;
 extern PGDLLIMPORT bool enable_partitionwise_join;
 extern PGDLLIMPORT bool enable_partitionwise_aggregate;
@@ -141,6 +160,11 @@ extern void initial_cost_nestloop(PlannerInfo *root,
 					  JoinType jointype,
 					  Path *outer_path, Path *inner_path,
 					  JoinPathExtraData *extra);
+extern SimilarityJoinStrategy similarity_join_strategy(void);
+extern RestrictInfo *similarity_join_clause(JoinType jointype,
+					   Path *outer_path, Path *inner_path,
+					   List *restrictlist, EditDistanceClause *edc,
+					   int *outerArgno);
 extern void final_cost_nestloop(PlannerInfo *root, NestPath *path,
 					JoinCostWorkspace *workspace,
 					JoinPathExtraData *extra);
@@ -0,0 +1,78 @@
+/*-------------------------------------------------------------------------
+ *
+ * editdist.h
+ *	  prototypes for editdist.c
+ *
+ *
+ * Portions Copyright (c) 1996-2018, PostgreSQL Global Development Group
+ * Portions Copyright (c) 1994, Regents of the University of California
+ *
+ * src/include/optimizer/editdist.h
+ *
+ *-------------------------------------------------------------------------
+ */
+#ifndef EDITDIST_H
+#define EDITDIST_H
+
+#include "nodes/primnodes.h"
+
+/*
+ * One string operand of an edit-distance predicate.  The normalisation
+ * wrappers the similarity queries put around their join keys, i.e.
+ * trim(x::varchar(n)), are peeled off and remembered here so that callers
+ * can apply them to the raw string without building intermediate datums.
+ */
+typedef struct EditDistanceOperand
+{
+	Expr	   *expr;			/* expression producing the raw string */
+	int			truncLen;		/* character limit of varchar(n), or -1 */
+	bool		trim;			/* strip blanks after truncation? */
+} EditDistanceOperand;
+
+/*
+ * A recognised "levenshtein(a, b) <= k" style predicate.  Strict comparisons
+ * are folded into maxDistance, so the clause holds iff the distance between
+ * the two normalised operands is at most maxDistance.
+ */
+typedef struct EditDistanceClause
+{
+	EditDistanceOperand args[2];
+	int			maxDistance;
+	Oid			collation;		/* input collation of the distance function */
+} EditDistanceClause;
+
+/*
+ * Per-string summary used to reject pairs before computing their distance.
+ * Characters and character bigrams are hashed into a few buckets; merging
+ * buckets can only loosen the bounds derived from them, never break them.
+ */
+#define EDSIG_BUCKETS	32
+
+typedef struct EditDistanceSignature
+{
+	int			length;			/* length in characters, -1 if unknown */
+	uint8		chars[EDSIG_BUCKETS];	/* character histogram (saturating) */
+	uint16		qgrams[EDSIG_BUCKETS];	/* bigram histogram */
+} EditDistanceSignature;
+
+/* Results of edit_distance_prefilter() */
+typedef enum EditDistanceFilterResult
+{
+	EDFILTER_PASS,				/* pair may be within the threshold */
+	EDFILTER_LENGTH,			/* rejected: lengths differ by more than k */
+	EDFILTER_BAG,				/* rejected: character bag distance > k */
+	EDFILTER_QGRAM				/* rejected: too few common bigrams */
+} EditDistanceFilterResult;
+
+extern bool is_levenshtein_function(Oid funcid);
+extern Oid	edit_distance_index_operator(Oid opfamily, Oid *boundtype);
+extern bool match_edit_distance_clause(Node *clause, EditDistanceClause *edc);
+extern bool is_edit_distance_of_clause(Expr *expr, Node *clause);
+extern const char *edit_distance_normalize(const EditDistanceOperand *operand,
+						Datum value, int *len);
+extern void edit_distance_signature(const char *s, int len,
+						EditDistanceSignature *sig);
+extern EditDistanceFilterResult edit_distance_prefilter(const EditDistanceSignature *a,
+						const EditDistanceSignature *b, int maxDistance);
+
+#endif							/* EDITDIST_H */
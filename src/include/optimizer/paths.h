@@ -211,6 +211,12 @@ extern List *build_join_pathkeys(PlannerInfo *root,
 					RelOptInfo *joinrel,
 					JoinType jointype,
 					List *outer_pathkeys);
+extern List *similarity_join_pathkeys(PlannerInfo *root,
+						 JoinType jointype,
+						 Path *outer_path,
+						 Path *inner_path,
+						 List *restrictlist,
+						 List *pathkeys);
 extern List *make_pathkeys_for_sortclauses(PlannerInfo *root,
 							  List *sortclauses,
 							  List *tlist);
@@ -57,6 +57,12 @@ extern MVDependencies *statext_dependencies_build(int numrows, HeapTuple *rows,
 extern bytea *statext_dependencies_serialize(MVDependencies *dependencies);
 extern MVDependencies *statext_dependencies_deserialize(bytea *data);
 
+extern MVBlockSketch *statext_blocksketch_build(Relation onerel,
+						  int numrows, HeapTuple *rows,
+						  Bitmapset *attrs, VacAttrStats **stats);
+extern bytea *statext_blocksketch_serialize(MVBlockSketch *sketch);
+extern MVBlockSketch *statext_blocksketch_deserialize(bytea *data);
+
 extern MultiSortSupport multi_sort_init(int ndims);
 extern void multi_sort_add_dimension(MultiSortSupport mss, int sortdim,
 						 Oid oper);
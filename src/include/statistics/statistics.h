@@ -78,8 +78,69 @@ typedef struct MVDependencies
 /* size of the struct excluding the deps array */
 #define SizeOfDependencies	(offsetof(MVDependencies, ndeps) + sizeof(uint32))
 
+#define STATS_BLOCKSKETCH_MAGIC		0xC7D1B3E5	/* marks serialized bytea */
+#define STATS_BLOCKSKETCH_TYPE_BASIC	1	/* basic block sketch type */
+
+/* bits in the hash signature of each column of each block */
+#define STATS_BLOCKSKETCH_BITS		256
+#define STATS_BLOCKSKETCH_WORDS		(STATS_BLOCKSKETCH_BITS / 32)
+
+/* sketch at most this many of the blocks ANALYZE sampled */
+#define STATS_BLOCKSKETCH_MAX_BLOCKS	10000
+
+/*
+ * Summary of the values of one column in one heap block: the range of the
+ * values, for integer columns only, and a signature with one bit set for the
+ * hash of each value.  Two blocks, or a block and a set of values, can share
+ * a value only if their signatures share a bit.
+ */
+typedef struct MVBlockSketchColumn
+{
+	bool		hasRange;		/* min and max are valid */
+	bool		hasHashes;		/* signature is valid */
+	int64		min;			/* smallest value in the block */
+	int64		max;			/* largest value in the block */
+	uint32		signature[STATS_BLOCKSKETCH_WORDS];
+} MVBlockSketchColumn;
+
+/* Summaries of the columns of one heap block */
+typedef struct MVBlockSketchItem
+{
+	BlockNumber block;			/* heap block summarised */
+	uint32		nrows;			/* visible rows in it */
+	MVBlockSketchColumn columns[FLEXIBLE_ARRAY_MEMBER];
+} MVBlockSketchItem;
+
+/* size of an item with ncolumns columns */
+#define SizeOfBlockSketchItem(ncolumns) \
+	MAXALIGN(offsetof(MVBlockSketchItem, columns) + \
+			 (ncolumns) * sizeof(MVBlockSketchColumn))
+
+/*
+ * Per-block sketches of a relation, for the blocks ANALYZE sampled, in block
+ * order.  The columns are those of the statistics object, in attnum order.
+ */
+typedef struct MVBlockSketch
+{
+	uint32		magic;			/* magic constant marker */
+	uint32		type;			/* type of block sketch (BASIC) */
+	uint32		nblocks;		/* number of blocks sketched */
+	uint32		ncolumns;		/* number of columns per block */
+	AttrNumber	attnums[STATS_MAX_DIMENSIONS];	/* the columns */
+	char		items[FLEXIBLE_ARRAY_MEMBER];	/* nblocks items */
+} MVBlockSketch;
+
+/* size of the struct excluding the items array */
+#define SizeOfBlockSketch	offsetof(MVBlockSketch, items)
+
+/* item i of a block sketch */
+#define BlockSketchGetItem(sketch, i) \
+	((MVBlockSketchItem *) ((sketch)->items + \
+							(i) * SizeOfBlockSketchItem((sketch)->ncolumns)))
+
 extern MVNDistinct *statext_ndistinct_load(Oid mvoid);
 extern MVDependencies *statext_dependencies_load(Oid mvoid);
+extern MVBlockSketch *statext_blocksketch_load(Oid mvoid);
 
 extern void BuildRelationExtStatistics(Relation onerel, double totalrows,
 						   int numrows, HeapTuple *rows,
@@ -18,6 +18,7 @@
 #include "fmgr.h"
 #include "access/htup.h"
 #include "nodes/relation.h"
+#include "optimizer/editdist.h"
 
 
 /*
@@ -200,6 +201,8 @@ extern int	estimate_array_length(Node *arrayexpr);
 extern Selectivity rowcomparesel(PlannerInfo *root,
 			  RowCompareExpr *clause,
 			  int varRelid, JoinType jointype, SpecialJoinInfo *sjinfo);
+extern Selectivity edit_distance_selectivity(PlannerInfo *root,
+						  EditDistanceClause *edc, int varRelid);
 
 extern void mergejoinscansel(PlannerInfo *root, Node *clause,
 				 Oid opfamily, int strategy, bool nulls_first,
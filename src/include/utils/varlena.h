@@ -16,6 +16,27 @@
 #include "nodes/pg_list.h"
 #include "utils/sortsupport.h"
 
+/*
+ * Levenshtein distance arguments longer than this are rejected, unless the
+ * caller asserts it bounds the work some other way.
+ */
+#define MAX_LEVENSHTEIN_STRLEN		255
+
+/*
+ * A Levenshtein source string preprocessed by varstr_levenshtein_prepare(),
+ * for callers that compare one string against many others.
+ */
+typedef struct LevenshteinSource
+{
+	char	   *str;			/* private copy of the string */
+	int			slen;			/* its length in bytes */
+	int			m;				/* its length in characters */
+	int		   *char_len;		/* byte length of each character, then 0 */
+	int		   *rows;			/* two rows of the distance matrix */
+	int			str_space;		/* allocated size of str */
+	int			char_space;		/* allocated entries of char_len */
+} LevenshteinSource;
+
 extern int	varstr_cmp(const char *arg1, int len1, const char *arg2, int len2, Oid collid);
 extern void varstr_sortsupport(SortSupport ssup, Oid collid, bool bpchar);
 extern int varstr_levenshtein(const char *source, int slen,
@@ -26,6 +47,16 @@ extern int varstr_levenshtein_less_equal(const char *source, int slen,
 							  const char *target, int tlen,
 							  int ins_c, int del_c, int sub_c,
 							  int max_d, bool trusted);
+extern void varstr_levenshtein_prepare(LevenshteinSource *src,
+						   const char *source, int slen);
+extern int varstr_levenshtein_prepared(const LevenshteinSource *source,
+							const char *target, int tlen,
+							int ins_c, int del_c, int sub_c,
+							bool trusted);
+extern int varstr_levenshtein_less_equal_prepared(const LevenshteinSource *source,
+									   const char *target, int tlen,
+									   int ins_c, int del_c, int sub_c,
+									   int max_d, bool trusted);
 extern List *textToQualifiedNameList(text *textval);
 extern bool SplitIdentifierString(char *rawstring, char separator,
 					  List **namelist);
@@ -0,0 +1,234 @@
+--
+-- Bandit nested loop join
+--
+-- The bandit join explores the pages of its outer input in some order and
+-- exploits the ones that yield the most rows, so it returns the rows of a
+-- plain nested loop in a different order.  The tests compare aggregates.
+--
+SET enable_hashjoin = off;
+SET enable_mergejoin = off;
+SET enable_material = off;
+SET enable_bitmapscan = off;
+SET enable_seqscan = off;
+SET enable_block = off;
+
+-- the arms outgrow their estimated pages while the join runs; with the
+-- inputs flipped, the pages of the big inner input are the arms
+CREATE TABLE bandit_big (id int PRIMARY KEY, k int) WITH (autovacuum_enabled = off);
+CREATE TABLE bandit_small (id int PRIMARY KEY, k int);
+INSERT INTO bandit_big SELECT i, i % 13 FROM generate_series(1, 100) i;
+INSERT INTO bandit_small SELECT i, i % 11 FROM generate_series(1, 64) i;
+ANALYZE bandit_big;
+ANALYZE bandit_small;
+INSERT INTO bandit_big SELECT i, i % 13 FROM generate_series(101, 40000) i;
+SELECT count(*), sum(x.id::bigint * y.id) FROM bandit_big x JOIN bandit_small y
+  ON x.k = y.k WHERE x.id > 0 AND y.id > 0;
+SET enable_fastjoin = on;
+SET enable_fliporder = on;
+EXPLAIN (COSTS OFF)
+SELECT * FROM bandit_big x JOIN bandit_small y
+  ON x.k = y.k WHERE x.id > 0 AND y.id > 0;
+SELECT count(*), sum(x.id::bigint * y.id) FROM bandit_big x JOIN bandit_small y
+  ON x.k = y.k WHERE x.id > 0 AND y.id > 0;
+RESET enable_fliporder;
+RESET enable_fastjoin;
+DROP TABLE bandit_big;
+
+-- with a seed, the arms are explored in a pseudo-random order that visits
+-- each page once, for a power of two of pages and for any other number
+CREATE TABLE bandit_pow2 (id int PRIMARY KEY, k int);
+CREATE TABLE bandit_odd (id int PRIMARY KEY, k int);
+INSERT INTO bandit_pow2 SELECT i, i % 13 FROM generate_series(1, 2047) i;
+INSERT INTO bandit_odd SELECT i, i % 13 FROM generate_series(1, 1601) i;
+ANALYZE bandit_pow2;
+ANALYZE bandit_odd;
+SELECT count(*), sum(x.id::bigint * y.id) FROM bandit_pow2 x JOIN bandit_small y
+  ON x.k = y.k WHERE x.id > 0 AND y.id > 0;
+SELECT count(*), sum(x.id::bigint * y.id) FROM bandit_odd x JOIN bandit_small y
+  ON x.k = y.k WHERE x.id > 0 AND y.id > 0;
+SET enable_fastjoin = on;
+SET enable_fliporder = on;
+SET bandit_explore_seed = 42;
+SELECT count(*), sum(x.id::bigint * y.id) FROM bandit_pow2 x JOIN bandit_small y
+  ON x.k = y.k WHERE x.id > 0 AND y.id > 0;
+SELECT count(*), sum(x.id::bigint * y.id) FROM bandit_odd x JOIN bandit_small y
+  ON x.k = y.k WHERE x.id > 0 AND y.id > 0;
+SET bandit_explore_seed = 7;
+SELECT count(*), sum(x.id::bigint * y.id) FROM bandit_odd x JOIN bandit_small y
+  ON x.k = y.k WHERE x.id > 0 AND y.id > 0;
+RESET bandit_explore_seed;
+RESET enable_fliporder;
+RESET enable_fastjoin;
+DROP TABLE bandit_pow2;
+
+-- pages ranked by rows per unit of work return the same rows
+SET enable_fastjoin = on;
+SET enable_fliporder = on;
+SET enable_costawarebandit = on;
+SELECT count(*), sum(x.id::bigint * y.id) FROM bandit_odd x JOIN bandit_small y
+  ON x.k = y.k WHERE x.id > 0 AND y.id > 0;
+RESET enable_costawarebandit;
+RESET enable_fliporder;
+RESET enable_fastjoin;
+
+-- with adaptive sizing, an active set of pages that all score alike is halved
+CREATE TABLE bandit_mid (id int PRIMARY KEY, k int);
+INSERT INTO bandit_mid SELECT i, i % 11 FROM generate_series(1, 512) i;
+ANALYZE bandit_mid;
+SELECT count(*), sum(x.id::bigint * y.id) FROM bandit_odd x JOIN bandit_mid y
+  ON x.k = y.k WHERE x.id > 0 AND y.id > 0;
+SET enable_fastjoin = on;
+SET enable_fliporder = on;
+SET enable_adaptiveactiveset = on;
+EXPLAIN (ANALYZE, COSTS OFF, TIMING OFF, SUMMARY OFF)
+SELECT * FROM bandit_odd x JOIN bandit_mid y
+  ON x.k = y.k WHERE x.id > 0 AND y.id > 0;
+SELECT count(*), sum(x.id::bigint * y.id) FROM bandit_odd x JOIN bandit_mid y
+  ON x.k = y.k WHERE x.id > 0 AND y.id > 0;
+RESET enable_adaptiveactiveset;
+EXPLAIN (ANALYZE, COSTS OFF, TIMING OFF, SUMMARY OFF)
+SELECT * FROM bandit_odd x JOIN bandit_mid y
+  ON x.k = y.k WHERE x.id > 0 AND y.id > 0;
+RESET enable_fliporder;
+RESET enable_fastjoin;
+
+-- a LIMIT bounds the active set, and a rescan starts the join over
+SELECT o.n, (SELECT count(*) FROM bandit_odd x JOIN bandit_mid y
+  ON x.k = y.k WHERE x.id > 0 AND y.id > 0 AND y.id % 5 = o.n)
+  FROM generate_series(0, 3) o(n);
+SET enable_fastjoin = on;
+SET enable_fliporder = on;
+EXPLAIN (ANALYZE, COSTS OFF, TIMING OFF, SUMMARY OFF)
+SELECT * FROM bandit_odd x JOIN bandit_mid y
+  ON x.k = y.k WHERE x.id > 0 AND y.id > 0 LIMIT 50;
+SELECT count(*) FROM (SELECT * FROM bandit_odd x JOIN bandit_mid y
+  ON x.k = y.k WHERE x.id > 0 AND y.id > 0 LIMIT 50) s;
+SELECT o.n, (SELECT count(*) FROM bandit_odd x JOIN bandit_mid y
+  ON x.k = y.k WHERE x.id > 0 AND y.id > 0 AND y.id % 5 = o.n)
+  FROM generate_series(0, 3) o(n);
+SELECT o.n, (SELECT count(*) FROM (SELECT * FROM bandit_odd x JOIN bandit_mid y
+  ON x.k = y.k WHERE x.id > 0 AND y.id > 0 AND y.id % 5 = o.n LIMIT 100) s)
+  FROM generate_series(0, 3) o(n);
+RESET enable_fliporder;
+RESET enable_fastjoin;
+
+-- a deadline ends the join with a notice, and each rescan has it anew;
+-- every full block of the join naps longer than the deadline, so that it
+-- is always passed after the first one
+CREATE FUNCTION bandit_nap(a int, b int) RETURNS int LANGUAGE plpgsql AS $$
+BEGIN
+  IF a % 32 = 1 AND b % 32 = 1 THEN
+    PERFORM pg_sleep(0.002);
+  END IF;
+  RETURN 0;
+END $$;
+SET enable_fastjoin = on;
+SET enable_fliporder = on;
+SET bandit_join_deadline = 1;
+\set VERBOSITY terse
+SELECT o.n, (SELECT count(*) FROM bandit_odd x JOIN bandit_mid y
+  ON x.k = y.k + bandit_nap(x.id, y.id)
+  WHERE x.id > 0 AND y.id > 0 AND y.id > o.n) > 0 AS some_rows
+  FROM generate_series(0, 2) o(n);
+\set VERBOSITY default
+RESET bandit_join_deadline;
+RESET enable_fliporder;
+RESET enable_fastjoin;
+DROP FUNCTION bandit_nap(int, int);
+
+-- the warm-up makes the pages of the skewed inner input the arms, and does
+-- so again on each rescan, which starts from the outer input's pages
+CREATE TABLE bandit_clu (id int PRIMARY KEY, k int);
+INSERT INTO bandit_clu
+  SELECT i, CASE WHEN i <= 96 THEN i % 11 ELSE -1 END FROM generate_series(1, 640) i;
+ANALYZE bandit_clu;
+SELECT o.n, (SELECT count(*) FROM bandit_clu x JOIN bandit_mid y
+  ON x.k = y.k AND x.id + y.id > o.n WHERE x.id > 0 AND y.id > 0)
+  FROM generate_series(0, 2) o(n);
+SET enable_fastjoin = on;
+SET enable_adaptiveflip = on;
+EXPLAIN (ANALYZE, COSTS OFF, TIMING OFF, SUMMARY OFF)
+SELECT o.n, (SELECT count(*) FROM bandit_clu x JOIN bandit_mid y
+  ON x.k = y.k AND x.id + y.id > o.n WHERE x.id > 0 AND y.id > 0)
+  FROM generate_series(0, 2) o(n);
+SELECT o.n, (SELECT count(*) FROM bandit_clu x JOIN bandit_mid y
+  ON x.k = y.k AND x.id + y.id > o.n WHERE x.id > 0 AND y.id > 0)
+  FROM generate_series(0, 2) o(n);
+RESET enable_adaptiveflip;
+RESET enable_fastjoin;
+DROP TABLE bandit_clu;
+
+-- pages that all score alike are handed over to a block nested loop, which
+-- skips the blocks the bandit has joined
+SET enable_fastjoin = on;
+SET enable_fliporder = on;
+SET enable_adaptiveblock = on;
+EXPLAIN (ANALYZE, COSTS OFF, TIMING OFF, SUMMARY OFF)
+SELECT * FROM bandit_odd x JOIN bandit_mid y
+  ON x.k = y.k WHERE x.id > 0 AND y.id > 0;
+SELECT count(*), sum(x.id::bigint * y.id) FROM bandit_odd x JOIN bandit_mid y
+  ON x.k = y.k WHERE x.id > 0 AND y.id > 0;
+RESET enable_adaptiveblock;
+RESET enable_fliporder;
+RESET enable_fastjoin;
+
+-- pages explored with a sample of the other input are joined in full when
+-- exploited; a rescan that changes that input draws a new sample
+SELECT o.n, (SELECT count(*) FROM bandit_odd x JOIN bandit_mid y
+  ON x.k = y.k WHERE x.id > 0 AND y.id > 0 AND y.id > o.n * 100)
+  FROM generate_series(0, 3) o(n);
+SET enable_fastjoin = on;
+SET enable_fliporder = on;
+SET bandit_explore_sample_pages = 2;
+SELECT count(*), sum(x.id::bigint * y.id) FROM bandit_odd x JOIN bandit_mid y
+  ON x.k = y.k WHERE x.id > 0 AND y.id > 0;
+EXPLAIN (ANALYZE, COSTS OFF, TIMING OFF, SUMMARY OFF)
+SELECT o.n, (SELECT count(*) FROM bandit_odd x JOIN bandit_mid y
+  ON x.k = y.k WHERE x.id > 0 AND y.id > 0 AND y.id > o.n * 100)
+  FROM generate_series(0, 3) o(n);
+SELECT o.n, (SELECT count(*) FROM bandit_odd x JOIN bandit_mid y
+  ON x.k = y.k WHERE x.id > 0 AND y.id > 0 AND y.id > o.n * 100)
+  FROM generate_series(0, 3) o(n);
+RESET bandit_explore_sample_pages;
+RESET enable_fliporder;
+RESET enable_fastjoin;
+
+-- pages explored extent by extent, and the last extent only partly filled
+SET enable_fastjoin = on;
+SET enable_fliporder = on;
+SET bandit_extent_pages = 8;
+EXPLAIN (ANALYZE, COSTS OFF, TIMING OFF, SUMMARY OFF)
+SELECT * FROM bandit_odd x JOIN bandit_mid y
+  ON x.k = y.k WHERE x.id > 0 AND y.id > 0;
+SELECT count(*), sum(x.id::bigint * y.id) FROM bandit_odd x JOIN bandit_mid y
+  ON x.k = y.k WHERE x.id > 0 AND y.id > 0;
+SELECT count(*), sum(x.id::bigint * y.id) FROM bandit_odd x JOIN bandit_small y
+  ON x.k = y.k WHERE x.id > 0 AND y.id > 0;
+RESET bandit_extent_pages;
+RESET enable_fliporder;
+RESET enable_fastjoin;
+
+-- the block sketches of the arm relation rank the pages holding the only
+-- matching keys first
+CREATE TABLE bandit_sketched (id int PRIMARY KEY, k int);
+INSERT INTO bandit_sketched
+  SELECT i, CASE WHEN i BETWEEN 801 AND 896 THEN i % 11 ELSE -1 END
+  FROM generate_series(1, 1600) i;
+CREATE STATISTICS bandit_sketched_stat (blocksketch) ON id, k FROM bandit_sketched;
+ANALYZE bandit_sketched;
+SELECT count(*), sum(x.id::bigint * y.id) FROM bandit_sketched x JOIN bandit_mid y
+  ON x.k = y.k WHERE x.id > 0 AND y.id > 0;
+SET enable_fastjoin = on;
+SET enable_fliporder = on;
+EXPLAIN (ANALYZE, COSTS OFF, TIMING OFF, SUMMARY OFF)
+SELECT * FROM bandit_sketched x JOIN bandit_mid y
+  ON x.k = y.k WHERE x.id > 0 AND y.id > 0;
+SELECT count(*), sum(x.id::bigint * y.id) FROM bandit_sketched x JOIN bandit_mid y
+  ON x.k = y.k WHERE x.id > 0 AND y.id > 0;
+RESET enable_fliporder;
+RESET enable_fastjoin;
+DROP TABLE bandit_sketched;
+
+DROP TABLE bandit_mid;
+DROP TABLE bandit_odd;
+DROP TABLE bandit_small;
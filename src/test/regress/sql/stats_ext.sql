@@ -290,3 +290,31 @@ EXPLAIN (COSTS OFF)
  SELECT * FROM functional_dependencies WHERE a = 1 AND b = '1' AND c = 1;
 
 RESET random_page_cost;
+
+-- block sketch tests
+CREATE TABLE block_sketches (a int, b int, c text);
+
+-- a block sketch alone may cover a single column, the other kinds may not
+CREATE STATISTICS tst ON a FROM block_sketches;
+CREATE STATISTICS tst (ndistinct, blocksketch) ON a FROM block_sketches;
+CREATE STATISTICS bs_a_stat (blocksketch) ON a FROM block_sketches;
+CREATE STATISTICS bs_a_b_stat (blocksketch) ON a, b FROM block_sketches;
+SELECT pg_get_statisticsobjdef(oid) FROM pg_statistic_ext WHERE stxname = 'bs_a_stat';
+
+-- ANALYZE builds the sketches
+INSERT INTO block_sketches SELECT i, i % 7, i::text FROM generate_series(1, 1000) i;
+SELECT stxname, stxkind, stxblocksketch IS NOT NULL AS built
+  FROM pg_statistic_ext WHERE stxname LIKE 'bs_%' ORDER BY stxname;
+ANALYZE block_sketches;
+SELECT stxname, stxkind, stxblocksketch IS NOT NULL AS built
+  FROM pg_statistic_ext WHERE stxname LIKE 'bs_%' ORDER BY stxname;
+
+-- a change of column type resets the sketches covering it until the next ANALYZE
+ALTER TABLE block_sketches ALTER COLUMN b TYPE bigint;
+SELECT stxname, stxkind, stxblocksketch IS NOT NULL AS built
+  FROM pg_statistic_ext WHERE stxname LIKE 'bs_%' ORDER BY stxname;
+ANALYZE block_sketches;
+SELECT stxname, stxkind, stxblocksketch IS NOT NULL AS built
+  FROM pg_statistic_ext WHERE stxname LIKE 'bs_%' ORDER BY stxname;
+
+DROP TABLE block_sketches;